@@ -0,0 +1,123 @@
+#include "Aot.hpp"
+
+Interpreter* aot_interpreter;
+
+AotFn::AotFn(Code code, int arity) : Callable(OBJ_AOT_FN), code(code), arity(arity) {}
+
+Value AotFn::call(Interpreter* interpreter, const std::vector<Value>& arguments) {
+	return code(this, nullptr, arguments.data());
+}
+
+Value AotFn::call_method(Interpreter* interpreter, Value receiver, const std::vector<Value>& arguments) {
+	return code(this, &receiver, arguments.data());
+}
+
+int AotFn::num_params() {
+	return arity;
+}
+
+void AotFn::trace() {
+	for (auto u : upvalues) heap.mark(u);
+}
+
+Value aot_binary(const Token& op, const Value& left, const Value& right) {
+	return aot_interpreter->binary(op, left, right);
+}
+
+Value aot_negate(const Token& op, const Value& right) {
+	if (!right.is_number()) throw RuntimeError(op, "Operand must be a number");
+	return Value(-right.as_number());
+}
+
+Value aot_get_global(const Token& name) {
+	return aot_interpreter->globals->get(name);
+}
+
+void aot_set_global(const Token& name, const Value& val) {
+	aot_interpreter->globals->assign(name, val);
+}
+
+void aot_define_global(const Token& name, const Value& val) {
+	aot_interpreter->globals->define(name.symbol, val);
+}
+
+// Compiled callees take the arguments where they are. Anything else gets
+// them copied into a vector, as the Interpreter passes them.
+static Value call_callable(const Token& paren, const Value& callee, const Value* receiver, const Value* args, int argc) {
+	if (!callee.is_callable()) throw RuntimeError(paren, "Object is not callable");
+	auto fn = static_cast<Callable*>(callee.as_obj());
+	if (argc != fn->num_params()) throw RuntimeError(paren, "Incorect number of arguments");
+	if (fn->obj_type == OBJ_AOT_FN) {
+		auto compiled = static_cast<AotFn*>(fn);
+		return compiled->code(compiled, receiver, args);
+	}
+	std::vector<Value> arguments(args, args + argc);
+	Root arguments_root(arguments);
+	try {
+		if (receiver != nullptr) return fn->call_method(aot_interpreter, *receiver, arguments);
+		return fn->call(aot_interpreter, arguments);
+	} catch (NativeError& e) {
+		throw RuntimeError(paren, e.what());
+	}
+}
+
+Value aot_call(const Token& paren, const Value* callee_args, int argc) {
+	return call_callable(paren, callee_args[0], nullptr, callee_args + 1, argc);
+}
+
+AotMethod aot_lookup(const Token& name, const Value& obj, InlineCache& cache) {
+	if (!obj.is_instance()) throw RuntimeError(name, "Only instances have properties");
+	auto instance = static_cast<Instance*>(obj.as_obj());
+	const CacheEntry* entry = instance->lookup(name.symbol, cache);
+	if (entry == nullptr) throw RuntimeError(name, "Undefined property '" + std::string(name.lexeme) + "'");
+	if (entry->index >= 0) return AotMethod { instance->fields[entry->index], true };
+	return AotMethod { entry->method, false };
+}
+
+Value aot_invoke(const Token& paren, const AotMethod& method, const Value* receiver_args, int argc) {
+	if (method.is_field) return call_callable(paren, method.callee, nullptr, receiver_args + 1, argc);
+	return call_callable(paren, method.callee, receiver_args, receiver_args + 1, argc);
+}
+
+Value aot_get(const Token& name, const Value& obj, InlineCache& cache) {
+	if (obj.is_instance()) return static_cast<Instance*>(obj.as_obj())->get(name, cache);
+	throw RuntimeError(name, "Only instances have properties");
+}
+
+Instance* aot_set_target(const Token& name, const Value& obj) {
+	if (obj.is_instance()) return static_cast<Instance*>(obj.as_obj());
+	throw RuntimeError(name, "Only instances have feilds");
+}
+
+AotFn* aot_fn(AotFn::Code code, int arity, std::initializer_list<Box*> upvalues) {
+	auto fn = heap.alloc<AotFn>(code, arity);
+	fn->upvalues.assign(upvalues.begin(), upvalues.end());
+	return fn;
+}
+
+Class* aot_class(const Token& name) {
+	auto methods = std::make_shared<std::unordered_map<Symbol, Callable*>>();
+	return heap.alloc<Class>(std::string(name.lexeme), methods);
+}
+
+void aot_add_method(Class* klass, const Token& name, AotFn* method) {
+	(*klass->methods)[name.symbol] = method;
+}
+
+void aot_print(const Value& val) {
+	std::cout << aot_interpreter->stringify(val) << '\n';
+}
+
+int aot_main(void (*init)(), void (*script)()) {
+	heap.set_stack_base(__builtin_frame_address(0));
+	Interpreter interpreter;
+	aot_interpreter = &interpreter;
+	init();
+	try {
+		script();
+	} catch (RuntimeError& e) {
+		std::cout << "Runtime error: [line: " << e.token.line << "] " << e.what() << '\n';
+		return 65;
+	}
+	return 0;
+}
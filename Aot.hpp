@@ -0,0 +1,100 @@
+#ifndef AOT
+#define AOT
+
+#include <vector>
+#include <iostream>
+#include <initializer_list>
+#include <math.h>
+#include "Interpreter.hpp"
+#include "Callable.hpp"
+#include "Environment.hpp"
+#include "Heap.hpp"
+#include "Symbol.hpp"
+
+// Runtime for programs compiled with --aot. The generated C++ includes
+// this header and links against libjlox.a, the interpreter's objects minus
+// main. Values, the heap, classes, instances and the natives are the same
+// ones the tree walker uses. Every operation checks and fails exactly as
+// the Interpreter does, with the same tokens. The generated code keeps
+// locals in C++ arrays and temporaries, which the heap finds with its scan
+// of the native stack.
+
+// Set up by the generated main. Natives get it as their Interpreter, and
+// it holds the globals.
+extern Interpreter* aot_interpreter;
+
+// A fn, method or lambda compiled to a C++ function. arguments has arity
+// entries, receiver is null unless it is called as a method.
+struct AotFn : public Callable {
+	typedef Value (*Code)(AotFn* self, const Value* receiver, const Value* arguments);
+
+	Code code;
+	int arity;
+	Upvalues upvalues;
+
+	AotFn(Code code, int arity);
+
+	Value call(Interpreter* interpreter, const std::vector<Value>& arguments) override;
+
+	Value call_method(Interpreter* interpreter, Value receiver, const std::vector<Value>& arguments) override;
+
+	int num_params() override;
+
+	void trace() override;
+};
+
+// What obj.name resolved to at an invoke, before its arguments run.
+struct AotMethod {
+	Value callee;
+	bool is_field;
+};
+
+inline bool aot_truthy(const Value& val) {
+	if (val.is_nil()) return false;
+	if (val.is_bool()) return val.as_bool();
+	return true;
+}
+
+inline Value& aot_boxed(const Value& box) {
+	return static_cast<Box*>(box.as_obj())->val;
+}
+
+inline Value aot_box(Value val) {
+	return heap.alloc<Box>(val);
+}
+
+Value aot_binary(const Token& op, const Value& left, const Value& right);
+
+Value aot_negate(const Token& op, const Value& right);
+
+Value aot_get_global(const Token& name);
+
+void aot_set_global(const Token& name, const Value& val);
+
+void aot_define_global(const Token& name, const Value& val);
+
+// callee_args holds the callee followed by its argc arguments.
+Value aot_call(const Token& paren, const Value* callee_args, int argc);
+
+AotMethod aot_lookup(const Token& name, const Value& obj, InlineCache& cache);
+
+// receiver_args holds the receiver followed by the argc arguments.
+Value aot_invoke(const Token& paren, const AotMethod& method, const Value* receiver_args, int argc);
+
+Value aot_get(const Token& name, const Value& obj, InlineCache& cache);
+
+Instance* aot_set_target(const Token& name, const Value& obj);
+
+AotFn* aot_fn(AotFn::Code code, int arity, std::initializer_list<Box*> upvalues);
+
+Class* aot_class(const Token& name);
+
+void aot_add_method(Class* klass, const Token& name, AotFn* method);
+
+void aot_print(const Value& val);
+
+// Runs the compiled script the way run_file runs one, with the same
+// report and exit status for a runtime error.
+int aot_main(void (*init)(), void (*script)());
+
+#endif
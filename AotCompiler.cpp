@@ -0,0 +1,428 @@
+#include "AotCompiler.hpp"
+#include <cstdio>
+#include <math.h>
+
+AotCompiler::AotCompiler() : fn(nullptr), num_caches(0), num_hoisted(0), next_temp(0), next_label(0) {}
+
+std::string AotCompiler::compile(Span<Stmt*> stmts) {
+	Function script { "", 1, 0, {} };
+	fn = &script;
+	for (auto s : stmts) compile(s);
+	fn = nullptr;
+
+	std::string out;
+	out += "// Generated by --aot. Build against libjlox.a, see the makefile.\n";
+	out += "#include \"Aot.hpp\"\n\n";
+	auto table = [&](const char* decl, size_t size) {
+		out += std::string("static ") + decl + "[" + std::to_string(std::max(size, (size_t) 1)) + "];\n";
+	};
+	table("Token T", tokens.size());
+	table("Value K", constants.size());
+	table("InlineCache C", num_caches);
+	table("Value H", num_hoisted);
+	out += "\n";
+	for (size_t i = 0; i < functions.size(); i++) out += signature(i) + ";\n";
+	out += "\n";
+	for (auto& f : functions) out += f + "\n";
+	out += "static void init() {\n";
+	for (size_t i = 0; i < tokens.size(); i++) out += "\tT[" + std::to_string(i) + "] = " + tokens[i] + ";\n";
+	for (size_t i = 0; i < constants.size(); i++) {
+		out += "\tK[" + std::to_string(i) + "] = symbols.string(symbols.intern(" + constants[i] + "));\n";
+	}
+	out += "}\n\n";
+	out += "static void script() {\n";
+	out += frame(script.num_slots);
+	out += script.code;
+	out += "}\n\n";
+	out += "int main() {\n\treturn aot_main(init, script);\n}\n";
+	return out;
+}
+
+Value AotCompiler::visit_literal_expr(Literal* expr) {
+	const Value& val = expr->val;
+	if (val.is_nil()) result = "Value()";
+	else if (val.is_bool()) result = val.as_bool() ? "Value(true)" : "Value(false)";
+	else if (val.is_number()) result = "Value(" + number(val.as_number()) + ")";
+	else {
+		result = "K[" + std::to_string(constants.size()) + "]";
+		constants.push_back(quote(static_cast<StringObj*>(val.as_obj())->val));
+	}
+	return Value();
+}
+
+Value AotCompiler::visit_grouping_expr(Grouping* expr) {
+	result = compile(expr->expression);
+	return Value();
+}
+
+Value AotCompiler::visit_unary_expr(Unary* expr) {
+	std::string right = compile(expr->right);
+	if (expr->op.type == BANG) result = temp("Value(!aot_truthy(" + right + "))");
+	else {
+		result = temp(right + ".is_number() ? Value(-" + right + ".as_number()) : aot_negate(" + token(expr->op) + ", " + right + ")");
+	}
+	return Value();
+}
+
+// Numbers get the operator inline. Everything else, errors included, goes
+// through Interpreter::binary.
+Value AotCompiler::visit_binary_expr(Binary* expr) {
+	std::string left = compile(expr->left);
+	std::string right = compile(expr->right);
+	std::string a = left + ".as_number()";
+	std::string b = right + ".as_number()";
+	std::string fast;
+	switch (expr->op.type) {
+		case BANG_EQUAL: fast = "Value(" + a + " != " + b + ")"; break;
+		case EQUAL_EQUAL: fast = "Value(" + a + " == " + b + ")"; break;
+		case GREATER: fast = "Value(" + a + " > " + b + ")"; break;
+		case GREATER_EQUAL: fast = "Value(" + a + " >= " + b + ")"; break;
+		case LESS: fast = "Value(" + a + " < " + b + ")"; break;
+		case LESS_EQUAL: fast = "Value(" + a + " <= " + b + ")"; break;
+		case PLUS: fast = "Value(" + a + " + " + b + ")"; break;
+		case MINUS: fast = "Value(" + a + " - " + b + ")"; break;
+		case SLASH: fast = "Value(" + a + " / " + b + ")"; break;
+		case STAR: fast = "Value(" + a + " * " + b + ")"; break;
+		case MOD: fast = "Value((double) ((long) " + a + " % (long) " + b + "))"; break;
+		case STAR_STAR: fast = "Value(pow(" + a + ", " + b + "))"; break;
+		case SLASH_SLASH: fast = "Value((double) ((long) " + a + " / (long) " + b + "))"; break;
+		default: break;
+	}
+	std::string slow = "aot_binary(" + token(expr->op) + ", " + left + ", " + right + ")";
+	if (fast.empty()) result = temp(slow);
+	else result = temp(left + ".is_number() && " + right + ".is_number() ? " + fast + " : " + slow);
+	return Value();
+}
+
+Value AotCompiler::visit_variable_expr(Variable* expr) {
+	result = temp(load(expr->access, expr->slot, expr->name));
+	return Value();
+}
+
+Value AotCompiler::visit_assign_expr(Assign* expr) {
+	std::string val = compile(expr->val);
+	store(expr->access, expr->slot, expr->name, val);
+	result = val;
+	return Value();
+}
+
+Value AotCompiler::visit_logical_expr(Logical* expr) {
+	std::string left = temp(compile(expr->left));
+	open(std::string("if (") + (expr->op.type == OR ? "!" : "") + "aot_truthy(" + left + ")) {");
+	line(left + " = " + compile(expr->right) + ";");
+	close();
+	result = left;
+	return Value();
+}
+
+// A method call looks the method up before its arguments run, as
+// Interpreter::invoke does.
+Value AotCompiler::visit_call_expr(Call* expr) {
+	if (expr->method != nullptr) {
+		Get* get = expr->method;
+		std::string obj = compile(get->obj);
+		std::string method = "m" + std::to_string(next_temp++);
+		line("AotMethod " + method + " = aot_lookup(" + token(get->name) + ", " + obj + ", C[" + std::to_string(num_caches++) + "]);");
+		std::string args = arguments(expr->arguments, obj);
+		result = temp("aot_invoke(" + token(expr->paren) + ", " + method + ", " + args + ", " + std::to_string(expr->arguments.size()) + ")");
+		return Value();
+	}
+	std::string callee = compile(expr->callee);
+	std::string args = arguments(expr->arguments, callee);
+	result = temp("aot_call(" + token(expr->paren) + ", " + args + ", " + std::to_string(expr->arguments.size()) + ")");
+	return Value();
+}
+
+// A lambda that captures nothing is made once, like the Interpreter's
+// hoisted lambdas.
+Value AotCompiler::visit_lambda_expr(LambdaExpr* expr) {
+	std::string code = function("lambda", 0, expr->params, expr->body, expr->num_slots, expr->boxed, false);
+	if (!expr->captures.empty()) {
+		result = temp(closure(code, expr->params.size(), expr->captures));
+		return Value();
+	}
+	std::string hoisted = "H[" + std::to_string(num_hoisted++) + "]";
+	line("if (" + hoisted + ".is_nil()) " + hoisted + " = heap.pin(aot_fn(" + code + ", " + std::to_string(expr->params.size()) + ", {}));");
+	result = temp(hoisted);
+	return Value();
+}
+
+Value AotCompiler::visit_get_expr(Get* expr) {
+	std::string obj = compile(expr->obj);
+	result = temp("aot_get(" + token(expr->name) + ", " + obj + ", C[" + std::to_string(num_caches++) + "])");
+	return Value();
+}
+
+Value AotCompiler::visit_set_expr(Set* expr) {
+	std::string obj = compile(expr->obj);
+	std::string name = token(expr->name);
+	std::string instance = "i" + std::to_string(next_temp++);
+	line("Instance* " + instance + " = aot_set_target(" + name + ", " + obj + ");");
+	std::string val = compile(expr->val);
+	line(instance + "->set(" + name + ".symbol, " + val + ", C[" + std::to_string(num_caches++) + "]);");
+	result = val;
+	return Value();
+}
+
+Value AotCompiler::visit_this_expr(This* expr) {
+	result = temp(load(expr->access, expr->slot, expr->keyword));
+	return Value();
+}
+
+void AotCompiler::visit_expression_stmt(Expression* stmt) {
+	open("{");
+	line("(void) " + compile(stmt->expression) + ";");
+	close();
+}
+
+void AotCompiler::visit_print_stmt(Print* stmt) {
+	open("{");
+	line("aot_print(" + compile(stmt->expression) + ");");
+	close();
+}
+
+void AotCompiler::visit_var_stmt(Var* stmt) {
+	open("{");
+	declare(stmt->access, stmt->slot);
+	std::string val = stmt->initializer != nullptr ? compile(stmt->initializer) : "Value()";
+	define(stmt->access, stmt->slot, stmt->name, val);
+	close();
+}
+
+void AotCompiler::visit_block_stmt(Block* stmt) {
+	fn->num_slots = std::max(fn->num_slots, stmt->num_slots);
+	open("{");
+	for (auto s : stmt->stmts) compile(s);
+	close();
+}
+
+void AotCompiler::visit_if_stmt(If* stmt) {
+	open("{");
+	open("if (aot_truthy(" + compile(stmt->condition) + ")) {");
+	compile(stmt->then_branch);
+	if (stmt->else_branch != nullptr) {
+		close("} else {");
+		fn->indent++;
+		compile(stmt->else_branch);
+	}
+	close();
+	close();
+}
+
+// continue jumps past the body to the increment.
+void AotCompiler::visit_while_stmt(While* stmt) {
+	int label = next_label++;
+	open("for (;;) {");
+	if (stmt->condition != nullptr) line("if (!aot_truthy(" + compile(stmt->condition) + ")) break;");
+	fn->loops.push_back(Loop { label, false });
+	open("{");
+	compile(stmt->body);
+	close();
+	if (fn->loops.back().continued) line("continue_" + std::to_string(label) + ":;");
+	fn->loops.pop_back();
+	if (stmt->increment != nullptr) {
+		open("{");
+		compile(stmt->increment);
+		close();
+	}
+	close();
+}
+
+void AotCompiler::visit_fn_stmt(FnStmt* stmt) {
+	std::string code = function(std::string(stmt->name.lexeme), stmt->name.line, stmt->params, stmt->body, stmt->num_slots, stmt->boxed, false);
+	open("{");
+	declare(stmt->access, stmt->slot);
+	define(stmt->access, stmt->slot, stmt->name, temp(closure(code, stmt->params.size(), stmt->captures)));
+	close();
+}
+
+void AotCompiler::visit_return_stmt(Return* stmt) {
+	open("{");
+	line("return " + (stmt->val != nullptr ? compile(stmt->val) : std::string("Value()")) + ";");
+	close();
+}
+
+void AotCompiler::visit_break_stmt(Break* stmt) {
+	line("break;");
+}
+
+void AotCompiler::visit_continue_stmt(Continue* stmt) {
+	fn->loops.back().continued = true;
+	line("goto continue_" + std::to_string(fn->loops.back().label) + ";");
+}
+
+void AotCompiler::visit_class_stmt(ClassStmt* stmt) {
+	open("{");
+	declare(stmt->access, stmt->slot);
+	std::string klass = "k" + std::to_string(next_temp++);
+	line("Class* " + klass + " = aot_class(" + token(stmt->name) + ");");
+	for (auto m : stmt->methods) {
+		std::string code = function(std::string(stmt->name.lexeme) + "." + std::string(m->name.lexeme), m->name.line, m->params, m->body, m->num_slots, m->boxed, true);
+		line("aot_add_method(" + klass + ", " + token(m->name) + ", " + closure(code, m->params.size(), m->captures) + ");");
+	}
+	define(stmt->access, stmt->slot, stmt->name, klass);
+	close();
+}
+
+// Modules are loaded as the script is compiled, and each is compiled in
+// where it is first imported.
+void AotCompiler::visit_import_stmt(Import* stmt) {
+	Module* module = modules.enter(stmt->path);
+	if (module == nullptr) return;
+	ModuleRun run(module);
+	for (auto s : module->stmts) compile(s);
+	run.finish();
+}
+
+std::string AotCompiler::compile(Expr* expr) {
+	expr->accept(this);
+	return result;
+}
+
+void AotCompiler::compile(Stmt* stmt) {
+	stmt->accept(this);
+}
+
+void AotCompiler::line(const std::string& text) {
+	fn->code += std::string(fn->indent, '\t') + text + "\n";
+}
+
+void AotCompiler::open(const std::string& text) {
+	line(text);
+	fn->indent++;
+}
+
+void AotCompiler::close(const std::string& text) {
+	fn->indent--;
+	line(text);
+}
+
+// Expressions compile to a temporary or a constant, never to a variable,
+// so a result is unaffected by anything evaluated after it.
+std::string AotCompiler::temp(const std::string& init) {
+	std::string name = "t" + std::to_string(next_temp++);
+	line("Value " + name + " = " + init + ";");
+	return name;
+}
+
+// Tokens are rebuilt at startup with their symbols interned in this run.
+std::string AotCompiler::token(const Token& tok) {
+	std::string symbol = tok.symbol == SYM_NONE ? "SYM_NONE" : "symbols.intern(" + quote(symbols.name(tok.symbol)) + ")";
+	tokens.push_back(
+		"Token { (TokenType) " + std::to_string(tok.type) + ", " + quote(tok.lexeme) + ", Value(), "
+		+ std::to_string(tok.line) + ", " + symbol + " }"
+	);
+	return "T[" + std::to_string(tokens.size() - 1) + "]";
+}
+
+// The variable a local access names, as Interpreter::local finds it.
+std::string AotCompiler::local(Access access, int slot) {
+	fn->num_slots = std::max(fn->num_slots, slot + 1);
+	std::string index = std::to_string(slot);
+	if (access == Access_LOCAL) return "l[" + index + "]";
+	if (access == Access_BOXED) return "aot_boxed(l[" + index + "])";
+	return "self->upvalues[" + index + "]->val";
+}
+
+std::string AotCompiler::load(Access access, int slot, const Token& name) {
+	if (access == Access_GLOBAL) return "aot_get_global(" + token(name) + ")";
+	return local(access, slot);
+}
+
+void AotCompiler::store(Access access, int slot, const Token& name, const std::string& val) {
+	if (access == Access_GLOBAL) line("aot_set_global(" + token(name) + ", " + val + ");");
+	else line(local(access, slot) + " = " + val + ";");
+}
+
+void AotCompiler::declare(Access access, int slot) {
+	if (access == Access_BOXED) line("l[" + std::to_string(slot) + "] = aot_box(Value());");
+}
+
+void AotCompiler::define(Access access, int slot, const Token& name, const std::string& val) {
+	if (access == Access_GLOBAL) line("aot_define_global(" + token(name) + ", " + val + ");");
+	else line(local(access, slot) + " = " + val + ";");
+}
+
+// Writes the C++ function for a body and returns its name. The frame is
+// set up as Interpreter::execute_body sets it up.
+std::string AotCompiler::function(
+	const std::string& name,
+	int line_number,
+	Span<Token> params,
+	Span<Stmt*> body,
+	int num_slots,
+	Span<int> boxed,
+	bool is_method
+) {
+	functions.emplace_back();
+	size_t index = functions.size() - 1;
+	Function f { "", 1, num_slots, {} };
+	Function* enclosing = fn;
+	fn = &f;
+	int slot = 0;
+	if (is_method) line("l[" + std::to_string(slot++) + "] = *receiver;");
+	for (size_t i = 0; i < params.size(); i++) line("l[" + std::to_string(slot++) + "] = arguments[" + std::to_string(i) + "];");
+	for (int b : boxed) line("l[" + std::to_string(b) + "] = aot_box(l[" + std::to_string(b) + "]);");
+	for (auto s : body) compile(s);
+	line("return Value();");
+	fn = enclosing;
+	std::string comment = "// " + name + (line_number > 0 ? ", line " + std::to_string(line_number) : "") + "\n";
+	functions[index] = comment + signature(index) + " {\n" + frame(num_slots) + f.code + "}\n";
+	return "fn_" + std::to_string(index);
+}
+
+std::string AotCompiler::signature(size_t index) {
+	return "static Value fn_" + std::to_string(index) + "(AotFn* self, const Value* receiver, const Value* arguments)";
+}
+
+// Locals are a plain array on the native stack, where the heap's stack
+// scan sees them.
+std::string AotCompiler::frame(int num_slots) {
+	if (num_slots == 0) return "";
+	return "\tValue l[" + std::to_string(num_slots) + "];\n";
+}
+
+std::string AotCompiler::closure(const std::string& code, int arity, Span<Capture> captures) {
+	std::string upvalues;
+	for (auto& c : captures) {
+		if (!upvalues.empty()) upvalues += ", ";
+		if (c.is_local) upvalues += "static_cast<Box*>(l[" + std::to_string(c.index) + "].as_obj())";
+		else upvalues += "self->upvalues[" + std::to_string(c.index) + "]";
+	}
+	return "aot_fn(" + code + ", " + std::to_string(arity) + ", {" + upvalues + "})";
+}
+
+// Evaluates args in order into an array after first, and returns its name.
+std::string AotCompiler::arguments(Span<Expr*> args, const std::string& first) {
+	std::string values = first;
+	for (auto a : args) values += ", " + compile(a);
+	std::string name = "a" + std::to_string(next_temp++);
+	line("Value " + name + "[] = { " + values + " };");
+	return name;
+}
+
+// Hex floats round trip exactly.
+std::string AotCompiler::number(double val) {
+	if (isnan(val)) return "NAN";
+	if (isinf(val)) return val > 0 ? "INFINITY" : "-INFINITY";
+	char buffer[64];
+	snprintf(buffer, sizeof(buffer), "%a", val);
+	return buffer;
+}
+
+std::string AotCompiler::quote(std::string_view text) {
+	std::string out = "std::string_view(\"";
+	for (unsigned char c : text) {
+		if (c == '"' || c == '\\') {
+			out += '\\';
+			out += c;
+		} else if (c >= 0x20 && c < 0x7F) {
+			out += c;
+		} else {
+			char buffer[8];
+			snprintf(buffer, sizeof(buffer), "\\%03o", c);
+			out += buffer;
+		}
+	}
+	return out + "\", " + std::to_string(text.size()) + ")";
+}
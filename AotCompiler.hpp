@@ -0,0 +1,148 @@
+#ifndef AOT_COMPILER
+#define AOT_COMPILER
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include "Expr.hpp"
+#include "Stmt.hpp"
+#include "Value.hpp"
+#include "Module.hpp"
+
+// Translates a resolved and optimized program to C++ for --aot. Every fn,
+// method and lambda becomes a C++ function over Values that runs against
+// the runtime in Aot.hpp. Expressions are flattened into temporaries in
+// evaluation order, and numeric operators get an inline fast path. Each
+// token an error can report is kept in a table, so errors match the
+// Interpreter's.
+class AotCompiler : Expr::Visitor, Stmt::Visitor {
+public:
+	AotCompiler();
+
+	// A complete translation unit with its own main.
+	std::string compile(Span<Stmt*> stmts);
+
+	Value visit_literal_expr(Literal* expr) override;
+
+	Value visit_grouping_expr(Grouping* expr) override;
+
+	Value visit_unary_expr(Unary* expr) override;
+
+	Value visit_binary_expr(Binary* expr) override;
+
+	Value visit_variable_expr(Variable* expr) override;
+
+	Value visit_assign_expr(Assign* expr) override;
+
+	Value visit_logical_expr(Logical* expr) override;
+
+	Value visit_call_expr(Call* expr) override;
+
+	Value visit_lambda_expr(LambdaExpr* expr) override;
+
+	Value visit_get_expr(Get* expr) override;
+
+	Value visit_set_expr(Set* expr) override;
+
+	Value visit_this_expr(This* expr) override;
+
+	void visit_expression_stmt(Expression* stmt) override;
+
+	void visit_print_stmt(Print* stmt) override;
+
+	void visit_var_stmt(Var* stmt) override;
+
+	void visit_block_stmt(Block* stmt) override;
+
+	void visit_if_stmt(If* stmt) override;
+
+	void visit_while_stmt(While* stmt) override;
+
+	void visit_fn_stmt(FnStmt* stmt) override;
+
+	void visit_return_stmt(Return* stmt) override;
+
+	void visit_break_stmt(Break* stmt) override;
+
+	void visit_continue_stmt(Continue* stmt) override;
+
+	void visit_class_stmt(ClassStmt* stmt) override;
+
+	void visit_import_stmt(Import* stmt) override;
+
+private:
+	struct Loop {
+		int label;
+		bool continued;
+	};
+
+	// The C++ function being written.
+	struct Function {
+		std::string code;
+		int indent;
+		// Frame slots used, for the top level where no node records it.
+		int num_slots;
+		std::vector<Loop> loops;
+	};
+
+	Function* fn;
+	std::vector<std::string> functions;
+	// Tables the generated init fills in.
+	std::vector<std::string> tokens;
+	std::vector<std::string> constants;
+	int num_caches;
+	int num_hoisted;
+	int next_temp;
+	int next_label;
+	// The C++ expression holding the value of the last expression compiled.
+	std::string result;
+
+	std::string compile(Expr* expr);
+
+	void compile(Stmt* stmt);
+
+	void line(const std::string& text);
+
+	void open(const std::string& text);
+
+	void close(const std::string& text = "}");
+
+	std::string temp(const std::string& init);
+
+	std::string token(const Token& tok);
+
+	std::string local(Access access, int slot);
+
+	std::string load(Access access, int slot, const Token& name);
+
+	void store(Access access, int slot, const Token& name, const std::string& val);
+
+	void declare(Access access, int slot);
+
+	void define(Access access, int slot, const Token& name, const std::string& val);
+
+	// line is 0 for lambdas, which have no token of their own.
+	std::string function(
+		const std::string& name,
+		int line,
+		Span<Token> params,
+		Span<Stmt*> body,
+		int num_slots,
+		Span<int> boxed,
+		bool is_method
+	);
+
+	static std::string signature(size_t index);
+
+	static std::string frame(int num_slots);
+
+	std::string closure(const std::string& code, int arity, Span<Capture> captures);
+
+	std::string arguments(Span<Expr*> args, const std::string& first);
+
+	static std::string number(double val);
+
+	static std::string quote(std::string_view text);
+};
+
+#endif
@@ -0,0 +1,34 @@
+#include "Arena.hpp"
+
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+void* Arena::allocate(size_t size, size_t align) {
+	uintptr_t addr = ((uintptr_t) next + align - 1) & ~(uintptr_t) (align - 1);
+	if (next == nullptr || addr + size > (uintptr_t) end) {
+		// Anything too big for a block gets one of its own.
+		size_t block_size = size + align > ARENA_BLOCK_SIZE ? size + align : ARENA_BLOCK_SIZE;
+		blocks.emplace_back(new char[block_size]);
+		next = blocks.back().get();
+		end = next + block_size;
+		addr = ((uintptr_t) next + align - 1) & ~(uintptr_t) (align - 1);
+	}
+	next = (char*) (addr + size);
+	bytes += size;
+	return (void*) addr;
+}
+
+Arena& Arena::operator=(Arena&& other) {
+	blocks = std::move(other.blocks);
+	next = other.next;
+	end = other.end;
+	bytes = other.bytes;
+	other.clear();
+	return *this;
+}
+
+void Arena::clear() {
+	blocks.clear();
+	next = nullptr;
+	end = nullptr;
+	bytes = 0;
+}
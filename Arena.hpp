@@ -0,0 +1,91 @@
+#ifndef ARENA
+#define ARENA
+
+#include <vector>
+#include <algorithm>
+#include <new>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include <string_view>
+#include <utility>
+#include <type_traits>
+
+// A run of T stored in an Arena. Trivially copyable, so AST nodes and the
+// functions made from them can share lists without copying them.
+template <typename T>
+struct Span {
+	T* data;
+	uint32_t count;
+
+	Span() : data(nullptr), count(0) {}
+
+	Span(T* data, uint32_t count) : data(data), count(count) {}
+
+	size_t size() const { return count; }
+
+	bool empty() const { return count == 0; }
+
+	T& operator[](size_t i) const { return data[i]; }
+
+	T* begin() const { return data; }
+
+	T* end() const { return data + count; }
+};
+
+// Bump allocator for AST nodes. Nodes are laid out in the order they are
+// parsed and all freed together with the arena, so nothing placed in one
+// may need its destructor run.
+class Arena {
+public:
+	Arena() : next(nullptr), end(nullptr), bytes(0) {}
+
+	Arena(const Arena&) = delete;
+
+	Arena& operator=(const Arena&) = delete;
+
+	// Takes over every node of other, which is left empty for reuse.
+	Arena(Arena&& other) : Arena() { *this = std::move(other); }
+
+	Arena& operator=(Arena&& other);
+
+	template <typename T, typename... Args>
+	T* make(Args&&... args) {
+		static_assert(std::is_trivially_destructible<T>::value, "arena objects are never destroyed");
+		return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+	}
+
+	template <typename T>
+	Span<T> copy(const std::vector<T>& items) {
+		static_assert(std::is_trivially_copyable<T>::value, "spans are copied bytewise");
+		if (items.empty()) return Span<T>();
+		T* data = (T*) allocate(sizeof(T) * items.size(), alignof(T));
+		std::copy(items.begin(), items.end(), data);
+		return Span<T>(data, items.size());
+	}
+
+	// For lexemes that have to outlive the text they were scanned from.
+	std::string_view copy(std::string_view text) {
+		if (text.empty()) return std::string_view();
+		char* data = (char*) allocate(text.size(), 1);
+		std::copy(text.begin(), text.end(), data);
+		return std::string_view(data, text.size());
+	}
+
+	// Frees every node at once. Only for a caller that knows nothing points
+	// into the arena anymore.
+	void clear();
+
+	// Bytes handed out so far, for comparing AST sizes.
+	size_t size() const { return bytes; }
+
+private:
+	std::vector<std::unique_ptr<char[]>> blocks;
+	char* next;
+	char* end;
+	size_t bytes;
+
+	void* allocate(size_t size, size_t align);
+};
+
+#endif
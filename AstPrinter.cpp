@@ -0,0 +1,223 @@
+#include "AstPrinter.hpp"
+
+AstPrinter::AstPrinter(std::ostream& out) : out(out), indent(0) {}
+
+void AstPrinter::print(Span<Stmt*> stmts) {
+	for (auto s : stmts) {
+		print(s);
+		out << '\n';
+	}
+}
+
+Value AstPrinter::visit_literal_expr(Literal* expr) {
+	if (expr->val.is_string()) out << '\'' << static_cast<StringObj*>(expr->val.as_obj())->val << '\'';
+	else out << expr->val.to_string();
+	return Value();
+}
+
+Value AstPrinter::visit_grouping_expr(Grouping* expr) {
+	out << "(group ";
+	print(expr->expression);
+	out << ')';
+	return Value();
+}
+
+Value AstPrinter::visit_unary_expr(Unary* expr) {
+	out << '(' << expr->op.lexeme << ' ';
+	print(expr->right);
+	out << ')';
+	return Value();
+}
+
+Value AstPrinter::visit_binary_expr(Binary* expr) {
+	out << '(' << expr->op.lexeme << ' ';
+	print(expr->left);
+	out << ' ';
+	print(expr->right);
+	out << ')';
+	return Value();
+}
+
+Value AstPrinter::visit_variable_expr(Variable* expr) {
+	out << expr->name.lexeme;
+	return Value();
+}
+
+Value AstPrinter::visit_assign_expr(Assign* expr) {
+	out << "(= " << expr->name.lexeme << ' ';
+	print(expr->val);
+	out << ')';
+	return Value();
+}
+
+Value AstPrinter::visit_logical_expr(Logical* expr) {
+	out << '(' << expr->op.lexeme << ' ';
+	print(expr->left);
+	out << ' ';
+	print(expr->right);
+	out << ')';
+	return Value();
+}
+
+Value AstPrinter::visit_call_expr(Call* expr) {
+	out << "(call ";
+	print(expr->callee);
+	for (auto a : expr->arguments) {
+		out << ' ';
+		print(a);
+	}
+	out << ')';
+	return Value();
+}
+
+Value AstPrinter::visit_lambda_expr(LambdaExpr* expr) {
+	out << "(fn ";
+	print_params(expr->params);
+	print_body(expr->body);
+	out << ')';
+	return Value();
+}
+
+Value AstPrinter::visit_get_expr(Get* expr) {
+	out << "(. ";
+	print(expr->obj);
+	out << ' ' << expr->name.lexeme << ')';
+	return Value();
+}
+
+Value AstPrinter::visit_set_expr(Set* expr) {
+	out << "(= (. ";
+	print(expr->obj);
+	out << ' ' << expr->name.lexeme << ") ";
+	print(expr->val);
+	out << ')';
+	return Value();
+}
+
+Value AstPrinter::visit_this_expr(This* expr) {
+	out << "this";
+	return Value();
+}
+
+void AstPrinter::visit_expression_stmt(Expression* stmt) {
+	print(stmt->expression);
+}
+
+void AstPrinter::visit_print_stmt(Print* stmt) {
+	out << "(print ";
+	print(stmt->expression);
+	out << ')';
+}
+
+void AstPrinter::visit_var_stmt(Var* stmt) {
+	out << "(let " << stmt->name.lexeme;
+	if (stmt->initializer != nullptr) {
+		out << ' ';
+		print(stmt->initializer);
+	}
+	out << ')';
+}
+
+void AstPrinter::visit_block_stmt(Block* stmt) {
+	out << "(block";
+	print_body(stmt->stmts);
+	out << ')';
+}
+
+void AstPrinter::visit_if_stmt(If* stmt) {
+	out << "(if ";
+	print(stmt->condition);
+	indent++;
+	newline();
+	print(stmt->then_branch);
+	if (stmt->else_branch != nullptr) {
+		newline();
+		print(stmt->else_branch);
+	}
+	indent--;
+	out << ')';
+}
+
+void AstPrinter::visit_while_stmt(While* stmt) {
+	out << "(while ";
+	if (stmt->condition != nullptr) print(stmt->condition);
+	else out << "true";
+	if (stmt->increment != nullptr) {
+		out << ' ';
+		print(stmt->increment);
+	}
+	indent++;
+	newline();
+	print(stmt->body);
+	indent--;
+	out << ')';
+}
+
+void AstPrinter::visit_fn_stmt(FnStmt* stmt) {
+	out << "(fn " << stmt->name.lexeme << ' ';
+	print_params(stmt->params);
+	print_body(stmt->body);
+	out << ')';
+}
+
+void AstPrinter::visit_return_stmt(Return* stmt) {
+	out << "(return";
+	if (stmt->val != nullptr) {
+		out << ' ';
+		print(stmt->val);
+	}
+	out << ')';
+}
+
+void AstPrinter::visit_break_stmt(Break* stmt) {
+	out << "(break)";
+}
+
+void AstPrinter::visit_continue_stmt(Continue* stmt) {
+	out << "(continue)";
+}
+
+void AstPrinter::visit_class_stmt(ClassStmt* stmt) {
+	out << "(class " << stmt->name.lexeme;
+	indent++;
+	for (auto m : stmt->methods) {
+		newline();
+		print(m);
+	}
+	indent--;
+	out << ')';
+}
+
+void AstPrinter::visit_import_stmt(Import* stmt) {
+	out << "(import " << stmt->path.lexeme << ')';
+}
+
+void AstPrinter::print(Stmt* stmt) {
+	stmt->accept(this);
+}
+
+void AstPrinter::print(Expr* expr) {
+	expr->accept(this);
+}
+
+void AstPrinter::print_body(Span<Stmt*> body) {
+	indent++;
+	for (auto s : body) {
+		newline();
+		print(s);
+	}
+	indent--;
+}
+
+void AstPrinter::print_params(Span<Token> params) {
+	out << '(';
+	for (size_t i = 0; i < params.size(); i++) {
+		if (i > 0) out << ' ';
+		out << params[i].lexeme;
+	}
+	out << ')';
+}
+
+void AstPrinter::newline() {
+	out << '\n' << std::string(indent, '\t');
+}
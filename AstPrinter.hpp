@@ -0,0 +1,80 @@
+#ifndef AST_PRINTER
+#define AST_PRINTER
+
+#include <iostream>
+#include <string>
+#include "Expr.hpp"
+#include "Stmt.hpp"
+#include "Value.hpp"
+
+// Prints an AST as s-expressions, one statement per line, for --dump-ast.
+class AstPrinter : Expr::Visitor, Stmt::Visitor {
+public:
+	AstPrinter(std::ostream& out);
+
+	void print(Span<Stmt*> stmts);
+
+	Value visit_literal_expr(Literal* expr) override;
+
+	Value visit_grouping_expr(Grouping* expr) override;
+
+	Value visit_unary_expr(Unary* expr) override;
+
+	Value visit_binary_expr(Binary* expr) override;
+
+	Value visit_variable_expr(Variable* expr) override;
+
+	Value visit_assign_expr(Assign* expr) override;
+
+	Value visit_logical_expr(Logical* expr) override;
+
+	Value visit_call_expr(Call* expr) override;
+
+	Value visit_lambda_expr(LambdaExpr* expr) override;
+
+	Value visit_get_expr(Get* expr) override;
+
+	Value visit_set_expr(Set* expr) override;
+
+	Value visit_this_expr(This* expr) override;
+
+	void visit_expression_stmt(Expression* stmt) override;
+
+	void visit_print_stmt(Print* stmt) override;
+
+	void visit_var_stmt(Var* stmt) override;
+
+	void visit_block_stmt(Block* stmt) override;
+
+	void visit_if_stmt(If* stmt) override;
+
+	void visit_while_stmt(While* stmt) override;
+
+	void visit_fn_stmt(FnStmt* stmt) override;
+
+	void visit_return_stmt(Return* stmt) override;
+
+	void visit_break_stmt(Break* stmt) override;
+
+	void visit_continue_stmt(Continue* stmt) override;
+
+	void visit_class_stmt(ClassStmt* stmt) override;
+
+	void visit_import_stmt(Import* stmt) override;
+
+private:
+	std::ostream& out;
+	int indent;
+
+	void print(Stmt* stmt);
+
+	void print(Expr* expr);
+
+	void print_body(Span<Stmt*> body);
+
+	void print_params(Span<Token> params);
+
+	void newline();
+};
+
+#endif
@@ -0,0 +1,733 @@
+#include "Cache.hpp"
+#include "Symbol.hpp"
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+
+#ifdef CACHE_SUPPORTED
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// File layout: the header, a table of (offset, length) pairs for every
+// string, the string bytes, then the AST in preorder. Strings are token
+// lexemes, symbol names and string literals, each stored once. The checksum
+// covers everything after the header.
+struct CacheHeader {
+	char magic[4];
+	uint32_t version;
+	uint64_t hash;
+	uint64_t checksum;
+	uint32_t num_strings;
+	uint32_t strings_size;
+	uint32_t tree_size;
+	uint32_t unused;
+};
+
+enum Node : uint8_t {
+	Node_NULL,
+	Node_BINARY, Node_GROUPING, Node_LITERAL, Node_LOGICAL, Node_UNARY, Node_VARIABLE,
+	Node_ASSIGN, Node_CALL, Node_LAMBDA, Node_GET, Node_SET, Node_THIS,
+	Node_EXPRESSION, Node_PRINT, Node_VAR, Node_BLOCK, Node_IF, Node_WHILE,
+	Node_FN, Node_RETURN, Node_BREAK, Node_CONTINUE, Node_CLASS, Node_IMPORT,
+};
+
+enum ValueTag : uint8_t { ValueTag_NIL, ValueTag_FALSE, ValueTag_TRUE, ValueTag_NUMBER, ValueTag_STRING };
+
+static const char CACHE_MAGIC[4] = { 'L', 'O', 'X', 'C' };
+
+static const uint32_t NO_STRING = UINT32_MAX;
+
+static const uint64_t FNV_OFFSET = 14695981039346656037ull;
+
+static uint64_t fnv1a(uint64_t hash, const void* data, size_t size) {
+	const uint8_t* bytes = (const uint8_t*) data;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+uint64_t hash_source(std::string_view text) {
+	return fnv1a(FNV_OFFSET, text.data(), text.size());
+}
+
+// Thrown for literals that only exist at runtime, which are never cached.
+struct Unwritable {};
+
+class CacheWriter : Expr::Visitor, Stmt::Visitor {
+public:
+	std::vector<uint8_t> tree;
+	std::vector<std::pair<uint32_t, uint32_t>> entries;
+	std::string strings;
+
+	void write(Span<Stmt*> stmts) {
+		u32(stmts.size());
+		for (auto s : stmts) write(s);
+	}
+
+	Value visit_binary_expr(Binary* expr) override {
+		u8(Node_BINARY);
+		write(expr->left);
+		token(expr->op);
+		write(expr->right);
+		return Value();
+	}
+
+	Value visit_grouping_expr(Grouping* expr) override {
+		u8(Node_GROUPING);
+		write(expr->expression);
+		return Value();
+	}
+
+	Value visit_literal_expr(Literal* expr) override {
+		u8(Node_LITERAL);
+		value(expr->val);
+		return Value();
+	}
+
+	Value visit_logical_expr(Logical* expr) override {
+		u8(Node_LOGICAL);
+		write(expr->left);
+		token(expr->op);
+		write(expr->right);
+		return Value();
+	}
+
+	Value visit_unary_expr(Unary* expr) override {
+		u8(Node_UNARY);
+		token(expr->op);
+		write(expr->right);
+		return Value();
+	}
+
+	Value visit_variable_expr(Variable* expr) override {
+		u8(Node_VARIABLE);
+		token(expr->name);
+		slot(expr->access, expr->slot);
+		return Value();
+	}
+
+	Value visit_assign_expr(Assign* expr) override {
+		u8(Node_ASSIGN);
+		token(expr->name);
+		write(expr->val);
+		slot(expr->access, expr->slot);
+		return Value();
+	}
+
+	Value visit_call_expr(Call* expr) override {
+		u8(Node_CALL);
+		write(expr->callee);
+		token(expr->paren);
+		u32(expr->arguments.size());
+		for (auto a : expr->arguments) write(a);
+		u8(expr->method != nullptr);
+		return Value();
+	}
+
+	Value visit_lambda_expr(LambdaExpr* expr) override {
+		u8(Node_LAMBDA);
+		function(expr->params, expr->body, expr->num_slots, expr->captures, expr->boxed);
+		return Value();
+	}
+
+	Value visit_get_expr(Get* expr) override {
+		u8(Node_GET);
+		write(expr->obj);
+		token(expr->name);
+		return Value();
+	}
+
+	Value visit_set_expr(Set* expr) override {
+		u8(Node_SET);
+		write(expr->obj);
+		token(expr->name);
+		write(expr->val);
+		return Value();
+	}
+
+	Value visit_this_expr(This* expr) override {
+		u8(Node_THIS);
+		token(expr->keyword);
+		slot(expr->access, expr->slot);
+		return Value();
+	}
+
+	void visit_expression_stmt(Expression* stmt) override {
+		u8(Node_EXPRESSION);
+		write(stmt->expression);
+	}
+
+	void visit_print_stmt(Print* stmt) override {
+		u8(Node_PRINT);
+		write(stmt->expression);
+	}
+
+	void visit_var_stmt(Var* stmt) override {
+		u8(Node_VAR);
+		token(stmt->name);
+		write(stmt->initializer);
+		slot(stmt->access, stmt->slot);
+	}
+
+	void visit_block_stmt(Block* stmt) override {
+		u8(Node_BLOCK);
+		write(stmt->stmts);
+		i32(stmt->num_slots);
+	}
+
+	void visit_if_stmt(If* stmt) override {
+		u8(Node_IF);
+		write(stmt->condition);
+		write(stmt->then_branch);
+		write(stmt->else_branch);
+	}
+
+	void visit_while_stmt(While* stmt) override {
+		u8(Node_WHILE);
+		write(stmt->condition);
+		write(stmt->body);
+		write(stmt->increment);
+	}
+
+	void visit_fn_stmt(FnStmt* stmt) override {
+		u8(Node_FN);
+		token(stmt->name);
+		function(stmt->params, stmt->body, stmt->num_slots, stmt->captures, stmt->boxed);
+		slot(stmt->access, stmt->slot);
+	}
+
+	void visit_return_stmt(Return* stmt) override {
+		u8(Node_RETURN);
+		token(stmt->keyword);
+		write(stmt->val);
+	}
+
+	void visit_break_stmt(Break* stmt) override {
+		u8(Node_BREAK);
+		token(stmt->keyword);
+	}
+
+	void visit_continue_stmt(Continue* stmt) override {
+		u8(Node_CONTINUE);
+		token(stmt->keyword);
+	}
+
+	void visit_class_stmt(ClassStmt* stmt) override {
+		u8(Node_CLASS);
+		token(stmt->name);
+		u32(stmt->methods.size());
+		for (auto m : stmt->methods) write(m);
+		slot(stmt->access, stmt->slot);
+	}
+
+	void visit_import_stmt(Import* stmt) override {
+		u8(Node_IMPORT);
+		token(stmt->keyword);
+		token(stmt->path);
+	}
+
+private:
+	std::unordered_map<std::string, uint32_t> ids;
+
+	void write(Expr* expr) {
+		if (expr == nullptr) u8(Node_NULL);
+		else expr->accept(this);
+	}
+
+	void write(Stmt* stmt) {
+		if (stmt == nullptr) u8(Node_NULL);
+		else stmt->accept(this);
+	}
+
+	void bytes(const void* data, size_t size) {
+		tree.insert(tree.end(), (const uint8_t*) data, (const uint8_t*) data + size);
+	}
+
+	void u8(uint8_t val) { tree.push_back(val); }
+
+	void u32(uint32_t val) { bytes(&val, 4); }
+
+	void i32(int32_t val) { bytes(&val, 4); }
+
+	void string(std::string_view text) {
+		auto [it, added] = ids.emplace(std::string(text), entries.size());
+		if (added) {
+			entries.emplace_back(strings.size(), text.size());
+			strings += text;
+		}
+		u32(it->second);
+	}
+
+	void value(const Value& val) {
+		if (val.is_nil()) u8(ValueTag_NIL);
+		else if (val.is_bool()) u8(val.as_bool() ? ValueTag_TRUE : ValueTag_FALSE);
+		else if (val.is_number()) {
+			u8(ValueTag_NUMBER);
+			double number = val.as_number();
+			bytes(&number, 8);
+		} else if (val.is_string()) {
+			u8(ValueTag_STRING);
+			string(static_cast<StringObj*>(val.as_obj())->val);
+		} else throw Unwritable();
+	}
+
+	void token(const Token& tok) {
+		u8(tok.type);
+		string(tok.lexeme);
+		value(tok.literal);
+		i32(tok.line);
+		if (tok.symbol == SYM_NONE) u32(NO_STRING);
+		else string(symbols.name(tok.symbol));
+	}
+
+	void slot(Access access, int index) {
+		u8(access);
+		i32(index);
+	}
+
+	void function(Span<Token> params, Span<Stmt*> body, int num_slots, Span<Capture> captures, Span<int> boxed) {
+		u32(params.size());
+		for (auto& p : params) token(p);
+		write(body);
+		i32(num_slots);
+		u32(captures.size());
+		for (auto& c : captures) {
+			u8(c.is_local);
+			i32(c.index);
+		}
+		u32(boxed.size());
+		for (int b : boxed) i32(b);
+	}
+};
+
+void write_cache(const std::string& path, uint64_t hash, Span<Stmt*> stmts) {
+#ifdef CACHE_SUPPORTED
+	CacheWriter writer;
+	try {
+		writer.write(stmts);
+	} catch (Unwritable&) {
+		return;
+	}
+	std::vector<uint32_t> table;
+	table.reserve(2 * writer.entries.size());
+	for (auto& [offset, length] : writer.entries) {
+		table.push_back(offset);
+		table.push_back(length);
+	}
+	CacheHeader header;
+	memcpy(header.magic, CACHE_MAGIC, 4);
+	header.version = CACHE_VERSION;
+	header.hash = hash;
+	header.checksum = fnv1a(FNV_OFFSET, table.data(), 4 * table.size());
+	header.checksum = fnv1a(header.checksum, writer.strings.data(), writer.strings.size());
+	header.checksum = fnv1a(header.checksum, writer.tree.data(), writer.tree.size());
+	header.num_strings = writer.entries.size();
+	header.strings_size = writer.strings.size();
+	header.tree_size = writer.tree.size();
+	header.unused = 0;
+	// Written under a name of its own and renamed into place, so a run
+	// starting meanwhile never maps a half written file.
+	std::string tmp = path + "." + std::to_string(getpid()) + ".tmp";
+	{
+		std::ofstream out(tmp, std::ios::binary);
+		if (!out) return;
+		out.write((const char*) &header, sizeof(header));
+		out.write((const char*) table.data(), 4 * table.size());
+		out.write(writer.strings.data(), writer.strings.size());
+		out.write((const char*) writer.tree.data(), writer.tree.size());
+		if (!out) {
+			out.close();
+			std::remove(tmp.c_str());
+			return;
+		}
+	}
+	if (std::rename(tmp.c_str(), path.c_str()) != 0) std::remove(tmp.c_str());
+#endif
+}
+
+// Thrown for anything out of place in a cache file.
+struct BadCache {};
+
+// Rebuilds the AST. Every read is bounds checked and every tag checked, so
+// a truncated or mangled file is rejected rather than read past its end.
+// Every slot and capture index is checked against the frame it indexes, so
+// a file that got past the checksum still can not index past a frame.
+class CacheReader {
+public:
+	CacheReader(const CacheHeader& header, const uint8_t* base, Arena& arena)
+		: arena(arena), syms(header.num_strings, SYM_NONE), num_strings(header.num_strings), tree_size(header.tree_size) {
+		table = base + sizeof(CacheHeader);
+		strings = table + 8 * (size_t) num_strings;
+		strings_size = header.strings_size;
+		curr = strings + strings_size;
+		end = curr + header.tree_size;
+	}
+
+	Span<Stmt*> read() {
+		Span<Stmt*> stmts = read_stmts();
+		if (curr != end) throw BadCache();
+		return stmts;
+	}
+
+private:
+	Arena& arena;
+	std::vector<Symbol> syms;
+	uint32_t num_strings;
+	const uint8_t* table;
+	const uint8_t* strings;
+	uint32_t strings_size;
+	const uint8_t* curr;
+	const uint8_t* end;
+	uint32_t tree_size;
+
+	// A function or a top level block being read. Their frame sizes and
+	// captures come after their bodies, so the slots and capture indices the
+	// body uses are tracked as one past the highest, and checked at the end.
+	struct Scope {
+		bool is_fn;
+		int locals;
+		int upvalues;
+	};
+	// Innermost last. Blocks inside a function share its frame and get no
+	// scope of their own.
+	std::vector<Scope> scopes;
+
+	void bytes(void* data, size_t size) {
+		if ((size_t) (end - curr) < size) throw BadCache();
+		memcpy(data, curr, size);
+		curr += size;
+	}
+
+	uint8_t u8() {
+		uint8_t val;
+		bytes(&val, 1);
+		return val;
+	}
+
+	uint32_t u32() {
+		uint32_t val;
+		bytes(&val, 4);
+		return val;
+	}
+
+	int32_t i32() {
+		int32_t val;
+		bytes(&val, 4);
+		return val;
+	}
+
+	// A count of items that each take at least one byte, checked before it
+	// sizes anything.
+	uint32_t count() {
+		uint32_t n = u32();
+		if (n > (size_t) (end - curr)) throw BadCache();
+		return n;
+	}
+
+	std::string_view string(uint32_t index) {
+		if (index >= num_strings) throw BadCache();
+		uint32_t entry[2];
+		memcpy(entry, table + 8 * (size_t) index, 8);
+		if (entry[0] > strings_size || entry[1] > strings_size - entry[0]) throw BadCache();
+		return std::string_view((const char*) strings + entry[0], entry[1]);
+	}
+
+	std::string_view string() { return string(u32()); }
+
+	Symbol symbol(uint32_t index) {
+		std::string_view name = string(index);
+		if (syms[index] == SYM_NONE) syms[index] = symbols.intern(name);
+		return syms[index];
+	}
+
+	Value value() {
+		switch (u8()) {
+			case ValueTag_NIL: return Value();
+			case ValueTag_FALSE: return Value(false);
+			case ValueTag_TRUE: return Value(true);
+			case ValueTag_NUMBER: {
+				double number;
+				bytes(&number, 8);
+				return Value(number);
+			}
+			case ValueTag_STRING: return Value(symbols.string(symbol(u32())));
+		}
+		throw BadCache();
+	}
+
+	Token token() {
+		Token tok;
+		uint8_t type = u8();
+		if (type > _EOF) throw BadCache();
+		tok.type = (TokenType) type;
+		tok.lexeme = string();
+		tok.literal = value();
+		tok.line = i32();
+		uint32_t sym = u32();
+		tok.symbol = sym == NO_STRING ? SYM_NONE : symbol(sym);
+		return tok;
+	}
+
+	Access access() {
+		uint8_t val = u8();
+		if (val > Access_UPVALUE) throw BadCache();
+		return (Access) val;
+	}
+
+	template <typename T>
+	void slot(T* node) {
+		node->access = access();
+		node->slot = i32();
+		if (node->access == Access_LOCAL || node->access == Access_BOXED) use_local(node->slot);
+		else if (node->access == Access_UPVALUE) use_upvalue(node->slot);
+	}
+
+	void use_local(int index) {
+		if (index < 0 || scopes.empty()) throw BadCache();
+		scopes.back().locals = std::max(scopes.back().locals, index + 1);
+	}
+
+	// Only a function has captures, so there are none at the top level.
+	void use_upvalue(int index) {
+		if (index < 0 || scopes.empty() || !scopes.back().is_fn) throw BadCache();
+		scopes.back().upvalues = std::max(scopes.back().upvalues, index + 1);
+	}
+
+	// A slot count, which is at most one per byte of the tree.
+	int num_slots() {
+		int n = i32();
+		if (n < 0 || (uint32_t) n > tree_size) throw BadCache();
+		return n;
+	}
+
+	Span<Stmt*> read_stmts() {
+		std::vector<Stmt*> stmts(count());
+		for (auto& s : stmts) s = expect(read_stmt());
+		return arena.copy(stmts);
+	}
+
+	// Ends the scope begun before fn's params were read. Its captures index
+	// the frame or the captures of the enclosing function.
+	template <typename T>
+	T* function(T* fn) {
+		fn->num_slots = num_slots();
+		std::vector<Capture> captures(count());
+		for (auto& c : captures) {
+			c.is_local = u8();
+			c.index = i32();
+		}
+		fn->captures = arena.copy(captures);
+		std::vector<int> boxed(count());
+		for (auto& b : boxed) {
+			b = i32();
+			if (b < 0 || b >= fn->num_slots) throw BadCache();
+		}
+		fn->boxed = arena.copy(boxed);
+		Scope scope = scopes.back();
+		scopes.pop_back();
+		if (scope.locals > fn->num_slots || (size_t) scope.upvalues > captures.size()) throw BadCache();
+		for (auto& c : captures) {
+			if (c.is_local) use_local(c.index);
+			else use_upvalue(c.index);
+		}
+		return fn;
+	}
+
+	Span<Token> params() {
+		std::vector<Token> params(count());
+		for (auto& p : params) p = token();
+		return arena.copy(params);
+	}
+
+	Expr* read_expr() {
+		switch (u8()) {
+			case Node_NULL: return nullptr;
+			case Node_BINARY: {
+				Expr* left = expect(read_expr());
+				Token op = token();
+				return arena.make<Binary>(left, op, expect(read_expr()));
+			}
+			case Node_GROUPING: return arena.make<Grouping>(expect(read_expr()));
+			case Node_LITERAL: return arena.make<Literal>(value());
+			case Node_LOGICAL: {
+				Expr* left = expect(read_expr());
+				Token op = token();
+				return arena.make<Logical>(left, op, expect(read_expr()));
+			}
+			case Node_UNARY: {
+				Token op = token();
+				return arena.make<Unary>(op, expect(read_expr()));
+			}
+			case Node_VARIABLE: {
+				Variable* expr = arena.make<Variable>(token());
+				slot(expr);
+				return expr;
+			}
+			case Node_ASSIGN: {
+				Token name = token();
+				Assign* expr = arena.make<Assign>(name, expect(read_expr()));
+				slot(expr);
+				return expr;
+			}
+			case Node_CALL: {
+				Expr* callee = expect(read_expr());
+				Token paren = token();
+				std::vector<Expr*> arguments(count());
+				for (auto& a : arguments) a = expect(read_expr());
+				Call* expr = arena.make<Call>(callee, paren, arena.copy(arguments));
+				if (u8()) expr->method = dynamic_cast<Get*>(callee);
+				return expr;
+			}
+			case Node_LAMBDA: {
+				scopes.push_back(Scope { true, 0, 0 });
+				Span<Token> fn_params = params();
+				Span<Stmt*> body = read_stmts();
+				return function(arena.make<LambdaExpr>(fn_params, body));
+			}
+			case Node_GET: {
+				Expr* obj = expect(read_expr());
+				return arena.make<Get>(obj, token());
+			}
+			case Node_SET: {
+				Expr* obj = expect(read_expr());
+				Token name = token();
+				return arena.make<Set>(obj, name, expect(read_expr()));
+			}
+			case Node_THIS: {
+				This* expr = arena.make<This>(token());
+				slot(expr);
+				return expr;
+			}
+		}
+		throw BadCache();
+	}
+
+	Stmt* read_stmt() {
+		switch (u8()) {
+			case Node_NULL: return nullptr;
+			case Node_EXPRESSION: return arena.make<Expression>(expect(read_expr()));
+			case Node_PRINT: return arena.make<Print>(expect(read_expr()));
+			case Node_VAR: {
+				Token name = token();
+				Var* stmt = arena.make<Var>(name, read_expr());
+				slot(stmt);
+				return stmt;
+			}
+			case Node_BLOCK: {
+				// A top level block sizes the frame its locals are in.
+				bool top_level = scopes.empty() || !scopes.back().is_fn;
+				if (top_level) scopes.push_back(Scope { false, 0, 0 });
+				Block* stmt = arena.make<Block>(read_stmts());
+				stmt->num_slots = num_slots();
+				if (top_level) {
+					if (scopes.back().locals > stmt->num_slots) throw BadCache();
+					scopes.pop_back();
+				}
+				return stmt;
+			}
+			case Node_IF: {
+				Expr* condition = expect(read_expr());
+				Stmt* then_branch = expect(read_stmt());
+				return arena.make<If>(condition, then_branch, read_stmt());
+			}
+			case Node_WHILE: {
+				Expr* condition = read_expr();
+				Stmt* body = expect(read_stmt());
+				return arena.make<While>(condition, body, read_expr());
+			}
+			case Node_FN: return read_fn();
+			case Node_RETURN: {
+				Token keyword = token();
+				return arena.make<Return>(keyword, read_expr());
+			}
+			case Node_BREAK: return arena.make<Break>(token());
+			case Node_CONTINUE: return arena.make<Continue>(token());
+			case Node_CLASS: {
+				Token name = token();
+				std::vector<FnStmt*> methods(count());
+				for (auto& m : methods) {
+					if (u8() != Node_FN) throw BadCache();
+					m = read_fn();
+				}
+				ClassStmt* stmt = arena.make<ClassStmt>(name, arena.copy(methods));
+				slot(stmt);
+				return stmt;
+			}
+			case Node_IMPORT: {
+				Token keyword = token();
+				return arena.make<Import>(keyword, token());
+			}
+		}
+		throw BadCache();
+	}
+
+	FnStmt* read_fn() {
+		Token name = token();
+		scopes.push_back(Scope { true, 0, 0 });
+		Span<Token> fn_params = params();
+		Span<Stmt*> body = read_stmts();
+		FnStmt* stmt = function(arena.make<FnStmt>(name, fn_params, body));
+		slot(stmt);
+		return stmt;
+	}
+
+	template <typename T>
+	static T* expect(T* node) {
+		if (node == nullptr) throw BadCache();
+		return node;
+	}
+};
+
+CacheFile::CacheFile() : data(nullptr), size(0) {}
+
+CacheFile::~CacheFile() {
+#ifdef CACHE_SUPPORTED
+	if (data != nullptr) munmap(data, size);
+#endif
+}
+
+bool CacheFile::load(const std::string& path, uint64_t hash, Arena& arena, Span<Stmt*>& stmts) {
+#ifdef CACHE_SUPPORTED
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) return false;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(CacheHeader)) {
+		close(fd);
+		return false;
+	}
+	size_t file_size = st.st_size;
+	void* mem = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mem == MAP_FAILED) return false;
+	CacheHeader header;
+	memcpy(&header, mem, sizeof(header));
+	bool valid = memcmp(header.magic, CACHE_MAGIC, 4) == 0
+		&& header.version == CACHE_VERSION
+		&& header.hash == hash
+		&& file_size == sizeof(header) + 8 * (uint64_t) header.num_strings + header.strings_size + header.tree_size
+		&& header.checksum == fnv1a(FNV_OFFSET, (const uint8_t*) mem + sizeof(header), file_size - sizeof(header));
+	if (!valid) {
+		munmap(mem, file_size);
+		return false;
+	}
+	try {
+		stmts = CacheReader(header, (const uint8_t*) mem, arena).read();
+	} catch (BadCache&) {
+		munmap(mem, file_size);
+		return false;
+	}
+	data = mem;
+	size = file_size;
+	return true;
+#else
+	return false;
+#endif
+}
@@ -0,0 +1,51 @@
+#ifndef CACHE
+#define CACHE
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <cstddef>
+#include "Arena.hpp"
+#include "Expr.hpp"
+#include "Stmt.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define CACHE_SUPPORTED
+#endif
+
+// Bumped whenever the format or the AST it encodes changes, so older cache
+// files are ignored rather than misread.
+#define CACHE_VERSION 3
+
+// FNV-1a over a script's text. A cache file is only used for the text it
+// was written from.
+uint64_t hash_source(std::string_view text);
+
+// Writes a resolved and optimized AST that has not run yet to path, so the
+// next run of the same script can skip scanning, parsing, resolving and
+// optimizing. Failing to write only loses the cache.
+void write_cache(const std::string& path, uint64_t hash, Span<Stmt*> stmts);
+
+// A cache file mapped into memory. The AST read from it is rebuilt in an
+// arena, but its token lexemes point into the mapping, so the CacheFile is
+// kept for as long as the AST.
+class CacheFile {
+public:
+	CacheFile();
+
+	CacheFile(const CacheFile&) = delete;
+
+	CacheFile& operator=(const CacheFile&) = delete;
+
+	~CacheFile();
+
+	// Returns false, with nothing mapped, if path is missing, unreadable or
+	// was written for other text or by another version.
+	bool load(const std::string& path, uint64_t hash, Arena& arena, Span<Stmt*>& stmts);
+
+private:
+	void* data;
+	size_t size;
+};
+
+#endif
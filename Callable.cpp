@@ -1,346 +1,476 @@
 #include "Callable.hpp"
+#include "Heap.hpp"
+#include <cmath>
 
 Fn::Fn(
-		std::shared_ptr<Token> name, 
-		std::vector<std::shared_ptr<Token>> params, 
-		std::vector<std::shared_ptr<Stmt>> body, 
-		std::shared_ptr<Environment> closure
-	) : name(name), params(params), body(body), closure(closure) {}
-
-std::shared_ptr<Obj> Fn::call(Interpreter* interpreter, std::vector<std::shared_ptr<Obj>> arguments) {
-	auto env = std::make_shared<Environment>(closure);
-	for (int i = 0; i < params.size(); i++) {
-		env->define(params[i]->lexeme, arguments[i]);
-	}
-	try {
-		interpreter->execute_block(body, env);
-	} catch (ReturnException return_value) {
-		return return_value.val;
-	}
-	return nullptr;
+		Token name, 
+		Span<Token> params, 
+		Span<Stmt*> body, 
+		int num_slots,
+		Span<int> boxed,
+		FnStmt* lazy
+	) : Callable(OBJ_FN), name(name), params(params), body(body), num_slots(num_slots), boxed(boxed), lazy(lazy), jit(nullptr), hotness(0) {}
+
+Fn::~Fn() {
+	delete jit;
+}
+
+Value Fn::call(Interpreter* interpreter, const std::vector<Value>& arguments) {
+	return interpreter->call_fn(this, arguments);
 }
 
 int Fn::num_params() {
 	return params.size();
 }
 
-std::shared_ptr<Fn> Fn::bind(std::shared_ptr<Instance> instance) {
-	auto env = std::make_shared<Environment>(closure);
-	env->define("this", instance);
-	return std::make_shared<Fn>(name, params, body, env);
+Value Fn::call_method(Interpreter* interpreter, Value receiver, const std::vector<Value>& arguments) {
+	if (lazy != nullptr) interpreter->load(this);
+	return interpreter->execute_body(body, num_slots, boxed, upvalues, arguments, &receiver);
 }
 
-Lambda::Lambda(std::vector<std::shared_ptr<Token>> params, std::vector<std::shared_ptr<Stmt>> body)
-	: params(params), body(body) {}
-
-std::shared_ptr<Obj> Lambda::call(Interpreter* interpreter, std::vector<std::shared_ptr<Obj>> arguments) {
-	auto env = std::make_shared<Environment>();
-	for (int i = 0; i < params.size(); i++) {
-		env->define(params[i]->lexeme, arguments[i]);
-	}
-	try {
-		interpreter->execute_block(body, env);
-	} catch (ReturnException return_value) {
-		return return_value.val;
+void Fn::trace() {
+	for (auto u : upvalues) heap.mark(u);
+	if (jit != nullptr) {
+		for (auto& c : jit->callees) heap.mark(c.second);
 	}
-	return nullptr;
+}
+
+BoundMethod::BoundMethod(Value receiver, Callable* method)
+	: Callable(OBJ_BOUND_METHOD), receiver(receiver), method(method) {}
+
+Value BoundMethod::call(Interpreter* interpreter, const std::vector<Value>& arguments) {
+	return method->call_method(interpreter, receiver, arguments);
+}
+
+int BoundMethod::num_params() {
+	return method->num_params();
+}
+
+void BoundMethod::trace() {
+	heap.mark(receiver);
+	heap.mark(method);
+}
+
+Lambda::Lambda(Span<Token> params, Span<Stmt*> body, int num_slots, Span<int> boxed, LambdaExpr* lazy)
+	: Callable(OBJ_LAMBDA), params(params), body(body), num_slots(num_slots), boxed(boxed), lazy(lazy) {}
+
+Value Lambda::call(Interpreter* interpreter, const std::vector<Value>& arguments) {
+	if (lazy != nullptr) interpreter->load(this);
+	return interpreter->execute_body(body, num_slots, boxed, upvalues, arguments);
 }
 
 int Lambda::num_params() {
 	return params.size();
 }
 
-std::shared_ptr<Obj> Clock::call(Interpreter* interpreter, std::vector<std::shared_ptr<Obj>> arguments) {
+void Lambda::trace() {
+	for (auto u : upvalues) heap.mark(u);
+}
+
+Value Clock::call(Interpreter* interpreter, const std::vector<Value>& arguments) {
 	auto time = std::chrono::system_clock::now();
 	auto duration = time.time_since_epoch();
 	double seconds = std::chrono::duration_cast<std::chrono::milliseconds>(duration).count() / 1000.0;
-	return std::make_shared<DoubleObj>(seconds);
+	return Value(seconds);
 }
 
 int Clock::num_params() {
 	return 0;
 }
 
-Class::Class(std::string name, std::shared_ptr<std::unordered_map<std::string, std::shared_ptr<Callable>>> methods) 
-	: name(name), methods(methods) {}
+Class::Class(std::string name, std::shared_ptr<std::unordered_map<Symbol, Callable*>> methods) 
+	: Callable(OBJ_CLASS), name(name), methods(methods), shape(std::make_shared<Shape>()) {}
 
-std::shared_ptr<Obj> Class::call(Interpreter* interpreter, std::vector<std::shared_ptr<Obj>> arguments) {
-	auto instance = std::make_shared<Instance>(name, methods);
-	if (methods->count("__init__")) {
-		if (auto method = std::dynamic_pointer_cast<Fn>((*methods)["__init__"])) {
-			method->bind(instance)->call(interpreter, arguments);
-		}
+Value Class::call(Interpreter* interpreter, const std::vector<Value>& arguments) {
+	auto instance = heap.alloc<Instance>(name, methods, shape);
+	auto init = methods->find(SYM_INIT);
+	if (init != methods->end() && (init->second->obj_type == OBJ_FN || init->second->obj_type == OBJ_AOT_FN)) {
+		init->second->call_method(interpreter, instance, arguments);
 	}
 	return instance;
 }
 
 int Class::num_params() {
-	if (methods->count("__init__")) return (*methods)["__init__"]->num_params();
+	auto init = methods->find(SYM_INIT);
+	if (init != methods->end()) return init->second->num_params();
 	return 0;
 }
 
+void Class::trace() {
+	for (auto& m : *methods) heap.mark(m.second);
+}
+
 std::string Class::to_string() {
 	return "<class " + name + ">";
 }
 
-Instance::Instance(std::string type, std::shared_ptr<std::unordered_map<std::string,std::shared_ptr<Callable>>> methods)
-	: type(type), methods(methods) {}
+Instance::Instance(
+		std::string type,
+		std::shared_ptr<std::unordered_map<Symbol, Callable*>> methods,
+		std::shared_ptr<Shape> root_shape,
+		ObjType obj_type
+	) : Obj(obj_type), type(type), methods(methods), root_shape(root_shape), shape(root_shape.get()) {}
+
+// Every instance with a given shape shares a methods table, so a cached
+// method is valid for as long as the shape matches.
+const CacheEntry* Instance::lookup(Symbol name, InlineCache& cache) {
+	const CacheEntry* entry = cache.find(shape->id);
+	if (entry != nullptr) return entry;
+	int index = shape->find(name);
+	if (index >= 0) return cache.add(CacheEntry { shape->id, index, nullptr, nullptr });
+	auto method = methods->find(name);
+	if (method != methods->end()) return cache.add(CacheEntry { shape->id, -1, method->second, nullptr });
+	return nullptr;
+}
 
-std::shared_ptr<Obj> Instance::get(std::shared_ptr<Token> name) {
-	if (feilds.count(name->lexeme)) {
-		return feilds[name->lexeme];
-	} else if (methods->count(name->lexeme)) {
-		if (auto method = std::dynamic_pointer_cast<Fn>((*methods)[name->lexeme])) {
-			return method->bind(std::shared_ptr<Instance>(this, [](Instance*) {}));
-		}
-		return (*methods)[name->lexeme];
+Value Instance::get(const Token& name, InlineCache& cache) {
+	const CacheEntry* entry = lookup(name.symbol, cache);
+	if (entry == nullptr) throw RuntimeError(name, "Undefined property '" + std::string(name.lexeme) + "'");
+	if (entry->index >= 0) return fields[entry->index];
+	return heap.alloc<BoundMethod>(this, entry->method);
+}
+
+void Instance::set(Symbol name, Value val, InlineCache& cache) {
+	const CacheEntry* entry = cache.find(shape->id);
+	if (entry == nullptr) {
+		int index = shape->find(name);
+		if (index >= 0) entry = cache.add(CacheEntry { shape->id, index, nullptr, nullptr });
+		else entry = cache.add(CacheEntry { shape->id, (int) fields.size(), nullptr, shape->add(name) });
+	}
+	if (entry->transition != nullptr) {
+		shape = entry->transition;
+		fields.push_back(val);
+	} else {
+		fields[entry->index] = val;
 	}
-	throw RuntimeError(name, "Undefined property '" + name->lexeme + "'");
 }
 
-void Instance::set(std::shared_ptr<Token> name, std::shared_ptr<Obj> val) {
-	feilds[name->lexeme] = val;
+void Instance::trace() {
+	for (auto& m : *methods) heap.mark(m.second);
+	for (auto& f : fields) heap.mark(f);
 }
 
 std::string Instance::to_string() {
 	return "<instance of class " + type + ">";
 }
 
-List::List() {}
+NativeMethod::NativeMethod(Impl impl, int arity) : impl(impl), arity(arity) {}
 
-std::shared_ptr<Obj> List::call(Interpreter* interpreter, std::vector<std::shared_ptr<Obj>> arguments) {
-	auto vec = std::make_shared<std::vector<std::shared_ptr<Obj>>>();
-	auto methods = std::make_shared<std::unordered_map<std::string, std::shared_ptr<Callable>>>();
-	(*methods)["size"] = std::make_shared<ListSize>(vec);
-	(*methods)["__get__"] = std::make_shared<ListGet>(vec);
-	(*methods)["__set__"] = std::make_shared<ListSet>(vec);
-	(*methods)["push"] = std::make_shared<ListPush>(vec);
-	(*methods)["pop"] = std::make_shared<ListPop>(vec);
-	(*methods)["sort"] = std::make_shared<ListSort>(vec);
-	(*methods)["map"] = std::make_shared<ListMap>(vec);
-	(*methods)["reduce"] = std::make_shared<ListReduce>(vec);
-	(*methods)["filter"] = std::make_shared<ListFilter>(vec);
-	return std::make_shared<Instance>("List", methods);
+Value NativeMethod::call(Interpreter* interpreter, const std::vector<Value>& arguments) {
+	return Value();
 }
 
-int List::num_params() {
-	return 0;
+Value NativeMethod::call_method(Interpreter* interpreter, Value receiver, const std::vector<Value>& arguments) {
+	return impl(interpreter, static_cast<Instance*>(receiver.as_obj()), arguments);
+}
+
+int NativeMethod::num_params() {
+	return arity;
 }
 
-ListSize::ListSize(std::shared_ptr<std::vector<std::shared_ptr<Obj>>> list) : list(list) {}
+typedef std::shared_ptr<std::unordered_map<Symbol, Callable*>> MethodTable;
 
-std::shared_ptr<Obj> ListSize::call(Interpreter* interpreter, std::vector<std::shared_ptr<Obj>> arguments) {
-	return std::make_shared<DoubleObj>(list->size());
+// Method tables are built on first use, once the heap is running, and are
+// pinned since nothing else keeps the natives alive.
+static void add_native(MethodTable& methods, const char* name, NativeMethod::Impl impl, int arity) {
+	(*methods)[symbols.intern(name)] = heap.pin(heap.alloc<NativeMethod>(impl, arity));
 }
 
-int ListSize::num_params() {
-	return 0;
+static std::vector<Value>& items(Instance* receiver) {
+	return static_cast<ListInstance*>(receiver)->items;
 }
 
-ListGet::ListGet(std::shared_ptr<std::vector<std::shared_ptr<Obj>>> list) : list(list) {}
+static Value list_size(Interpreter* interpreter, Instance* receiver, const std::vector<Value>& arguments) {
+	return Value((double) items(receiver).size());
+}
 
-std::shared_ptr<Obj> ListGet::call(Interpreter* interpreter, std::vector<std::shared_ptr<Obj>> arguments) {
-	if (auto double_obj = std::dynamic_pointer_cast<DoubleObj>(arguments[0])) {
-		int idx = (int) double_obj->val;
-		if (0 <= idx && idx < list->size()) return (*list)[idx];
+static Value list_get(Interpreter* interpreter, Instance* receiver, const std::vector<Value>& arguments) {
+	auto& list = items(receiver);
+	if (arguments[0].is_number()) {
+		int idx = (int) arguments[0].as_number();
+		if (0 <= idx && idx < list.size()) return list[idx];
 	}
-	return nullptr;
+	return Value();
 }
 
-int ListGet::num_params() {
-	return 1;
+static Value list_set(Interpreter* interpreter, Instance* receiver, const std::vector<Value>& arguments) {
+	auto& list = items(receiver);
+	if (arguments[0].is_number()) {
+		int idx = (int) arguments[0].as_number();
+		if (0 <= idx && idx < list.size()) list[idx] = arguments[1];
+	}
+	return Value();
 }
 
-ListSet::ListSet(std::shared_ptr<std::vector<std::shared_ptr<Obj>>> list) : list(list) {}
+static Value list_push(Interpreter* interpreter, Instance* receiver, const std::vector<Value>& arguments) {
+	items(receiver).push_back(arguments[0]);
+	return Value();
+}
 
-std::shared_ptr<Obj> ListSet::call(Interpreter* interpreter, std::vector<std::shared_ptr<Obj>> arguments) {
-	if (auto double_obj = std::dynamic_pointer_cast<DoubleObj>(arguments[0])) {
-		int idx = (int) double_obj->val;
-		if (0 <= idx && idx < list->size()) (*list)[idx] = arguments[1];
+static Value list_pop(Interpreter* interpreter, Instance* receiver, const std::vector<Value>& arguments) {
+	auto& list = items(receiver);
+	if (list.size() == 0) return Value();
+	auto back = list.back();
+	list.pop_back();
+	return back;
+}
+
+static Value list_sort(Interpreter* interpreter, Instance* receiver, const std::vector<Value>& arguments) {
+	auto& list = items(receiver);
+	if (arguments[0].is_callable()) {
+		auto function = static_cast<Callable*>(arguments[0].as_obj());
+		if (function->num_params() != 2) return Value();
+		std::sort(list.begin(), list.end(), [interpreter, function](Value a, Value b) {
+			std::vector<Value> arguments {a, b};
+			auto res = function->call(interpreter, arguments);
+			if (res.is_number()) {
+				return res.as_number() < 0;
+			} else {
+				return interpreter->is_truthy(res);
+			}
+		});
 	}
-	return nullptr;
+	return Value();
 }
 
-int ListSet::num_params() {
-	return 2;
+static Value list_map(Interpreter* interpreter, Instance* receiver, const std::vector<Value>& arguments) {
+	auto& list = items(receiver);
+	if (arguments[0].is_callable()) {
+		auto function = static_cast<Callable*>(arguments[0].as_obj());
+		if (function->num_params() != 1) return Value();
+		auto result = heap.alloc<ListInstance>();
+		for (auto obj : list) result->items.push_back(function->call(interpreter, {obj}));
+		return result;
+	}
+	return Value();
 }
 
-ListPush::ListPush(std::shared_ptr<std::vector<std::shared_ptr<Obj>>> list) : list(list) {}
+static Value list_reduce(Interpreter* interpreter, Instance* receiver, const std::vector<Value>& arguments) {
+	auto& list = items(receiver);
+	if (arguments[0].is_callable()) {
+		auto function = static_cast<Callable*>(arguments[0].as_obj());
+		if (function->num_params() != 2) return Value();
+		auto res = arguments[1];
+		for (auto obj : list) res = function->call(interpreter, {res, obj});
+		return res;
+	}
+	return Value();
+}
 
-std::shared_ptr<Obj> ListPush::call(Interpreter* interpreter, std::vector<std::shared_ptr<Obj>> arguments) {
-	list->push_back(arguments[0]);
-	return nullptr;
+static Value list_filter(Interpreter* interpreter, Instance* receiver, const std::vector<Value>& arguments) {
+	auto& list = items(receiver);
+	if (arguments[0].is_callable()) {
+		auto function = static_cast<Callable*>(arguments[0].as_obj());
+		if (function->num_params() != 1) return Value();
+		auto result = heap.alloc<ListInstance>();
+		for (auto obj : list) {
+			if (interpreter->is_truthy(function->call(interpreter, {obj}))) result->items.push_back(obj);
+		}
+		return result;
+	}
+	return Value();
+}
+
+static MethodTable list_methods() {
+	static MethodTable methods;
+	if (methods == nullptr) {
+		methods = std::make_shared<std::unordered_map<Symbol, Callable*>>();
+		add_native(methods, "size", list_size, 0);
+		add_native(methods, "__get__", list_get, 1);
+		add_native(methods, "__set__", list_set, 2);
+		add_native(methods, "push", list_push, 1);
+		add_native(methods, "pop", list_pop, 0);
+		add_native(methods, "sort", list_sort, 1);
+		add_native(methods, "map", list_map, 1);
+		add_native(methods, "reduce", list_reduce, 2);
+		add_native(methods, "filter", list_filter, 1);
+	}
+	return methods;
 }
 
-int ListPush::num_params() {
-	return 1;
+// Every list shares one root shape, so call sites on lists stay monomorphic.
+static std::shared_ptr<Shape> list_shape() {
+	static std::shared_ptr<Shape> shape = std::make_shared<Shape>();
+	return shape;
 }
 
-ListPop::ListPop(std::shared_ptr<std::vector<std::shared_ptr<Obj>>> list) : list(list) {}
+ListInstance::ListInstance() : Instance("List", list_methods(), list_shape(), OBJ_LIST) {}
 
-std::shared_ptr<Obj> ListPop::call(Interpreter* interpreter, std::vector<std::shared_ptr<Obj>> arguments) {
-	if (list->size() == 0) return nullptr;
-	auto back = list->back();
-	list->pop_back();
-	return back;
+void ListInstance::trace() {
+	Instance::trace();
+	for (auto& v : items) heap.mark(v);
 }
 
-int ListPop::num_params() {
-	return 0;
+static Table& entries(Instance* receiver) {
+	return static_cast<MapInstance*>(receiver)->entries;
 }
 
-ListSort::ListSort(std::shared_ptr<std::vector<std::shared_ptr<Obj>>> list) : list(list) {}
+static Value map_get(Interpreter* interpreter, Instance* receiver, const std::vector<Value>& arguments) {
+	Value* val = entries(receiver).find(arguments[0]);
+	return val != nullptr ? *val : Value();
+}
 
-std::shared_ptr<Obj> ListSort::call(Interpreter* interpreter, std::vector<std::shared_ptr<Obj>> arguments) {
-	if (auto function = std::dynamic_pointer_cast<Callable>(arguments[0])) {
-		if (function->num_params() != 2) return nullptr;
-		std::sort(list->begin(), list->end(), [interpreter, function](std::shared_ptr<Obj> a, std::shared_ptr<Obj> b) {
-			std::vector<std::shared_ptr<Obj>> arguments {a, b};
-			auto res = function->call(interpreter, arguments);
-			if (auto res_double = std::dynamic_pointer_cast<DoubleObj>(res)) {
-				return res_double->val < 0;
-			} else {
-				return interpreter->is_truthy(res);
-			}
-		});
-	}
-	return nullptr;
+static Value map_set(Interpreter* interpreter, Instance* receiver, const std::vector<Value>& arguments) {
+	entries(receiver).set(arguments[0], arguments[1]);
+	return Value();
 }
 
-int ListSort::num_params() {
-	return 1;
-}
-
-ListMap::ListMap(std::shared_ptr<std::vector<std::shared_ptr<Obj>>> list) : list(list) {}
-
-std::shared_ptr<Obj> ListMap::call(Interpreter* interpreter, std::vector<std::shared_ptr<Obj>> arguments) {
-	if (auto function = std::dynamic_pointer_cast<Callable>(arguments[0])) {
-		if (function->num_params() != 1) return nullptr;
-		auto vec = std::make_shared<std::vector<std::shared_ptr<Obj>>>();
-		for (auto obj : (*list)) vec->push_back(function->call(interpreter, {obj}));
-		auto methods = std::make_shared<std::unordered_map<std::string, std::shared_ptr<Callable>>>();
-		(*methods)["size"] = std::make_shared<ListSize>(vec);
-		(*methods)["__get__"] = std::make_shared<ListGet>(vec);
-		(*methods)["__set__"] = std::make_shared<ListSet>(vec);
-		(*methods)["push"] = std::make_shared<ListPush>(vec);
-		(*methods)["pop"] = std::make_shared<ListPop>(vec);
-		(*methods)["sort"] = std::make_shared<ListSort>(vec);
-		(*methods)["map"] = std::make_shared<ListMap>(vec);
-		(*methods)["reduce"] = std::make_shared<ListReduce>(vec);
-		(*methods)["filter"] = std::make_shared<ListFilter>(vec);
-		return std::make_shared<Instance>("List", methods);
-	}
-	return nullptr;
+static Value map_remove(Interpreter* interpreter, Instance* receiver, const std::vector<Value>& arguments) {
+	entries(receiver).remove(arguments[0]);
+	return Value();
 }
 
-int ListMap::num_params() {
-	return 1;
+static Value map_contains(Interpreter* interpreter, Instance* receiver, const std::vector<Value>& arguments) {
+	return Value(entries(receiver).find(arguments[0]) != nullptr);
 }
 
-ListReduce::ListReduce(std::shared_ptr<std::vector<std::shared_ptr<Obj>>> list) : list(list) {}
+static Value map_size(Interpreter* interpreter, Instance* receiver, const std::vector<Value>& arguments) {
+	return Value((double) entries(receiver).size());
+}
 
-std::shared_ptr<Obj> ListReduce::call(Interpreter* interpreter, std::vector<std::shared_ptr<Obj>> arguments) {
-	if (auto function = std::dynamic_pointer_cast<Callable>(arguments[0])) {
-		if (function->num_params() != 2) return nullptr;
-		auto res = arguments[1];
-		for (auto obj : (*list)) res = function->call(interpreter, {res, obj});
-		return res;
-	}
-	return nullptr;
+static Value map_keys(Interpreter* interpreter, Instance* receiver, const std::vector<Value>& arguments) {
+	auto result = heap.alloc<ListInstance>();
+	result->items.reserve(entries(receiver).size());
+	entries(receiver).for_each([result](const Table::Entry& e) { result->items.push_back(e.key); });
+	return result;
 }
 
-int ListReduce::num_params() {
-	return 2;
+static Value map_values(Interpreter* interpreter, Instance* receiver, const std::vector<Value>& arguments) {
+	auto result = heap.alloc<ListInstance>();
+	result->items.reserve(entries(receiver).size());
+	entries(receiver).for_each([result](const Table::Entry& e) { result->items.push_back(e.val); });
+	return result;
 }
 
-ListFilter::ListFilter(std::shared_ptr<std::vector<std::shared_ptr<Obj>>> list) : list(list) {}
+// The largest count reserve takes. Anything bigger could not be allocated
+// anyway, and is kept well clear of overflowing the capacity math.
+static const double MAX_RESERVE = 4294967296.0;
 
-std::shared_ptr<Obj> ListFilter::call(Interpreter* interpreter, std::vector<std::shared_ptr<Obj>> arguments) {
-	if (auto function = std::dynamic_pointer_cast<Callable>(arguments[0])) {
-		if (function->num_params() != 1) return nullptr;
-		auto vec = std::make_shared<std::vector<std::shared_ptr<Obj>>>();
-		for (auto obj : (*list)) {
-			if (interpreter->is_truthy(function->call(interpreter, {obj}))) vec->push_back(obj);
-		}
-		auto methods = std::make_shared<std::unordered_map<std::string, std::shared_ptr<Callable>>>();
-		(*methods)["size"] = std::make_shared<ListSize>(vec);
-		(*methods)["__get__"] = std::make_shared<ListGet>(vec);
-		(*methods)["__set__"] = std::make_shared<ListSet>(vec);
-		(*methods)["push"] = std::make_shared<ListPush>(vec);
-		(*methods)["pop"] = std::make_shared<ListPop>(vec);
-		(*methods)["sort"] = std::make_shared<ListSort>(vec);
-		(*methods)["map"] = std::make_shared<ListMap>(vec);
-		(*methods)["reduce"] = std::make_shared<ListReduce>(vec);
-		(*methods)["filter"] = std::make_shared<ListFilter>(vec);
-		return std::make_shared<Instance>("List", methods);
+static size_t reserve_count(const Value& val) {
+	if (!val.is_number()) throw NativeError("Reserve count must be a number");
+	double n = val.as_number();
+	if (!(n >= 0 && n <= MAX_RESERVE) || n != std::floor(n)) {
+		throw NativeError("Reserve count must be a whole number from 0 to 4294967296");
 	}
-	return nullptr;
+	return (size_t) n;
 }
 
-int ListFilter::num_params() {
-	return 1;
+static Value map_reserve(Interpreter* interpreter, Instance* receiver, const std::vector<Value>& arguments) {
+	size_t n = reserve_count(arguments[0]);
+	try {
+		entries(receiver).reserve(n);
+	} catch (std::bad_alloc&) {
+		throw NativeError("Out of memory reserving " + interpreter->stringify(arguments[0]) + " entries");
+	}
+	return Value();
+}
+
+static MethodTable map_methods() {
+	static MethodTable methods;
+	if (methods == nullptr) {
+		methods = std::make_shared<std::unordered_map<Symbol, Callable*>>();
+		add_native(methods, "__get__", map_get, 1);
+		add_native(methods, "__set__", map_set, 2);
+		add_native(methods, "remove", map_remove, 1);
+		add_native(methods, "has", map_contains, 1);
+		add_native(methods, "size", map_size, 0);
+		add_native(methods, "keys", map_keys, 0);
+		add_native(methods, "values", map_values, 0);
+		add_native(methods, "reserve", map_reserve, 1);
+	}
+	return methods;
 }
 
-Map::Map() {}
+static std::shared_ptr<Shape> map_shape() {
+	static std::shared_ptr<Shape> shape = std::make_shared<Shape>();
+	return shape;
+}
 
-std::shared_ptr<Obj> Map::call(Interpreter * interpreter, std::vector<std::shared_ptr<Obj>> arguments) {
-	auto map = std::make_shared<std::unordered_map<size_t, std::shared_ptr<Obj>>>();
-	auto methods = std::make_shared<std::unordered_map<std::string, std::shared_ptr<Callable>>>();
-	(*methods)["__get__"] = std::make_shared<MapGet>(map);
-	(*methods)["__set__"] = std::make_shared<MapSet>(map);
-	(*methods)["remove"] = std::make_shared<MapRemove>(map);
-	(*methods)["has"] = std::make_shared<MapContains>(map);
-	return std::make_shared<Instance>("Map", methods);
+MapInstance::MapInstance() : Instance("Map", map_methods(), map_shape(), OBJ_MAP) {}
+
+void MapInstance::trace() {
+	Instance::trace();
+	entries.for_each([](const Table::Entry& e) {
+		heap.mark(e.key);
+		heap.mark(e.val);
+	});
 }
 
-int Map::num_params() {
-	return 0;
+static std::string& buffer(Instance* receiver) {
+	return static_cast<StringBuilderInstance*>(receiver)->buffer;
 }
 
-MapGet::MapGet(std::shared_ptr<std::unordered_map<size_t, std::shared_ptr<Obj>>> map) : map(map) {}
+// Returns the builder so appends can be chained.
+static Value builder_append(Interpreter* interpreter, Instance* receiver, const std::vector<Value>& arguments) {
+	if (arguments[0].is_string()) buffer(receiver) += static_cast<StringObj*>(arguments[0].as_obj())->val;
+	else buffer(receiver) += interpreter->stringify(arguments[0]);
+	return receiver;
+}
 
-std::shared_ptr<Obj> MapGet::call(Interpreter* interpreter, std::vector<std::shared_ptr<Obj>> arguments) {
-	size_t key = arguments[0]->hash();
-	if (map->count(key)) return (*map)[key];
-	return nullptr;
+static Value builder_size(Interpreter* interpreter, Instance* receiver, const std::vector<Value>& arguments) {
+	return Value((double) buffer(receiver).size());
 }
 
-int MapGet::num_params() {
-	return 1;
+static Value builder_reserve(Interpreter* interpreter, Instance* receiver, const std::vector<Value>& arguments) {
+	size_t n = reserve_count(arguments[0]);
+	try {
+		buffer(receiver).reserve(n);
+	} catch (std::bad_alloc&) {
+		throw NativeError("Out of memory reserving " + interpreter->stringify(arguments[0]) + " bytes");
+	}
+	return Value();
 }
 
-MapSet::MapSet(std::shared_ptr<std::unordered_map<size_t, std::shared_ptr<Obj>>> map) : map(map) {}
+static Value builder_clear(Interpreter* interpreter, Instance* receiver, const std::vector<Value>& arguments) {
+	buffer(receiver).clear();
+	return Value();
+}
 
-std::shared_ptr<Obj> MapSet::call(Interpreter* interpreter, std::vector<std::shared_ptr<Obj>> arguments) {
-	size_t key = arguments[0]->hash();
-	(*map)[key] = arguments[1];
-	return nullptr;
+static Value builder_to_string(Interpreter* interpreter, Instance* receiver, const std::vector<Value>& arguments) {
+	return heap.alloc<StringObj>(buffer(receiver));
 }
 
-int MapSet::num_params() {
-	return 2;
+static MethodTable builder_methods() {
+	static MethodTable methods;
+	if (methods == nullptr) {
+		methods = std::make_shared<std::unordered_map<Symbol, Callable*>>();
+		add_native(methods, "append", builder_append, 1);
+		add_native(methods, "size", builder_size, 0);
+		add_native(methods, "reserve", builder_reserve, 1);
+		add_native(methods, "clear", builder_clear, 0);
+		add_native(methods, "to_string", builder_to_string, 0);
+	}
+	return methods;
 }
 
-MapRemove::MapRemove(std::shared_ptr<std::unordered_map<size_t, std::shared_ptr<Obj>>> map) : map(map) {}
+static std::shared_ptr<Shape> builder_shape() {
+	static std::shared_ptr<Shape> shape = std::make_shared<Shape>();
+	return shape;
+}
 
-std::shared_ptr<Obj> MapRemove::call(Interpreter* interpreter, std::vector<std::shared_ptr<Obj>> arguments) {
-	size_t key = arguments[0]->hash();
-	if (map->count(key)) map->erase(key);
-	return nullptr;
+StringBuilderInstance::StringBuilderInstance()
+	: Instance("StringBuilder", builder_methods(), builder_shape(), OBJ_STRING_BUILDER) {}
+
+Value List::call(Interpreter* interpreter, const std::vector<Value>& arguments) {
+	return heap.alloc<ListInstance>();
+}
+
+int List::num_params() {
+	return 0;
 }
 
-int MapRemove::num_params() {
-	return 1;
+Value Map::call(Interpreter * interpreter, const std::vector<Value>& arguments) {
+	return heap.alloc<MapInstance>();
 }
 
-MapContains::MapContains(std::shared_ptr<std::unordered_map<size_t, std::shared_ptr<Obj>>> map) : map(map) {}
+int Map::num_params() {
+	return 0;
+}
 
-std::shared_ptr<Obj> MapContains::call(Interpreter* interpreter, std::vector<std::shared_ptr<Obj>> arguments) {
-	size_t key = arguments[0]->hash();
-	return std::make_shared<BoolObj>(map->count(key));
+Value StringBuilder::call(Interpreter* interpreter, const std::vector<Value>& arguments) {
+	return heap.alloc<StringBuilderInstance>();
 }
 
-int MapContains::num_params() {
-	return 1;
+int StringBuilder::num_params() {
+	return 0;
 }
-	
\ No newline at end of file
@@ -4,14 +4,24 @@
 #include <vector>
 #include <chrono>
 #include "Interpreter.hpp"
-#include "Obj.hpp"
-#include "ReturnException.hpp"
+#include "Value.hpp"
+#include "Shape.hpp"
+#include "Table.hpp"
 
 class Interpreter;
+struct JitCode;
 struct Instance;
 
 struct Callable : public Obj { 
-	virtual std::shared_ptr<Obj> call(Interpreter* interpreter, std::vector<std::shared_ptr<Obj>> arguments) = 0;
+	Callable(ObjType obj_type = OBJ_NATIVE) : Obj(obj_type) {}
+
+	virtual Value call(Interpreter* interpreter, const std::vector<Value>& arguments) = 0;
+
+	// Calls this as a method of receiver. Only methods written in the
+	// language use the receiver, natives already know their instance.
+	virtual Value call_method(Interpreter* interpreter, Value receiver, const std::vector<Value>& arguments) {
+		return call(interpreter, arguments);
+	}
 
 	virtual int num_params() = 0;
     
@@ -20,210 +30,178 @@ struct Callable : public Obj {
 
 struct Fn : public Callable {
 	Fn(
-		std::shared_ptr<Token> name, 
-		std::vector<std::shared_ptr<Token>> params, 
-		std::vector<std::shared_ptr<Stmt>> body, 
-		std::shared_ptr<Environment> closure
+		Token name, 
+		Span<Token> params, 
+		Span<Stmt*> body, 
+		int num_slots,
+		Span<int> boxed,
+		FnStmt* lazy = nullptr
 	);
 
-	std::shared_ptr<Obj> call(Interpreter* interpreter, std::vector<std::shared_ptr<Obj>> arguments) override;
-
-	int num_params() override;
-	
-	std::shared_ptr<Fn> bind(std::shared_ptr<Instance> instance);
-
-	std::shared_ptr<Token> name;
-	std::vector<std::shared_ptr<Token>> params;
-	std::vector<std::shared_ptr<Stmt>> body;
-	std::shared_ptr<Environment> closure;
-};
+	Value call(Interpreter* interpreter, const std::vector<Value>& arguments) override;
 
-struct Lambda : public Callable {
-	Lambda(std::vector<std::shared_ptr<Token>> params, std::vector<std::shared_ptr<Stmt>> body);
-
-	std::shared_ptr<Obj> call(Interpreter* interpreter, std::vector<std::shared_ptr<Obj>> arguments) override;
+	// Methods keep this in slot 0 of their frame, ahead of the params.
+	Value call_method(Interpreter* interpreter, Value receiver, const std::vector<Value>& arguments) override;
 
 	int num_params() override;
 
-	std::vector<std::shared_ptr<Token>> params;
-	std::vector<std::shared_ptr<Stmt>> body;
-};
+	void trace() override;
 
-struct Clock : public Callable {
-	std::shared_ptr<Obj> call(Interpreter* interpreter, std::vector<std::shared_ptr<Obj>> arguments) override;
-	
-	int num_params() override;
+	Token name;
+	Span<Token> params;
+	Span<Stmt*> body;
+	int num_slots;
+	// Params that closures capture, boxed as the frame is set up.
+	Span<int> boxed;
+	// Only the variables the body uses from enclosing functions.
+	Upvalues upvalues;
+	// The declaration whose body is still unparsed, see Interpreter::load.
+	FnStmt* lazy;
+	// Set up by the Jit once the Fn is hot, nullptr before then.
+	JitCode* jit;
+	int hotness;
+
+	~Fn();
 };
 
-struct Class : public Callable {
-    std::string name;
-	std::shared_ptr<std::unordered_map<std::string, std::shared_ptr<Callable>>> methods;
+// A method taken as a value. Calls through obj.method(...) never create one.
+struct BoundMethod : public Callable {
+	Value receiver;
+	Callable* method;
 
-    Class(std::string name, std::shared_ptr<std::unordered_map<std::string, std::shared_ptr<Callable>>> methods);
+	BoundMethod(Value receiver, Callable* method);
 
-	std::shared_ptr<Obj> call(Interpreter* interpreter, std::vector<std::shared_ptr<Obj>> arguments) override;
+	Value call(Interpreter* interpreter, const std::vector<Value>& arguments) override;
 
 	int num_params() override;
 
-    std::string to_string();
+	void trace() override;
 };
 
-struct Instance : public Obj {
-	std::string type;
-	std::shared_ptr<std::unordered_map<std::string, std::shared_ptr<Callable>>> methods;
-	std::unordered_map<std::string, std::shared_ptr<Obj>> feilds;
-
-	Instance(std::string type, std::shared_ptr<std::unordered_map<std::string, std::shared_ptr<Callable>>> methods);
-
-	std::shared_ptr<Obj> get(std::shared_ptr<Token> name);
-	
-	void set(std::shared_ptr<Token> name, std::shared_ptr<Obj> val);
-
-	std::string to_string();
-};
-
-struct List : public Callable {
-	List();
+struct Lambda : public Callable {
+	Lambda(Span<Token> params, Span<Stmt*> body, int num_slots, Span<int> boxed, LambdaExpr* lazy = nullptr);
 
-	std::shared_ptr<Obj> call(Interpreter* interpreter, std::vector<std::shared_ptr<Obj>> arguments) override;
+	Value call(Interpreter* interpreter, const std::vector<Value>& arguments) override;
 
 	int num_params() override;
-};
-
-struct ListSize : Callable {
-	std::shared_ptr<std::vector<std::shared_ptr<Obj>>> list;
-
-	ListSize(std::shared_ptr<std::vector<std::shared_ptr<Obj>>> list);
 
-	std::shared_ptr<Obj> call(Interpreter* interpreter, std::vector<std::shared_ptr<Obj>> arguments) override;
+	void trace() override;
 
-	int num_params() override;
+	Span<Token> params;
+	Span<Stmt*> body;
+	int num_slots;
+	Span<int> boxed;
+	Upvalues upvalues;
+	LambdaExpr* lazy;
 };
 
-struct ListGet : Callable {
-	std::shared_ptr<std::vector<std::shared_ptr<Obj>>> list;
-
-	ListGet(std::shared_ptr<std::vector<std::shared_ptr<Obj>>> list);
-
-	std::shared_ptr<Obj> call(Interpreter* interpreter, std::vector<std::shared_ptr<Obj>> arguments) override;
-
+struct Clock : public Callable {
+	Value call(Interpreter* interpreter, const std::vector<Value>& arguments) override;
+	
 	int num_params() override;
 };
 
-struct ListSet : Callable {
-	std::shared_ptr<std::vector<std::shared_ptr<Obj>>> list;
+struct Class : public Callable {
+    std::string name;
+	std::shared_ptr<std::unordered_map<Symbol, Callable*>> methods;
+	std::shared_ptr<Shape> shape;
 
-	ListSet(std::shared_ptr<std::vector<std::shared_ptr<Obj>>> list);
+    Class(std::string name, std::shared_ptr<std::unordered_map<Symbol, Callable*>> methods);
 
-	std::shared_ptr<Obj> call(Interpreter* interpreter, std::vector<std::shared_ptr<Obj>> arguments) override;
+	Value call(Interpreter* interpreter, const std::vector<Value>& arguments) override;
 
 	int num_params() override;
-};
-
-struct ListPush : Callable {
-	std::shared_ptr<std::vector<std::shared_ptr<Obj>>> list;
-
-	ListPush(std::shared_ptr<std::vector<std::shared_ptr<Obj>>> list);
 
-	std::shared_ptr<Obj> call(Interpreter* interpreter, std::vector<std::shared_ptr<Obj>> arguments) override;
+	void trace() override;
 
-	int num_params() override;
+    std::string to_string();
 };
 
-struct ListPop : Callable {
-	std::shared_ptr<std::vector<std::shared_ptr<Obj>>> list;
-
-	ListPop(std::shared_ptr<std::vector<std::shared_ptr<Obj>>> list);
-
-	std::shared_ptr<Obj> call(Interpreter* interpreter, std::vector<std::shared_ptr<Obj>> arguments) override;
-
-	int num_params() override;
-};
+struct Instance : public Obj {
+	std::string type;
+	std::shared_ptr<std::unordered_map<Symbol, Callable*>> methods;
+	// root_shape keeps the shape tree alive, shape is where this instance is in it.
+	std::shared_ptr<Shape> root_shape;
+	Shape* shape;
+	std::vector<Value> fields;
+
+	Instance(
+		std::string type,
+		std::shared_ptr<std::unordered_map<Symbol, Callable*>> methods,
+		std::shared_ptr<Shape> root_shape,
+		ObjType obj_type = OBJ_INSTANCE
+	);
 
-struct ListSort : Callable {
-	std::shared_ptr<std::vector<std::shared_ptr<Obj>>> list;
+	// Finds name as a field or a method, going through the access site's
+	// cache. Returns nullptr if it is neither.
+	const CacheEntry* lookup(Symbol name, InlineCache& cache);
 
-	ListSort(std::shared_ptr<std::vector<std::shared_ptr<Obj>>> list);
+	Value get(const Token& name, InlineCache& cache);
+	
+	void set(Symbol name, Value val, InlineCache& cache);
 
-	std::shared_ptr<Obj> call(Interpreter* interpreter, std::vector<std::shared_ptr<Obj>> arguments) override;
+	void trace() override;
 
-	int num_params() override;
+	std::string to_string();
 };
 
-struct ListMap : Callable {
-	std::shared_ptr<std::vector<std::shared_ptr<Obj>>> list;
+// Method of a native kind such as List. The receiver is the instance it
+// was looked up on, so one table of these is shared by every instance.
+struct NativeMethod : public Callable {
+	typedef Value (*Impl)(Interpreter* interpreter, Instance* receiver, const std::vector<Value>& arguments);
 
-	ListMap(std::shared_ptr<std::vector<std::shared_ptr<Obj>>> list);
+	Impl impl;
+	int arity;
 
-	std::shared_ptr<Obj> call(Interpreter* interpreter, std::vector<std::shared_ptr<Obj>> arguments) override;
+	NativeMethod(Impl impl, int arity);
 
-	int num_params() override;
-};
-
-struct ListReduce : Callable {
-	std::shared_ptr<std::vector<std::shared_ptr<Obj>>> list;
-
-	ListReduce(std::shared_ptr<std::vector<std::shared_ptr<Obj>>> list);
+	// Native methods are always reached through an instance, either by
+	// invoke or wrapped in a BoundMethod, so call is never used directly.
+	Value call(Interpreter* interpreter, const std::vector<Value>& arguments) override;
 
-	std::shared_ptr<Obj> call(Interpreter* interpreter, std::vector<std::shared_ptr<Obj>> arguments) override;
+	Value call_method(Interpreter* interpreter, Value receiver, const std::vector<Value>& arguments) override;
 
 	int num_params() override;
 };
 
-struct ListFilter : Callable {
-	std::shared_ptr<std::vector<std::shared_ptr<Obj>>> list;
+struct ListInstance : public Instance {
+	std::vector<Value> items;
 
-	ListFilter(std::shared_ptr<std::vector<std::shared_ptr<Obj>>> list);
+	ListInstance();
 
-	std::shared_ptr<Obj> call(Interpreter* interpreter, std::vector<std::shared_ptr<Obj>> arguments) override;
-
-	int num_params() override;
+	void trace() override;
 };
 
-struct Map : public Callable {
-	Map();
+struct MapInstance : public Instance {
+	Table entries;
 
-	std::shared_ptr<Obj> call(Interpreter* interpreter, std::vector<std::shared_ptr<Obj>> arguments) override;
+	MapInstance();
 
-	int num_params() override;
+	void trace() override;
 };
 
-struct MapGet : Callable {
-	std::shared_ptr<std::unordered_map<size_t, std::shared_ptr<Obj>>> map;
-
-	MapGet(std::shared_ptr<std::unordered_map<size_t, std::shared_ptr<Obj>>> map);
-
-	std::shared_ptr<Obj> call(Interpreter* interpreter, std::vector<std::shared_ptr<Obj>> arguments) override;
+// Appends go into one growing buffer, so building a string piece by piece
+// is linear instead of copying the whole prefix on every '+'.
+struct StringBuilderInstance : public Instance {
+	std::string buffer;
 
-	int num_params() override;
+	StringBuilderInstance();
 };
 
-struct MapSet : Callable {
-	std::shared_ptr<std::unordered_map<size_t, std::shared_ptr<Obj>>> map;
-
-	MapSet(std::shared_ptr<std::unordered_map<size_t, std::shared_ptr<Obj>>> map);
-
-	std::shared_ptr<Obj> call(Interpreter* interpreter, std::vector<std::shared_ptr<Obj>> arguments) override;
+struct List : public Callable {
+	Value call(Interpreter* interpreter, const std::vector<Value>& arguments) override;
 
 	int num_params() override;
 };
 
-struct MapRemove : Callable {
-	std::shared_ptr<std::unordered_map<size_t, std::shared_ptr<Obj>>> map;
-
-	MapRemove(std::shared_ptr<std::unordered_map<size_t, std::shared_ptr<Obj>>> map);
-
-	std::shared_ptr<Obj> call(Interpreter* interpreter, std::vector<std::shared_ptr<Obj>> arguments) override;
+struct Map : public Callable {
+	Value call(Interpreter* interpreter, const std::vector<Value>& arguments) override;
 
 	int num_params() override;
 };
 
-struct MapContains : Callable {
-	std::shared_ptr<std::unordered_map<size_t, std::shared_ptr<Obj>>> map;
-
-	MapContains(std::shared_ptr<std::unordered_map<size_t, std::shared_ptr<Obj>>> map);
-
-	std::shared_ptr<Obj> call(Interpreter* interpreter, std::vector<std::shared_ptr<Obj>> arguments) override;
+struct StringBuilder : public Callable {
+	Value call(Interpreter* interpreter, const std::vector<Value>& arguments) override;
 
 	int num_params() override;
 };
@@ -0,0 +1,26 @@
+#include "Chunk.hpp"
+#include "Heap.hpp"
+
+void Chunk::write(uint8_t byte, int line) {
+	code.push_back(byte);
+	lines.push_back(line);
+}
+
+int Chunk::add_constant(Value val) {
+	constants.push_back(val);
+	return constants.size() - 1;
+}
+
+int Chunk::add_name(Symbol name) {
+	for (size_t i = 0; i < names.size(); i++) {
+		if (names[i] == name) return i;
+	}
+	names.push_back(name);
+	return names.size() - 1;
+}
+
+Proto::Proto(std::string name) : Obj(OBJ_PROTO), name(name), arity(0), upvalue_count(0) {}
+
+void Proto::trace() {
+	for (auto& c : chunk.constants) heap.mark(c);
+}
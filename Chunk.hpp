@@ -0,0 +1,54 @@
+#ifndef CHUNK
+#define CHUNK
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include "Value.hpp"
+#include "Shape.hpp"
+#include "Symbol.hpp"
+
+enum OpCode : uint8_t {
+	OP_CONSTANT, OP_NIL, OP_TRUE, OP_FALSE, OP_POP,
+	OP_GET_LOCAL, OP_SET_LOCAL, OP_GET_UPVALUE, OP_SET_UPVALUE,
+	OP_GET_GLOBAL, OP_DEFINE_GLOBAL, OP_SET_GLOBAL,
+	OP_GET_PROPERTY, OP_SET_PROPERTY,
+	OP_EQUAL, OP_NOT_EQUAL, OP_GREATER, OP_GREATER_EQUAL, OP_LESS, OP_LESS_EQUAL,
+	OP_ADD, OP_SUBTRACT, OP_MULTIPLY, OP_DIVIDE, OP_MOD, OP_POW, OP_INT_DIVIDE,
+	OP_NOT, OP_NEGATE, OP_PRINT,
+	OP_JUMP, OP_JUMP_IF_FALSE, OP_LOOP,
+	OP_CALL, OP_INVOKE, OP_CLOSURE, OP_CLOSE_UPVALUE, OP_RETURN,
+	OP_CLASS, OP_METHOD, OP_IMPORT,
+};
+
+// Bytecode for a single function body. Every byte in code has a matching
+// entry in lines so runtime errors can report where they happened.
+struct Chunk {
+	std::vector<uint8_t> code;
+	std::vector<int> lines;
+	std::vector<Value> constants;
+	// Global, property and method names, referenced by index from operands.
+	std::vector<Symbol> names;
+
+	void write(uint8_t byte, int line);
+
+	int add_constant(Value val);
+
+	int add_name(Symbol name);
+};
+
+// A compiled fn, method, lambda or top level script.
+struct Proto : public Obj {
+	std::string name;
+	int arity;
+	int upvalue_count;
+	Chunk chunk;
+	// One per property access instruction, indexed by its cache operand.
+	std::vector<InlineCache> caches;
+
+	Proto(std::string name);
+
+	void trace() override;
+};
+
+#endif
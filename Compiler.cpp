@@ -0,0 +1,454 @@
+#include "Compiler.hpp"
+
+Compiler::Compiler() : curr(nullptr), line(1) {}
+
+// Protos are pinned, like the literals in the AST, since a chunk can be
+// rerun for as long as the program is loaded.
+Proto* Compiler::compile(Span<Stmt*> stmts) {
+	FnState script { nullptr, heap.pin(heap.alloc<Proto>("script")), FnType_NONE, {}, {}, 0 };
+	script.locals.push_back(Local { SYM_NONE, 0, false });
+	curr = &script;
+	compile_block(stmts);
+	emit_return();
+	curr = nullptr;
+	return script.proto;
+}
+
+Value Compiler::visit_literal_expr(Literal* expr) {
+	if (expr->val.is_nil()) {
+		emit(OP_NIL);
+	} else if (expr->val.is_bool()) {
+		emit(expr->val.as_bool() ? OP_TRUE : OP_FALSE);
+	} else {
+		emit_constant(expr->val);
+	}
+	return Value();
+}
+
+Value Compiler::visit_grouping_expr(Grouping* expr) {
+	compile(expr->expression);
+	return Value();
+}
+
+Value Compiler::visit_unary_expr(Unary* expr) {
+	compile(expr->right);
+	line = expr->op.line;
+	switch (expr->op.type) {
+		case BANG: emit(OP_NOT); break;
+		case MINUS: emit(OP_NEGATE); break;
+		default: break;
+	}
+	return Value();
+}
+
+Value Compiler::visit_binary_expr(Binary* expr) {
+	compile(expr->left);
+	compile(expr->right);
+	line = expr->op.line;
+	switch (expr->op.type) {
+		case BANG_EQUAL: emit(OP_NOT_EQUAL); break;
+		case EQUAL_EQUAL: emit(OP_EQUAL); break;
+		case GREATER: emit(OP_GREATER); break;
+		case GREATER_EQUAL: emit(OP_GREATER_EQUAL); break;
+		case LESS: emit(OP_LESS); break;
+		case LESS_EQUAL: emit(OP_LESS_EQUAL); break;
+		case PLUS: emit(OP_ADD); break;
+		case MINUS: emit(OP_SUBTRACT); break;
+		case SLASH: emit(OP_DIVIDE); break;
+		case STAR: emit(OP_MULTIPLY); break;
+		case MOD: emit(OP_MOD); break;
+		case STAR_STAR: emit(OP_POW); break;
+		case SLASH_SLASH: emit(OP_INT_DIVIDE); break;
+		default: break;
+	}
+	return Value();
+}
+
+Value Compiler::visit_variable_expr(Variable* expr) {
+	line = expr->name.line;
+	get_variable(expr->name.symbol);
+	return Value();
+}
+
+Value Compiler::visit_assign_expr(Assign* expr) {
+	compile(expr->val);
+	line = expr->name.line;
+	set_variable(expr->name.symbol);
+	return Value();
+}
+
+Value Compiler::visit_logical_expr(Logical* expr) {
+	compile(expr->left);
+	if (expr->op.type == OR) {
+		int else_jump = emit_jump(OP_JUMP_IF_FALSE);
+		int end_jump = emit_jump(OP_JUMP);
+		patch_jump(else_jump);
+		emit(OP_POP);
+		compile(expr->right);
+		patch_jump(end_jump);
+	} else {
+		int end_jump = emit_jump(OP_JUMP_IF_FALSE);
+		emit(OP_POP);
+		compile(expr->right);
+		patch_jump(end_jump);
+	}
+	return Value();
+}
+
+Value Compiler::visit_call_expr(Call* expr) {
+	if (expr->arguments.size() > 255) throw SyntaxError(expr->paren.line, "Can't have more than 255 arguments");
+	if (auto get = dynamic_cast<Get*>(expr->callee)) {
+		compile(get->obj);
+		for (auto a : expr->arguments) compile(a);
+		line = expr->paren.line;
+		uint16_t name = name_operand(get->name.symbol);
+		emit(OP_INVOKE);
+		emit_short(name);
+		emit(expr->arguments.size());
+		emit_short(add_cache());
+		return Value();
+	}
+	compile(expr->callee);
+	for (auto a : expr->arguments) compile(a);
+	line = expr->paren.line;
+	emit(OP_CALL, expr->arguments.size());
+	return Value();
+}
+
+Value Compiler::visit_lambda_expr(LambdaExpr* expr) {
+	compile_fn("lambda", expr->params, expr->body, FnType_FN);
+	return Value();
+}
+
+Value Compiler::visit_get_expr(Get* expr) {
+	compile(expr->obj);
+	line = expr->name.line;
+	emit(OP_GET_PROPERTY);
+	emit_short(name_operand(expr->name.symbol));
+	emit_short(add_cache());
+	return Value();
+}
+
+Value Compiler::visit_set_expr(Set* expr) {
+	compile(expr->obj);
+	compile(expr->val);
+	line = expr->name.line;
+	emit(OP_SET_PROPERTY);
+	emit_short(name_operand(expr->name.symbol));
+	emit_short(add_cache());
+	return Value();
+}
+
+Value Compiler::visit_this_expr(This* expr) {
+	line = expr->keyword.line;
+	get_variable(SYM_THIS);
+	return Value();
+}
+
+void Compiler::visit_expression_stmt(Expression* stmt) {
+	compile(stmt->expression);
+	emit(OP_POP);
+}
+
+void Compiler::visit_print_stmt(Print* stmt) {
+	compile(stmt->expression);
+	emit(OP_PRINT);
+}
+
+void Compiler::visit_var_stmt(Var* stmt) {
+	if (stmt->initializer != nullptr) compile(stmt->initializer);
+	else emit(OP_NIL);
+	line = stmt->name.line;
+	define_variable(stmt->name.symbol);
+}
+
+void Compiler::visit_block_stmt(Block* stmt) {
+	begin_scope();
+	compile_block(stmt->stmts);
+	end_scope();
+}
+
+void Compiler::visit_if_stmt(If* stmt) {
+	compile(stmt->condition);
+	int then_jump = emit_jump(OP_JUMP_IF_FALSE);
+	emit(OP_POP);
+	compile(stmt->then_branch);
+	int else_jump = emit_jump(OP_JUMP);
+	patch_jump(then_jump);
+	emit(OP_POP);
+	if (stmt->else_branch != nullptr) compile(stmt->else_branch);
+	patch_jump(else_jump);
+}
+
+void Compiler::visit_while_stmt(While* stmt) {
+	int loop_start = chunk().code.size();
+	int exit_jump = -1;
+	if (stmt->condition != nullptr) {
+		compile(stmt->condition);
+		exit_jump = emit_jump(OP_JUMP_IF_FALSE);
+		emit(OP_POP);
+	}
+	curr->loops.push_back(Loop { curr->scope_depth, {}, {} });
+	compile(stmt->body);
+	Loop loop = curr->loops.back();
+	curr->loops.pop_back();
+	for (int jump : loop.continues) patch_jump(jump);
+	if (stmt->increment != nullptr) {
+		compile(stmt->increment);
+		emit(OP_POP);
+	}
+	emit_loop(loop_start);
+	if (exit_jump != -1) {
+		patch_jump(exit_jump);
+		emit(OP_POP);
+	}
+	for (int jump : loop.breaks) patch_jump(jump);
+}
+
+void Compiler::visit_fn_stmt(FnStmt* stmt) {
+	line = stmt->name.line;
+	// Locals are visible inside their own body so a nested fn can recurse.
+	if (curr->scope_depth > 0) {
+		add_local(stmt->name.symbol);
+		compile_fn(stmt->name.lexeme, stmt->params, stmt->body, FnType_FN);
+		return;
+	}
+	compile_fn(stmt->name.lexeme, stmt->params, stmt->body, FnType_FN);
+	define_variable(stmt->name.symbol);
+}
+
+void Compiler::visit_return_stmt(Return* stmt) {
+	line = stmt->keyword.line;
+	if (stmt->val == nullptr) {
+		emit_return();
+		return;
+	}
+	compile(stmt->val);
+	emit(OP_RETURN);
+}
+
+void Compiler::visit_break_stmt(Break* stmt) {
+	line = stmt->keyword.line;
+	discard_locals(curr->loops.back().scope_depth);
+	curr->loops.back().breaks.push_back(emit_jump(OP_JUMP));
+}
+
+void Compiler::visit_continue_stmt(Continue* stmt) {
+	line = stmt->keyword.line;
+	discard_locals(curr->loops.back().scope_depth);
+	curr->loops.back().continues.push_back(emit_jump(OP_JUMP));
+}
+
+void Compiler::visit_class_stmt(ClassStmt* stmt) {
+	line = stmt->name.line;
+	uint16_t name = name_operand(stmt->name.symbol);
+	emit(OP_CLASS);
+	emit_short(name);
+	define_variable(stmt->name.symbol);
+	get_variable(stmt->name.symbol);
+	for (auto m : stmt->methods) {
+		line = m->name.line;
+		FnType type = m->name.symbol == SYM_INIT ? FnType_INIT : FnType_METHOD;
+		compile_fn(m->name.lexeme, m->params, m->body, type);
+		emit(OP_METHOD);
+		emit_short(name_operand(m->name.symbol));
+	}
+	emit(OP_POP);
+}
+
+void Compiler::visit_import_stmt(Import* stmt) {
+	line = stmt->keyword.line;
+	emit(OP_IMPORT);
+	emit_short(make_constant(stmt->path.literal));
+}
+
+void Compiler::compile(Stmt* stmt) {
+	stmt->accept(this);
+}
+
+void Compiler::compile_block(Span<Stmt*> stmts) {
+	for (auto s : stmts) compile(s);
+}
+
+void Compiler::compile(Expr* expr) {
+	expr->accept(this);
+}
+
+void Compiler::compile_fn(
+	std::string_view name,
+	Span<Token> params,
+	Span<Stmt*> body,
+	FnType type
+) {
+	if (params.size() > 255) throw SyntaxError(line, "Can't have more than 255 parameters");
+	FnState state { curr, heap.pin(heap.alloc<Proto>(std::string(name))), type, {}, {}, 0 };
+	state.proto->arity = params.size();
+	// Slot 0 holds the receiver for methods and the callee otherwise.
+	state.locals.push_back(Local { type == FnType_METHOD || type == FnType_INIT ? SYM_THIS : SYM_NONE, 0, false });
+	curr = &state;
+	begin_scope();
+	for (auto p : params) add_local(p.symbol);
+	compile_block(body);
+	emit_return();
+	curr = state.enclosing;
+
+	state.proto->upvalue_count = state.upvalues.size();
+	emit(OP_CLOSURE);
+	emit_short(make_constant(state.proto));
+	for (auto& u : state.upvalues) emit(u.is_local ? 1 : 0, u.index);
+}
+
+Chunk& Compiler::chunk() {
+	return curr->proto->chunk;
+}
+
+void Compiler::emit(uint8_t byte) {
+	chunk().write(byte, line);
+}
+
+void Compiler::emit(uint8_t a, uint8_t b) {
+	emit(a);
+	emit(b);
+}
+
+void Compiler::emit_short(uint16_t val) {
+	emit((val >> 8) & 0xff, val & 0xff);
+}
+
+void Compiler::emit_return() {
+	if (curr->type == FnType_INIT) emit(OP_GET_LOCAL, 0);
+	else emit(OP_NIL);
+	emit(OP_RETURN);
+}
+
+void Compiler::emit_constant(Value val) {
+	emit(OP_CONSTANT);
+	emit_short(make_constant(val));
+}
+
+uint16_t Compiler::make_constant(Value val) {
+	int idx = chunk().add_constant(val);
+	if (idx > UINT16_MAX) throw SyntaxError(line, "Too many constants in one function");
+	return idx;
+}
+
+uint16_t Compiler::name_operand(Symbol name) {
+	int idx = chunk().add_name(name);
+	if (idx > UINT16_MAX) throw SyntaxError(line, "Too many names in one function");
+	return idx;
+}
+
+uint16_t Compiler::add_cache() {
+	auto& caches = curr->proto->caches;
+	if (caches.size() > UINT16_MAX) throw SyntaxError(line, "Too many property accesses in one function");
+	caches.push_back(InlineCache());
+	return caches.size() - 1;
+}
+
+int Compiler::emit_jump(uint8_t op) {
+	emit(op);
+	emit(0xff, 0xff);
+	return chunk().code.size() - 2;
+}
+
+void Compiler::patch_jump(int offset) {
+	int jump = chunk().code.size() - offset - 2;
+	if (jump > UINT16_MAX) throw SyntaxError(line, "Too much code to jump over");
+	chunk().code[offset] = (jump >> 8) & 0xff;
+	chunk().code[offset + 1] = jump & 0xff;
+}
+
+void Compiler::emit_loop(int loop_start) {
+	emit(OP_LOOP);
+	int offset = chunk().code.size() - loop_start + 2;
+	if (offset > UINT16_MAX) throw SyntaxError(line, "Loop body too large");
+	emit_short(offset);
+}
+
+void Compiler::begin_scope() {
+	curr->scope_depth++;
+}
+
+void Compiler::end_scope() {
+	curr->scope_depth--;
+	auto& locals = curr->locals;
+	while (!locals.empty() && locals.back().depth > curr->scope_depth) {
+		emit(locals.back().captured ? OP_CLOSE_UPVALUE : OP_POP);
+		locals.pop_back();
+	}
+}
+
+// Pops the locals declared inside a loop body before jumping out of it. The
+// compiler keeps tracking them since code after the jump is still in scope.
+void Compiler::discard_locals(int depth) {
+	auto& locals = curr->locals;
+	for (int i = locals.size() - 1; i >= 0 && locals[i].depth > depth; i--) {
+		emit(locals[i].captured ? OP_CLOSE_UPVALUE : OP_POP);
+	}
+}
+
+void Compiler::add_local(Symbol name) {
+	if (curr->locals.size() > UINT8_MAX) throw SyntaxError(line, "Too many local variables in function");
+	curr->locals.push_back(Local { name, curr->scope_depth, false });
+}
+
+int Compiler::resolve_local(FnState* state, Symbol name) {
+	for (int i = state->locals.size() - 1; i >= 0; i--) {
+		if (state->locals[i].name == name) return i;
+	}
+	return -1;
+}
+
+int Compiler::resolve_upvalue(FnState* state, Symbol name) {
+	if (state->enclosing == nullptr) return -1;
+	int local = resolve_local(state->enclosing, name);
+	if (local != -1) {
+		state->enclosing->locals[local].captured = true;
+		return add_upvalue(state, local, true);
+	}
+	int upvalue = resolve_upvalue(state->enclosing, name);
+	if (upvalue != -1) return add_upvalue(state, upvalue, false);
+	return -1;
+}
+
+int Compiler::add_upvalue(FnState* state, uint8_t index, bool is_local) {
+	for (size_t i = 0; i < state->upvalues.size(); i++) {
+		if (state->upvalues[i].index == index && state->upvalues[i].is_local == is_local) return i;
+	}
+	if (state->upvalues.size() > UINT8_MAX) throw SyntaxError(line, "Too many closure variables in function");
+	state->upvalues.push_back(UpvalueRef { index, is_local });
+	return state->upvalues.size() - 1;
+}
+
+void Compiler::get_variable(Symbol name) {
+	int arg = resolve_local(curr, name);
+	if (arg != -1) {
+		emit(OP_GET_LOCAL, arg);
+	} else if ((arg = resolve_upvalue(curr, name)) != -1) {
+		emit(OP_GET_UPVALUE, arg);
+	} else {
+		emit(OP_GET_GLOBAL);
+		emit_short(name_operand(name));
+	}
+}
+
+void Compiler::set_variable(Symbol name) {
+	int arg = resolve_local(curr, name);
+	if (arg != -1) {
+		emit(OP_SET_LOCAL, arg);
+	} else if ((arg = resolve_upvalue(curr, name)) != -1) {
+		emit(OP_SET_UPVALUE, arg);
+	} else {
+		emit(OP_SET_GLOBAL);
+		emit_short(name_operand(name));
+	}
+}
+
+void Compiler::define_variable(Symbol name) {
+	if (curr->scope_depth > 0) {
+		add_local(name);
+		return;
+	}
+	emit(OP_DEFINE_GLOBAL);
+	emit_short(name_operand(name));
+}
@@ -0,0 +1,161 @@
+#ifndef COMPILER
+#define COMPILER
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include "Expr.hpp"
+#include "Stmt.hpp"
+#include "Chunk.hpp"
+#include "Error.hpp"
+#include "Resolver.hpp"
+#include "Heap.hpp"
+
+// Lowers a resolved program into bytecode for the VM. Locals live in stack
+// slots, variables captured by inner functions become upvalues, and everything
+// else is a global looked up by name.
+class Compiler : Expr::Visitor, Stmt::Visitor {
+public:
+	Compiler();
+
+	Proto* compile(Span<Stmt*> stmts);
+
+	Value visit_literal_expr(Literal* expr) override;
+
+	Value visit_grouping_expr(Grouping* expr) override;
+
+	Value visit_unary_expr(Unary* expr) override;
+
+	Value visit_binary_expr(Binary* expr) override;
+
+	Value visit_variable_expr(Variable* expr) override;
+
+	Value visit_assign_expr(Assign* expr) override;
+
+	Value visit_logical_expr(Logical* expr) override;
+
+	Value visit_call_expr(Call* expr) override;
+
+	Value visit_lambda_expr(LambdaExpr* expr) override;
+
+	Value visit_get_expr(Get* expr) override;
+
+	Value visit_set_expr(Set* expr) override;
+
+	Value visit_this_expr(This* expr) override;
+
+	void visit_expression_stmt(Expression* stmt) override;
+
+	void visit_print_stmt(Print* stmt) override;
+
+	void visit_var_stmt(Var* stmt) override;
+
+	void visit_block_stmt(Block* stmt) override;
+
+	void visit_if_stmt(If* stmt) override;
+
+	void visit_while_stmt(While* stmt) override;
+
+	void visit_fn_stmt(FnStmt* stmt) override;
+
+	void visit_return_stmt(Return* stmt) override;
+
+	void visit_break_stmt(Break* stmt) override;
+
+	void visit_continue_stmt(Continue* stmt) override;
+
+	void visit_class_stmt(ClassStmt* stmt) override;
+
+	void visit_import_stmt(Import* stmt) override;
+
+private:
+	struct Local {
+		Symbol name;
+		int depth;
+		bool captured;
+	};
+
+	struct UpvalueRef {
+		uint8_t index;
+		bool is_local;
+	};
+
+	// Forward jumps out of a loop body, patched once the loop is compiled.
+	struct Loop {
+		int scope_depth;
+		std::vector<int> breaks;
+		std::vector<int> continues;
+	};
+
+	struct FnState {
+		FnState* enclosing;
+		Proto* proto;
+		FnType type;
+		std::vector<Local> locals;
+		std::vector<UpvalueRef> upvalues;
+		int scope_depth;
+		std::vector<Loop> loops;
+	};
+
+	FnState* curr;
+	int line;
+
+	void compile(Stmt* stmt);
+
+	void compile_block(Span<Stmt*> stmts);
+
+	void compile(Expr* expr);
+
+	void compile_fn(
+		std::string_view name,
+		Span<Token> params,
+		Span<Stmt*> body,
+		FnType type
+	);
+
+	Chunk& chunk();
+
+	void emit(uint8_t byte);
+
+	void emit(uint8_t a, uint8_t b);
+
+	void emit_short(uint16_t val);
+
+	void emit_return();
+
+	void emit_constant(Value val);
+
+	uint16_t make_constant(Value val);
+
+	uint16_t name_operand(Symbol name);
+
+	uint16_t add_cache();
+
+	int emit_jump(uint8_t op);
+
+	void patch_jump(int offset);
+
+	void emit_loop(int loop_start);
+
+	void begin_scope();
+
+	void end_scope();
+
+	void discard_locals(int depth);
+
+	void add_local(Symbol name);
+
+	int resolve_local(FnState* state, Symbol name);
+
+	int resolve_upvalue(FnState* state, Symbol name);
+
+	int add_upvalue(FnState* state, uint8_t index, bool is_local);
+
+	void get_variable(Symbol name);
+
+	void set_variable(Symbol name);
+
+	void define_variable(Symbol name);
+};
+
+#endif
@@ -1,44 +1,36 @@
 #include "Environment.hpp"
+#include "Heap.hpp"
 
-Environment::Environment() : enclosing(nullptr) {}
+Environment::Environment() : Obj(OBJ_ENVIRONMENT) {}
 
-Environment::Environment(std::shared_ptr<Environment> enclosing) : enclosing(enclosing) {}
-
-void Environment::define(std::string name, std::shared_ptr<Obj> val) {
+void Environment::define(Symbol name, Value val) {
 	values[name] = val;
 }
 
-void Environment::assign(std::shared_ptr<Token> name, std::shared_ptr<Obj> val) {
-	if (values.count(name->lexeme)) {
-		values[name->lexeme] = val;
-		return;
-	}
-	if (enclosing != nullptr) {
-		enclosing->assign(name, val);
+void Environment::assign(const Token& name, Value val) {
+	auto it = values.find(name.symbol);
+	if (it != values.end()) {
+		it->second = val;
 		return;
 	}
-	throw RuntimeError(name, "Undefined variable '" + name->lexeme + "'");
+	throw RuntimeError(name, "Undefined variable '" + std::string(name.lexeme) + "'");
 }
 
-void Environment::assign_at(int dist, std::shared_ptr<Token> name, std::shared_ptr<Obj> val) {
-	if (dist == 0) {
-		values[name->lexeme] = val;
-		return;
-	}
-	std::shared_ptr<Environment> env = enclosing;
-	for (int i = 1; i < dist; i++) env = env->enclosing;
-	env->values[name->lexeme] = val;
+Value Environment::get(const Token& name) {
+	auto it = values.find(name.symbol);
+	if (it != values.end()) return it->second;
+	throw RuntimeError(name, "Undefined variable '" + std::string(name.lexeme) + "'");
+}
+
+Value* Environment::lookup(Symbol name) {
+	auto it = values.find(name);
+	return it != values.end() ? &it->second : nullptr;
 }
 
-std::shared_ptr<Obj> Environment::get(std::shared_ptr<Token> name) {
-	if (values.count(name->lexeme)) return values[name->lexeme];
-	if (enclosing != nullptr) return enclosing->get(name);
-	throw RuntimeError(name, "Undefined variable '" + name->lexeme + "'");
+void Environment::trace() {
+	for (auto& v : values) heap.mark(v.second);
 }
 
-std::shared_ptr<Obj> Environment::get_at(int dist, std::string name) {
-	if (dist == 0) return values[name];
-	std::shared_ptr<Environment> env = enclosing;
-	for (int i = 1; i < dist; i++) env = env->enclosing;
-	return env->values[name];
+void Box::trace() {
+	heap.mark(val);
 }
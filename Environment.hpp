@@ -2,31 +2,45 @@
 #define ENVIRONMENT
 
 #include <unordered_map>
+#include <vector>
 #include <iostream>
 #include <string>
 #include "Token.hpp"
-#include "Obj.hpp"
+#include "Value.hpp"
 #include "Error.hpp"
+#include "Obj.hpp"
 
-class Environment {
+// Globals, keyed by symbol. Locals live in the Interpreter's value stack.
+class Environment : public Obj {
 public:
 	Environment();
-	
-	Environment(std::shared_ptr<Environment> enclosing);
 
-	void define(std::string name, std::shared_ptr<Obj> val);
+	void define(Symbol name, Value val);
 
-	void assign(std::shared_ptr<Token> name, std::shared_ptr<Obj> val);
+	void assign(const Token& name, Value val);
 
-	void assign_at(int dist, std::shared_ptr<Token> name, std::shared_ptr<Obj> val);
+	Value get(const Token& name);
 
-	std::shared_ptr<Obj> get(std::shared_ptr<Token> name);
+	// nullptr if name is not defined.
+	Value* lookup(Symbol name);
 
-	std::shared_ptr<Obj> get_at(int dist, std::string name);
+	void trace() override;
 
 private:
-	std::shared_ptr<Environment> enclosing;
-	std::unordered_map<std::string, std::shared_ptr<Obj>> values;
+	std::unordered_map<Symbol, Value> values;
 };
 
-#endif
\ No newline at end of file
+// A local that some closure captures. Its stack slot holds the Box, so the
+// frame and every closure made in it share the variable, and it outlives
+// the frame.
+struct Box : public Obj {
+	Value val;
+
+	Box(Value val) : Obj(OBJ_BOX), val(val) {}
+
+	void trace() override;
+};
+
+typedef std::vector<Box*> Upvalues;
+
+#endif
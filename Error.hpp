@@ -15,10 +15,19 @@ public:
 
 class RuntimeError : public std::runtime_error {
 public:
-	std::shared_ptr<Token> token;
+	Token token;
+	// Set once the message names the module the token is in.
+	bool in_module;
 
-    RuntimeError(std::shared_ptr<Token> token, const std::string& message)
-        : std::runtime_error(message), token(token) {}
+    RuntimeError(Token token, const std::string& message)
+        : std::runtime_error(message), token(token), in_module(false) {}
+};
+
+// Thrown by native methods, which have no token of their own. The call
+// that ran the native rethrows it as a RuntimeError there.
+class NativeError : public std::runtime_error {
+public:
+    NativeError(const std::string& message) : std::runtime_error(message) {}
 };
 
 #endif
\ No newline at end of file
@@ -1,10 +1,42 @@
 #ifndef EXPR
 #define EXPR
 
-#include <vector>
-#include <memory>
+#include "Arena.hpp"
 #include "Token.hpp"
-#include "Obj.hpp"
+#include "Value.hpp"
+#include "Shape.hpp"
+
+// How the Resolver found a variable. Locals are slots in the running
+// frame, boxed locals are locals some closure captures, and upvalues are
+// the running closure's captures.
+enum Access { Access_GLOBAL, Access_LOCAL, Access_BOXED, Access_UPVALUE };
+
+// What a Binary, Get or Call has seen as the tree walker runs it. A node
+// starts out Spec_NEW and on its first run settles on the specialization
+// for what it saw, or on Spec_GENERIC. A specialization whose guard fails
+// falls back to Spec_GENERIC for good. Spec_NUMBER is for a Binary whose
+// operands have only been numbers, Spec_INSTANCE for a Get whose receiver
+// has only been a plain class instance, and Spec_FN and Spec_NATIVE for a
+// Call whose callee has only been a Fn or a native callable.
+enum Spec { Spec_NEW, Spec_NUMBER, Spec_INSTANCE, Spec_FN, Spec_NATIVE, Spec_GENERIC };
+
+// A variable a fn or lambda uses from an enclosing function. Local captures
+// take the Box in slot index of the frame creating the closure, others are
+// copied from that frame's own captures.
+struct Capture {
+	bool is_local;
+	int index;
+};
+
+// A body the Parser only matched braces over, with --lazy. It is parsed
+// from tokens[start], just past its '{', when it is first called.
+struct LazyBody {
+	const std::vector<Token>* tokens;
+	Arena* arena;
+	int start;
+	bool is_method;
+};
+
 #include "Stmt.hpp"
 
 class Stmt;
@@ -20,173 +52,197 @@ class LambdaExpr;
 class Get;
 class Set;
 class This;
+struct Lambda;
 
 class Expr {
 public: 
 	class Visitor {
 	public:
-		virtual std::shared_ptr<Obj> visit_binary_expr(Binary* expr) = 0;
-        virtual std::shared_ptr<Obj> visit_grouping_expr(Grouping* expr) = 0;
-        virtual std::shared_ptr<Obj> visit_literal_expr(Literal* expr) = 0;
-        virtual std::shared_ptr<Obj> visit_logical_expr(Logical* expr) = 0;
-        virtual std::shared_ptr<Obj> visit_unary_expr(Unary* expr) = 0;
-        virtual std::shared_ptr<Obj> visit_variable_expr(Variable* expr) = 0;
-        virtual std::shared_ptr<Obj> visit_assign_expr(Assign* expr) = 0;
-        virtual std::shared_ptr<Obj> visit_call_expr(Call* expr) = 0;
-        virtual std::shared_ptr<Obj> visit_lambda_expr(LambdaExpr* expr) = 0;
-        virtual std::shared_ptr<Obj> visit_get_expr(Get* expr) = 0;
-        virtual std::shared_ptr<Obj> visit_set_expr(Set* expr) = 0;
-        virtual std::shared_ptr<Obj> visit_this_expr(This* expr) = 0;
+		virtual Value visit_binary_expr(Binary* expr) = 0;
+        virtual Value visit_grouping_expr(Grouping* expr) = 0;
+        virtual Value visit_literal_expr(Literal* expr) = 0;
+        virtual Value visit_logical_expr(Logical* expr) = 0;
+        virtual Value visit_unary_expr(Unary* expr) = 0;
+        virtual Value visit_variable_expr(Variable* expr) = 0;
+        virtual Value visit_assign_expr(Assign* expr) = 0;
+        virtual Value visit_call_expr(Call* expr) = 0;
+        virtual Value visit_lambda_expr(LambdaExpr* expr) = 0;
+        virtual Value visit_get_expr(Get* expr) = 0;
+        virtual Value visit_set_expr(Set* expr) = 0;
+        virtual Value visit_this_expr(This* expr) = 0;
 	};
 
-	virtual std::shared_ptr<Obj> accept(Visitor* visitor) = 0;
-
-    virtual ~Expr() {}
+	virtual Value accept(Visitor* visitor) = 0;
 };
 
 class Binary : public Expr {
 public:
-    std::shared_ptr<Expr> left;
-    std::shared_ptr<Token> op;
-    std::shared_ptr<Expr> right;
+    Expr* left;
+    Token op;
+    Expr* right;
+    Spec spec;
     
-    Binary(std::shared_ptr<Expr> left, std::shared_ptr<Token> op, std::shared_ptr<Expr> right) : left(left), op(op), right(right) {}
+    Binary(Expr* left, Token op, Expr* right) : left(left), op(op), right(right), spec(Spec_NEW) {}
 
-    std::shared_ptr<Obj> accept(Visitor* visitor) override {
+    Value accept(Visitor* visitor) override {
         return visitor->visit_binary_expr(this);
     }
 };
 
 class Grouping : public Expr {
 public:
-    std::shared_ptr<Expr> expression;
+    Expr* expression;
     
-    Grouping(std::shared_ptr<Expr> expression) : expression(expression) {}
+    Grouping(Expr* expression) : expression(expression) {}
 
-    std::shared_ptr<Obj> accept(Visitor* visitor) override {
+    Value accept(Visitor* visitor) override {
         return visitor->visit_grouping_expr(this);
     }
 };
 
 class Literal : public Expr {
 public:
-    std::shared_ptr<Obj> val;
+    Value val;
     
-    Literal(std::shared_ptr<Obj> val) : val(val) {}
+    Literal(Value val) : val(val) {}
 
-    std::shared_ptr<Obj> accept(Visitor* visitor) override {
+    Value accept(Visitor* visitor) override {
         return visitor->visit_literal_expr(this);
     }
 };
 
 class Logical : public Expr {
 public:
-   std::shared_ptr<Expr> left;
-   std::shared_ptr<Token> op;
-   std::shared_ptr<Expr> right;
+   Expr* left;
+   Token op;
+   Expr* right;
     
-    Logical(std::shared_ptr<Expr> left, std::shared_ptr<Token> op, std::shared_ptr<Expr> right) : left(left), op(op), right(right) {}
+    Logical(Expr* left, Token op, Expr* right) : left(left), op(op), right(right) {}
 
-    std::shared_ptr<Obj> accept(Visitor* visitor) override {
+    Value accept(Visitor* visitor) override {
         return visitor->visit_logical_expr(this);
     }
 };
 
 class Unary : public Expr {
 public:
-    std::shared_ptr<Token> op;
-    std::shared_ptr<Expr> right;
+    Token op;
+    Expr* right;
     
-    Unary(std::shared_ptr<Token> op, std::shared_ptr<Expr> right) : op(op), right(right) {}
+    Unary(Token op, Expr* right) : op(op), right(right) {}
 
-    std::shared_ptr<Obj> accept(Visitor* visitor) override {
+    Value accept(Visitor* visitor) override {
         return visitor->visit_unary_expr(this);
     }
 };
 
 class Variable : public Expr {
 public:
-    std::shared_ptr<Token> name;
+    Token name;
+    // Set by the Resolver. slot is the frame slot or capture index, unused
+    // for globals.
+    Access access;
+    int slot;
     
-    Variable(std::shared_ptr<Token> name) : name(name) {}
+    Variable(Token name) : name(name), access(Access_GLOBAL), slot(-1) {}
 
-    std::shared_ptr<Obj> accept(Visitor* visitor) override {
+    Value accept(Visitor* visitor) override {
         return visitor->visit_variable_expr(this);
     }
 };
 
 class Assign : public Expr {
 public:
-    std::shared_ptr<Token> name;
-    std::shared_ptr<Expr> val;
+    Token name;
+    Expr* val;
+    Access access;
+    int slot;
     
-    Assign(std::shared_ptr<Token> name, std::shared_ptr<Expr> val) : name(name), val(val) {}
+    Assign(Token name, Expr* val) : name(name), val(val), access(Access_GLOBAL), slot(-1) {}
 
-    std::shared_ptr<Obj> accept(Visitor* visitor) override {
+    Value accept(Visitor* visitor) override {
         return visitor->visit_assign_expr(this);
     }
 };
 
 class Call : public Expr {
 public:
-    std::shared_ptr<Expr> callee;
-    std::shared_ptr<Token> paren;
-    std::vector<std::shared_ptr<Expr>> arguments;
+    Expr* callee;
+    Token paren;
+    Span<Expr*> arguments;
+    // Set by the resolver when callee is a Get, so obj.name(...) can be invoked
+    // without binding the method first.
+    Get* method;
+    Spec spec;
     
-    Call(std::shared_ptr<Expr> callee, std::shared_ptr<Token> paren, std::vector<std::shared_ptr<Expr>> arguments) 
-        : callee(callee), paren(paren), arguments(arguments) {}
+    Call(Expr* callee, Token paren, Span<Expr*> arguments) 
+        : callee(callee), paren(paren), arguments(arguments), method(nullptr), spec(Spec_NEW) {}
 
-    std::shared_ptr<Obj> accept(Visitor* visitor) override {
+    Value accept(Visitor* visitor) override {
         return visitor->visit_call_expr(this);
     }
 };
 
 class LambdaExpr : public Expr {
 public:
-	std::vector<std::shared_ptr<Token>> params;
-	std::vector<std::shared_ptr<Stmt>> body;
-
-	LambdaExpr(std::vector<std::shared_ptr<Token>> params, std::vector<std::shared_ptr<Stmt>> body)
-	    : params(params), body(body) {}
-
-	std::shared_ptr<Obj> accept(Visitor* visitor) override {
+	Span<Token> params;
+	Span<Stmt*> body;
+	int num_slots;
+	Span<Capture> captures;
+	// Params that closures capture, boxed as the frame is set up.
+	Span<int> boxed;
+	// A lambda that captures nothing is created once and shared by every
+	// evaluation. Pinned, since the AST is not traced.
+	Lambda* hoisted;
+	// Set while the body is still unparsed.
+	LazyBody* lazy;
+
+	LambdaExpr(Span<Token> params, Span<Stmt*> body, LazyBody* lazy = nullptr)
+	    : params(params), body(body), num_slots(0), hoisted(nullptr), lazy(lazy) {}
+
+	Value accept(Visitor* visitor) override {
 		return visitor->visit_lambda_expr(this);
 	}
 };
 
 class Get : public Expr {
 public:
-    std::shared_ptr<Expr> obj;
-    std::shared_ptr<Token> name;
+    Expr* obj;
+    Token name;
+    InlineCache cache;
+    Spec spec;
     
-    Get(std::shared_ptr<Expr> obj, std::shared_ptr<Token> name) : obj(obj), name(name) {}
+    Get(Expr* obj, Token name) : obj(obj), name(name), spec(Spec_NEW) {}
 
-    std::shared_ptr<Obj> accept(Visitor* visitor) override {
+    Value accept(Visitor* visitor) override {
         return visitor->visit_get_expr(this);
     }
 };
 
 class Set : public Expr {
 public:
-    std::shared_ptr<Expr> obj;
-    std::shared_ptr<Token> name;
-    std::shared_ptr<Expr> val;
+    Expr* obj;
+    Token name;
+    Expr* val;
+    InlineCache cache;
     
-    Set(std::shared_ptr<Expr> obj, std::shared_ptr<Token> name, std::shared_ptr<Expr> val) 
+    Set(Expr* obj, Token name, Expr* val) 
         : obj(obj), name(name), val(val) {}
 
-    std::shared_ptr<Obj> accept(Visitor* visitor) override {
+    Value accept(Visitor* visitor) override {
         return visitor->visit_set_expr(this);
     }
 };
 
 class This : public Expr {
 public:
-    std::shared_ptr<Token> keyword;
+    Token keyword;
+    Access access;
+    int slot;
     
-    This(std::shared_ptr<Token> keyword) : keyword(keyword) {}
+    This(Token keyword) : keyword(keyword), access(Access_GLOBAL), slot(-1) {}
 
-    std::shared_ptr<Obj> accept(Visitor* visitor) override {
+    Value accept(Visitor* visitor) override {
         return visitor->visit_this_expr(this);
     }
 };
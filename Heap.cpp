@@ -0,0 +1,105 @@
+#include "Heap.hpp"
+#include <algorithm>
+
+#define GC_INITIAL_THRESHOLD (1 << 20)
+#define GC_GROWTH_FACTOR 2
+
+Heap heap;
+
+Heap::Heap()
+	: stack_base(nullptr), bytes_allocated(0), next_gc(GC_INITIAL_THRESHOLD),
+	peak_bytes(0), collections(0), freed(0) {}
+
+Heap::~Heap() {
+	for (auto obj : objects) delete obj;
+}
+
+void Heap::unpin(Obj* obj) {
+	auto it = std::find(pinned.rbegin(), pinned.rend(), obj);
+	if (it != pinned.rend()) pinned.erase(std::next(it).base());
+}
+
+void Heap::mark(Obj* obj) {
+	if (obj == nullptr || obj->marked) return;
+	obj->marked = true;
+	gray.push_back(obj);
+}
+
+void Heap::mark(const Value& val) {
+	if (val.is_obj()) mark(val.as_obj());
+}
+
+void Heap::set_stack_base(void* base) {
+	stack_base = (uintptr_t*) base;
+}
+
+void Heap::add_roots(std::function<void()> roots) {
+	this->roots.push_back(roots);
+}
+
+void Heap::collect() {
+	// Nothing can be scanned until main has recorded where the stack starts.
+	if (stack_base == nullptr) return;
+	peak_bytes = std::max(peak_bytes, bytes_allocated);
+
+	for (auto& r : roots) r();
+	for (auto obj : pinned) mark(obj);
+	for (auto buffer : root_buffers) {
+		for (auto& val : *buffer) mark(val);
+	}
+	for (auto obj : root_objs) mark(obj);
+	mark_stack();
+	trace_references();
+	sweep();
+
+	next_gc = std::max((size_t) GC_INITIAL_THRESHOLD, bytes_allocated * GC_GROWTH_FACTOR);
+	collections++;
+}
+
+void Heap::report(std::ostream& out) {
+	out << "[gc] collections: " << collections
+		<< ", live objects: " << objects.size()
+		<< ", heap bytes: " << bytes_allocated
+		<< ", peak bytes: " << std::max(peak_bytes, bytes_allocated)
+		<< ", freed objects: " << freed << '\n';
+}
+
+// Treats every word between here and main's frame as a possible pointer.
+// __builtin_unwind_init spills the callee saved registers into this frame
+// first so values that only live in registers are seen as well.
+__attribute__((noinline)) void Heap::mark_stack() {
+	__builtin_unwind_init();
+	volatile uintptr_t marker = 0;
+	stack_words.clear();
+	for (volatile uintptr_t* p = &marker; p < stack_base; p++) stack_words.push_back((uintptr_t) *p);
+	// There are far fewer stack words than objects, so the words are sorted
+	// and each object looks for one pointing into it.
+	std::sort(stack_words.begin(), stack_words.end());
+	for (auto obj : objects) {
+		auto it = std::lower_bound(stack_words.begin(), stack_words.end(), (uintptr_t) obj);
+		if (it != stack_words.end() && *it < (uintptr_t) obj + obj->size) mark(obj);
+	}
+}
+
+void Heap::trace_references() {
+	while (!gray.empty()) {
+		Obj* obj = gray.back();
+		gray.pop_back();
+		obj->trace();
+	}
+}
+
+void Heap::sweep() {
+	size_t live = 0;
+	for (auto obj : objects) {
+		if (obj->marked) {
+			obj->marked = false;
+			objects[live++] = obj;
+		} else {
+			bytes_allocated -= obj->size + obj->payload_size();
+			freed++;
+			delete obj;
+		}
+	}
+	objects.resize(live);
+}
@@ -0,0 +1,108 @@
+#ifndef HEAP
+#define HEAP
+
+#include <vector>
+#include <functional>
+#include <iostream>
+#include <utility>
+#include <cstdint>
+#include "Obj.hpp"
+#include "Value.hpp"
+
+// Mark-sweep collector that owns every runtime Obj. Roots come from the
+// callbacks registered by the Interpreter and VM, pinned objects (literals
+// and compiled code), buffers guarded by Root, and a conservative scan of
+// the native stack for values the tree walker keeps in C++ locals.
+class Heap {
+public:
+	Heap();
+
+	~Heap();
+
+	template <typename T, typename... Args>
+	T* alloc(Args&&... args) {
+#ifdef DEBUG_STRESS_GC
+		collect();
+#else
+		if (bytes_allocated > next_gc) collect();
+#endif
+		T* obj = new T(std::forward<Args>(args)...);
+		obj->size = sizeof(T);
+		bytes_allocated += sizeof(T) + obj->payload_size();
+		objects.push_back(obj);
+		return obj;
+	}
+
+	// Pinned objects are never freed. Used for anything the AST or compiled
+	// chunks point at, since those are not traced.
+	template <typename T>
+	T* pin(T* obj) {
+		pinned.push_back(obj);
+		return obj;
+	}
+
+	// For something pinned that nothing will use again. Recent pins are
+	// the likeliest to go, so the search starts from the back.
+	void unpin(Obj* obj);
+
+	void mark(Obj* obj);
+
+	void mark(const Value& val);
+
+	void set_stack_base(void* base);
+
+	void add_roots(std::function<void()> roots);
+
+	void collect();
+
+	void report(std::ostream& out);
+
+private:
+	friend class Root;
+
+	std::vector<Obj*> objects;
+	std::vector<Obj*> pinned;
+	std::vector<Obj*> gray;
+	std::vector<std::function<void()>> roots;
+	std::vector<const std::vector<Value>*> root_buffers;
+	std::vector<Obj*> root_objs;
+	uintptr_t* stack_base;
+	std::vector<uintptr_t> stack_words;
+	size_t bytes_allocated;
+	size_t next_gc;
+	size_t peak_bytes;
+	size_t collections;
+	size_t freed;
+
+	void mark_stack();
+
+	void trace_references();
+
+	void sweep();
+};
+
+extern Heap heap;
+
+// Keeps values that only live in C++ heap memory, such as an argument
+// vector being filled or a callable whose body is running, reachable for
+// as long as the guard is in scope.
+class Root {
+public:
+	Root(const std::vector<Value>& values) : buffer(true) {
+		heap.root_buffers.push_back(&values);
+	}
+
+	Root(Obj* obj) : buffer(false) {
+		heap.root_objs.push_back(obj);
+	}
+
+	~Root() {
+		if (buffer) heap.root_buffers.pop_back();
+		else heap.root_objs.pop_back();
+	}
+
+private:
+	bool buffer;
+};
+
+#endif
@@ -1,166 +1,245 @@
 #include "Interpreter.hpp"
 
-Interpreter::Interpreter() {
-	globals = std::make_shared<Environment>();
-	env = globals;
-	globals->define("clock", std::make_shared<Clock>());
-	globals->define("List", std::make_shared<List>());
-	globals->define("Map", std::make_shared<Map>());
+Interpreter::Interpreter() : jit(nullptr), base(0), upvalues(nullptr), running(nullptr), completion(Completion_NORMAL), spec_stats() {
+	globals = heap.alloc<Environment>();
+	heap.add_roots([this]() { mark_roots(); });
+	globals->define(symbols.intern("clock"), heap.alloc<Clock>());
+	globals->define(symbols.intern("List"), heap.alloc<List>());
+	globals->define(symbols.intern("Map"), heap.alloc<Map>());
+	globals->define(symbols.intern("StringBuilder"), heap.alloc<StringBuilder>());
 }
 
-void Interpreter::interpret(std::vector<std::shared_ptr<Stmt>> stmts) {
+void Interpreter::interpret(Span<Stmt*> stmts) {
+	// A runtime error in the last run can leave the frames of the calls it
+	// was in behind.
+	stack.clear();
+	base = 0;
+	upvalues = nullptr;
+	running = nullptr;
 	for (auto stmt : stmts) execute(stmt);
 }
 
-void Interpreter::execute_block(std::vector<std::shared_ptr<Stmt>>& stmts, std::shared_ptr<Environment> env) {
-	std::shared_ptr<Environment> prev_env = this->env;
-	try {
-		this->env = env;
-		for (std::shared_ptr<Stmt> s : stmts) execute(s);
-		this->env = prev_env;
-	} catch (ReturnException& e) {
-		this->env = prev_env;
-		throw e;
-	} catch (RuntimeError& e) {
-		this->env = prev_env;
-		throw e;
+// Runs a fn or lambda body in a new frame on top of the stack. A method's
+// receiver goes in slot 0, ahead of the arguments.
+Value Interpreter::execute_body(
+	Span<Stmt*> body,
+	int num_slots,
+	Span<int> boxed,
+	const Upvalues& upvalues,
+	const std::vector<Value>& arguments,
+	const Value* receiver,
+	Fn* fn
+) {
+	size_t frame = stack.size();
+	stack.resize(frame + num_slots);
+	size_t slot = frame;
+	if (receiver != nullptr) stack[slot++] = *receiver;
+	for (auto& a : arguments) stack[slot++] = a;
+	for (int b : boxed) {
+		auto box = heap.alloc<Box>(stack[frame + b]);
+		stack[frame + b] = box;
+	}
+	size_t prev_base = base;
+	const Upvalues* prev_upvalues = this->upvalues;
+	Fn* prev_running = running;
+	base = frame;
+	this->upvalues = &upvalues;
+	running = fn;
+	for (auto s : body) {
+		if (execute(s) != Completion_NORMAL) break;
 	}
-};
+	base = prev_base;
+	this->upvalues = prev_upvalues;
+	running = prev_running;
+	stack.resize(frame);
+	if (completion != Completion_RETURN) return Value();
+	completion = Completion_NORMAL;
+	Value val = return_value;
+	return_value = Value();
+	return val;
+}
+
+// Runs a call to a plain fn, natively once the Jit has compiled it.
+Value Interpreter::call_fn(Fn* fn, const std::vector<Value>& arguments) {
+	if (fn->lazy != nullptr) load(fn);
+	if (jit == nullptr) return execute_body(fn->body, fn->num_slots, fn->boxed, fn->upvalues, arguments);
+	Value result;
+	if (jit->call(fn, arguments, result)) return result;
+	return execute_body(fn->body, fn->num_slots, fn->boxed, fn->upvalues, arguments, nullptr, fn);
+}
+
+// The node keeps the parsed body, so every function made from it after
+// the first call starts out loaded.
+void Interpreter::load(Fn* fn) {
+	parse_lazy(fn->lazy);
+	fn->body = fn->lazy->body;
+	fn->num_slots = fn->lazy->num_slots;
+	fn->boxed = fn->lazy->boxed;
+	fn->lazy = nullptr;
+}
+
+void Interpreter::load(Lambda* lambda) {
+	parse_lazy(lambda->lazy);
+	lambda->body = lambda->lazy->body;
+	lambda->num_slots = lambda->lazy->num_slots;
+	lambda->boxed = lambda->lazy->boxed;
+	lambda->lazy = nullptr;
+}
+
+template <typename T>
+void Interpreter::parse_lazy(T* node) {
+	if (node->lazy == nullptr) return;
+	Arena& arena = *node->lazy->arena;
+	node->body = Parser(*node->lazy->tokens, arena).parse_body(*node->lazy);
+	Resolver(arena).resolve_lazy(node);
+	node->body = Optimizer(arena).optimize(node->body);
+	node->lazy = nullptr;
+}
 
-std::shared_ptr<Obj> Interpreter::visit_literal_expr(Literal* expr) {
+Value Interpreter::visit_literal_expr(Literal* expr) {
 	return expr->val;
 }
 
-std::shared_ptr<Obj> Interpreter::visit_grouping_expr(Grouping* expr) {
+Value Interpreter::visit_grouping_expr(Grouping* expr) {
 	return evaluate(expr->expression);
 }
 
-std::shared_ptr<Obj> Interpreter::visit_unary_expr(Unary* expr) {
-	std::shared_ptr<Obj> right = evaluate(expr->right);
-	std::shared_ptr<DoubleObj> double_val;
-	switch (expr->op->type) {
+Value Interpreter::visit_unary_expr(Unary* expr) {
+	Value right = evaluate(expr->right);
+	switch (expr->op.type) {
 		case BANG: 
-			return std::make_shared<BoolObj>(!is_truthy(right));
+			return Value(!is_truthy(right));
 		case MINUS:
 			check_num_operand(expr->op, right);
-			double_val = std::dynamic_pointer_cast<DoubleObj>(right);
-			return std::make_shared<DoubleObj>(-double_val->val);
+			return Value(-right.as_number());
+		default:
+			break;
 	}
-	return nullptr;
+	return Value();
 }
 
-std::shared_ptr<Obj> Interpreter::visit_binary_expr(Binary* expr) {
-	std::shared_ptr<Obj> left = evaluate(expr->left);
-	std::shared_ptr<Obj> right = evaluate(expr->right); 
+// The node's spec is read only once the operands have run, as they can run
+// this same node again through a recursive call.
+Value Interpreter::visit_binary_expr(Binary* expr) {
+	Value left = evaluate(expr->left);
+	Value right = evaluate(expr->right);
+	bool numbers = left.is_number() && right.is_number();
+	SpecStats& stats = spec_stats[SpecKind_BINARY];
+	switch (expr->spec) {
+		case Spec_NEW:
+			expr->spec = numbers ? Spec_NUMBER : Spec_GENERIC;
+			if (numbers) stats.specialized++;
+			break;
+		case Spec_NUMBER:
+			if (numbers) {
+				stats.hits++;
+				return number_binary(expr->op, left, right);
+			}
+			stats.misses++;
+			expr->spec = Spec_GENERIC;
+			break;
+		default:
+			stats.generic++;
+			break;
+	}
+	return binary(expr->op, left, right);
+}
 
-	if (left == nullptr || right == nullptr) throw RuntimeError(expr->op, "nil can not be added");
+// Skips the nil and type checks for operands known to be numbers.
+Value Interpreter::number_binary(const Token& op, const Value& left, const Value& right) {
+	double a = left.as_number();
+	double b = right.as_number();
+	switch (op.type) {
+		case BANG_EQUAL: return Value(a != b);
+		case EQUAL_EQUAL: return Value(a == b);
+		case GREATER: return Value(a > b);
+		case GREATER_EQUAL: return Value(a >= b);
+		case LESS: return Value(a < b);
+		case LESS_EQUAL: return Value(a <= b);
+		case PLUS: return Value(a + b);
+		case MINUS: return Value(a - b);
+		case SLASH: return Value(a / b);
+		case STAR: return Value(a * b);
+		case MOD: return Value((double) ((long) a % (long) b));
+		case STAR_STAR: return Value(pow(a, b));
+		case SLASH_SLASH: return Value((double) ((long) a / (long) b));
+		default: return binary(op, left, right);
+	}
+}
 
-	std::shared_ptr<DoubleObj> double_left;
-	std::shared_ptr<DoubleObj> double_right;
-	std::shared_ptr<StringObj> string_left;
-	std::shared_ptr<StringObj> string_right;
-	std::shared_ptr<BoolObj> bool_right;
+Value Interpreter::binary(const Token& op, const Value& left, const Value& right) {
+	if (left.is_nil() || right.is_nil()) throw RuntimeError(op, "nil can not be added");
 
-	switch (expr->op->type) {
+	switch (op.type) {
 		case BANG_EQUAL: 
-			return std::make_shared<BoolObj>(!is_equal(left, right));
+			return Value(!is_equal(left, right));
 		case EQUAL_EQUAL: 
-			return std::make_shared<BoolObj>(is_equal(left, right));
+			return Value(is_equal(left, right));
 		case GREATER:
-			check_num_operands(expr->op, left, right);
-			double_left = std::dynamic_pointer_cast<DoubleObj>(left);
-			double_right = std::dynamic_pointer_cast<DoubleObj>(right);
-			return std::make_shared<BoolObj>(double_left->val > double_right->val);
+			check_num_operands(op, left, right);
+			return Value(left.as_number() > right.as_number());
 		case GREATER_EQUAL:
-			check_num_operands(expr->op, left, right);
-			double_left = std::dynamic_pointer_cast<DoubleObj>(left);
-			double_right = std::dynamic_pointer_cast<DoubleObj>(right);
-			return std::make_shared<BoolObj>(double_left->val >= double_right->val);
+			check_num_operands(op, left, right);
+			return Value(left.as_number() >= right.as_number());
 		case LESS:
-			check_num_operands(expr->op, left, right);
-			double_left = std::dynamic_pointer_cast<DoubleObj>(left);
-			double_right = std::dynamic_pointer_cast<DoubleObj>(right);
-			return std::make_shared<BoolObj>(double_left->val < double_right->val);
+			check_num_operands(op, left, right);
+			return Value(left.as_number() < right.as_number());
 		case LESS_EQUAL:
-			check_num_operands(expr->op, left, right);
-			double_left = std::dynamic_pointer_cast<DoubleObj>(left);
-			double_right = std::dynamic_pointer_cast<DoubleObj>(right);
-			return std::make_shared<BoolObj>(double_left->val <= double_right->val);
+			check_num_operands(op, left, right);
+			return Value(left.as_number() <= right.as_number());
 		case PLUS:
-			if ((double_left = std::dynamic_pointer_cast<DoubleObj>(left))) {
-				if ((double_right = std::dynamic_pointer_cast<DoubleObj>(right))) {
-					return std::make_shared<DoubleObj>(double_left->val + double_right->val);
-				}
+			if (left.is_number() && right.is_number()) {
+				return Value(left.as_number() + right.as_number());
 			} 
-			if ((string_left = std::dynamic_pointer_cast<StringObj>(left))) {
-				if ((string_right = std::dynamic_pointer_cast<StringObj>(right))) {
-					return std::make_shared<StringObj>(string_left->val + string_right->val);
+			if (left.is_string()) {
+				auto& string_left = static_cast<StringObj*>(left.as_obj())->val;
+				if (right.is_string()) {
+					return heap.alloc<StringObj>(string_left + static_cast<StringObj*>(right.as_obj())->val);
 				}
-				if ((double_right = std::dynamic_pointer_cast<DoubleObj>(right))) {
-					return std::make_shared<StringObj>(string_left->val + stringify(double_right));
-				}
-				if ((bool_right = std::dynamic_pointer_cast<BoolObj>(right))) {
-					return std::make_shared<StringObj>(string_left->val + stringify(bool_right));
+				if (right.is_number() || right.is_bool()) {
+					return heap.alloc<StringObj>(string_left + stringify(right));
 				}
 			} 
-			throw  RuntimeError(expr->op, "Operands can not be added with '+'");
+			throw  RuntimeError(op, "Operands can not be added with '+'");
 		case MINUS:
-			check_num_operands(expr->op, left, right);
-			double_left = std::dynamic_pointer_cast<DoubleObj>(left);
-			double_right = std::dynamic_pointer_cast<DoubleObj>(right);
-			return std::make_shared<DoubleObj>(double_left->val - double_right->val);
+			check_num_operands(op, left, right);
+			return Value(left.as_number() - right.as_number());
 		case SLASH:
-			check_num_operands(expr->op, left, right);
-			double_left = std::dynamic_pointer_cast<DoubleObj>(left);
-			double_right = std::dynamic_pointer_cast<DoubleObj>(right);
-			return std::make_shared<DoubleObj>(double_left->val / double_right->val);
+			check_num_operands(op, left, right);
+			return Value(left.as_number() / right.as_number());
 		case STAR:
-			check_num_operands(expr->op, left, right);
-			double_left = std::dynamic_pointer_cast<DoubleObj>(left);
-			double_right = std::dynamic_pointer_cast<DoubleObj>(right);
-			return std::make_shared<DoubleObj>(double_left->val * double_right->val);
+			check_num_operands(op, left, right);
+			return Value(left.as_number() * right.as_number());
 		case MOD:
-			check_num_operands(expr->op, left, right);
-			double_left = std::dynamic_pointer_cast<DoubleObj>(left);
-			double_right = std::dynamic_pointer_cast<DoubleObj>(right);
-			return std::make_shared<DoubleObj>((long) double_left->val % (long) double_right->val);
+			check_num_operands(op, left, right);
+			return Value((double) ((long) left.as_number() % (long) right.as_number()));
 		case STAR_STAR:
-			check_num_operands(expr->op, left, right);
-			double_left = std::dynamic_pointer_cast<DoubleObj>(left);
-			double_right = std::dynamic_pointer_cast<DoubleObj>(right);
-			return std::make_shared<DoubleObj>(pow(double_left->val, double_right->val));
+			check_num_operands(op, left, right);
+			return Value(pow(left.as_number(), right.as_number()));
 		case SLASH_SLASH:
-			check_num_operands(expr->op, left, right);
-			double_left = std::dynamic_pointer_cast<DoubleObj>(left);
-			double_right = std::dynamic_pointer_cast<DoubleObj>(right);
-			return std::make_shared<DoubleObj>((long) double_left->val / (long) double_right->val);
+			check_num_operands(op, left, right);
+			return Value((double) ((long) left.as_number() / (long) right.as_number()));
+		default:
+			break;
 	}
-	return nullptr;
+	return Value();
 }
 
-std::shared_ptr<Obj> Interpreter::visit_variable_expr(Variable* expr) {
-	if (locals.count(expr)) {
-		int dist = locals[expr];
-		return env->get_at(dist, expr->name->lexeme);
-	} else {
-		return globals->get(expr->name);
-	}
+Value Interpreter::visit_variable_expr(Variable* expr) {
+	if (expr->access == Access_GLOBAL) return globals->get(expr->name);
+	return local(expr->access, expr->slot);
 }
 
-std::shared_ptr<Obj> Interpreter::visit_assign_expr(Assign* expr) {
-	std::shared_ptr<Obj> val = evaluate(expr->val);
-	if (locals.count(expr)) {
-		int dist = locals[expr];
-		env->assign_at(dist, expr->name, val);
-	} else {
-		globals->assign(expr->name, val);
-	}
+Value Interpreter::visit_assign_expr(Assign* expr) {
+	Value val = evaluate(expr->val);
+	if (expr->access == Access_GLOBAL) globals->assign(expr->name, val);
+	else local(expr->access, expr->slot) = val;
 	return val;
 }
 
-std::shared_ptr<Obj> Interpreter::visit_logical_expr(Logical* expr) {
-	std::shared_ptr<Obj> left = evaluate(expr->left);
-	if (expr->op->type == OR) {
+Value Interpreter::visit_logical_expr(Logical* expr) {
+	Value left = evaluate(expr->left);
+	if (expr->op.type == OR) {
 		if (is_truthy(left)) return left;
 	} else {
 		if (!is_truthy(left)) return left;
@@ -168,44 +247,159 @@ std::shared_ptr<Obj> Interpreter::visit_logical_expr(Logical* expr) {
 	return evaluate(expr->right);
 }
 
-std::shared_ptr<Obj> Interpreter::visit_call_expr(Call* expr) {
-	std::shared_ptr<Obj> callee = evaluate(expr->callee);
-	std::vector<std::shared_ptr<Obj>> arguments;
-	for (auto a : expr->arguments) arguments.push_back(evaluate(a));
-	if (auto fn = std::dynamic_pointer_cast<Callable>(callee)) {
+Value Interpreter::visit_call_expr(Call* expr) {
+	if (expr->method != nullptr) return invoke(expr);
+	Value callee = evaluate(expr->callee);
+	SpecStats& stats = spec_stats[SpecKind_CALL];
+	switch (expr->spec) {
+		case Spec_NEW:
+			if (callee.is_obj_type(OBJ_FN)) expr->spec = Spec_FN;
+			else if (callee.is_obj_type(OBJ_NATIVE)) expr->spec = Spec_NATIVE;
+			else expr->spec = Spec_GENERIC;
+			if (expr->spec != Spec_GENERIC) stats.specialized++;
+			break;
+		case Spec_FN:
+			if (callee.is_obj_type(OBJ_FN)) {
+				stats.hits++;
+				return fn_call(expr, static_cast<Fn*>(callee.as_obj()));
+			}
+			stats.misses++;
+			expr->spec = Spec_GENERIC;
+			break;
+		case Spec_NATIVE:
+			if (callee.is_obj_type(OBJ_NATIVE)) {
+				stats.hits++;
+				break;
+			}
+			stats.misses++;
+			expr->spec = Spec_GENERIC;
+			break;
+		default:
+			stats.generic++;
+			break;
+	}
+	return call(expr, callee);
+}
+
+// Calls the Fn directly rather than through Callable::call.
+Value Interpreter::fn_call(Call* expr, Fn* fn) {
+	Root callee_root(fn);
+	std::vector<Value> arguments;
+	Root arguments_root(arguments);
+	arguments.reserve(expr->arguments.size());
+	for (auto& a : expr->arguments) arguments.push_back(evaluate(a));
+	if (arguments.size() != fn->params.size()) throw RuntimeError(expr->paren, "Incorect number of arguments");
+	return call_fn(fn, arguments);
+}
+
+Value Interpreter::call(Call* expr, const Value& callee) {
+	// The callee has to outlive the call, as it owns the code being run.
+	Root callee_root(callee.as_obj());
+	std::vector<Value> arguments;
+	Root arguments_root(arguments);
+	arguments.reserve(expr->arguments.size());
+	for (auto& a : expr->arguments) arguments.push_back(evaluate(a));
+	if (callee.is_callable()) {
+		auto fn = static_cast<Callable*>(callee.as_obj());
 		if (arguments.size() != fn->num_params()) throw RuntimeError(expr->paren, "Incorect number of arguments");
-		return fn->call(this, arguments);
+		try {
+			return fn->call(this, arguments);
+		} catch (NativeError& e) {
+			throw RuntimeError(expr->paren, e.what());
+		}
 	} 
 	throw RuntimeError(expr->paren, "Object is not callable");
 }
 
-std::shared_ptr<Obj> Interpreter::visit_lambda_expr(LambdaExpr* expr) {
-	return std::make_shared<Lambda>(expr->params, expr->body);
+// Calls obj.name(...) without binding the method. The receiver goes
+// straight into the method's frame.
+Value Interpreter::invoke(Call* expr) {
+	Get* get = expr->method;
+	Value obj = evaluate(get->obj);
+	if (!obj.is_instance()) throw RuntimeError(get->name, "Only instances have properties");
+	auto instance = static_cast<Instance*>(obj.as_obj());
+	Root instance_root(instance);
+	const CacheEntry* entry = instance->lookup(get->name.symbol, get->cache);
+	if (entry == nullptr) throw RuntimeError(get->name, "Undefined property '" + std::string(get->name.lexeme) + "'");
+	// A field holding a callable is called like any other value. The entry
+	// can move once the arguments run, so it is not used past this point.
+	bool is_field = entry->index >= 0;
+	Value callee = is_field ? instance->fields[entry->index] : Value(entry->method);
+	Root callee_root(callee.as_obj());
+	std::vector<Value> arguments;
+	Root arguments_root(arguments);
+	arguments.reserve(expr->arguments.size());
+	for (auto& a : expr->arguments) arguments.push_back(evaluate(a));
+	if (!callee.is_callable()) throw RuntimeError(expr->paren, "Object is not callable");
+	auto fn = static_cast<Callable*>(callee.as_obj());
+	if (arguments.size() != fn->num_params()) throw RuntimeError(expr->paren, "Incorect number of arguments");
+	try {
+		if (is_field) return fn->call(this, arguments);
+		return fn->call_method(this, instance, arguments);
+	} catch (NativeError& e) {
+		throw RuntimeError(expr->paren, e.what());
+	}
+}
+
+Value Interpreter::visit_lambda_expr(LambdaExpr* expr) {
+	if (expr->hoisted != nullptr) return expr->hoisted;
+	auto lambda = heap.alloc<Lambda>(expr->params, expr->body, expr->num_slots, expr->boxed, expr->lazy != nullptr ? expr : nullptr);
+	if (expr->captures.empty()) expr->hoisted = heap.pin(lambda);
+	else capture(expr->captures, lambda->upvalues);
+	return lambda;
 }
 
-std::shared_ptr<Obj> Interpreter::visit_get_expr(Get* expr) {
-	std::shared_ptr<Obj> obj = evaluate(expr->obj);
-	if (auto i = std::dynamic_pointer_cast<Instance>(obj)) return i->get(expr->name);
+Value Interpreter::visit_get_expr(Get* expr) {
+	Value obj = evaluate(expr->obj);
+	bool is_instance = obj.is_obj_type(OBJ_INSTANCE);
+	SpecStats& stats = spec_stats[SpecKind_GET];
+	switch (expr->spec) {
+		case Spec_NEW:
+			expr->spec = is_instance ? Spec_INSTANCE : Spec_GENERIC;
+			if (is_instance) stats.specialized++;
+			break;
+		case Spec_INSTANCE:
+			if (is_instance) {
+				stats.hits++;
+				return instance_get(expr, obj);
+			}
+			stats.misses++;
+			expr->spec = Spec_GENERIC;
+			break;
+		default:
+			stats.generic++;
+			break;
+	}
+	return get(expr, obj);
+}
+
+// Reads a field the cache already knows without going through the
+// method lookup.
+Value Interpreter::instance_get(Get* expr, const Value& obj) {
+	auto instance = static_cast<Instance*>(obj.as_obj());
+	const CacheEntry* entry = expr->cache.find(instance->shape->id);
+	if (entry != nullptr && entry->index >= 0) return instance->fields[entry->index];
+	return instance->get(expr->name, expr->cache);
+}
+
+Value Interpreter::get(Get* expr, const Value& obj) {
+	if (obj.is_instance()) return static_cast<Instance*>(obj.as_obj())->get(expr->name, expr->cache);
 	throw RuntimeError(expr->name, "Only instances have properties");
 }
 
-std::shared_ptr<Obj> Interpreter::visit_set_expr(Set* expr) {
-	std::shared_ptr<Obj> obj = evaluate(expr->obj);
-	if (auto instance = std::dynamic_pointer_cast<Instance>(obj)) {
-		std::shared_ptr<Obj> val = evaluate(expr->val);
-		instance->set(expr->name, val);
+Value Interpreter::visit_set_expr(Set* expr) {
+	Value obj = evaluate(expr->obj);
+	if (obj.is_instance()) {
+		Value val = evaluate(expr->val);
+		static_cast<Instance*>(obj.as_obj())->set(expr->name.symbol, val, expr->cache);
 		return val;
 	}
 	throw RuntimeError(expr->name, "Only instances have feilds");
 }
 
-std::shared_ptr<Obj> Interpreter::visit_this_expr(This* expr) {
-	if (locals.count(expr)) {
-		int dist = locals[expr];
-		return env->get_at(dist, expr->keyword->lexeme);
-	} else {
-		return globals->get(expr->keyword);
-	}
+Value Interpreter::visit_this_expr(This* expr) {
+	if (expr->access == Access_GLOBAL) return globals->get(expr->keyword);
+	return local(expr->access, expr->slot);
 }
 
 void Interpreter::visit_expression_stmt(Expression* stmt) {
@@ -213,18 +407,24 @@ void Interpreter::visit_expression_stmt(Expression* stmt) {
 }
 
 void Interpreter::visit_print_stmt(Print* stmt) {
-	std::shared_ptr<Obj> val = evaluate(stmt->expression);
+	Value val = evaluate(stmt->expression);
 	std::cout << stringify(val) << '\n';
 }
 
 void Interpreter::visit_var_stmt(Var* stmt) {
-	std::shared_ptr<Obj> val = nullptr;
+	declare(stmt->access, stmt->slot);
+	Value val;
 	if (stmt->initializer != nullptr) val = evaluate(stmt->initializer);
-	env->define(stmt->name->lexeme, val);
+	define(stmt->access, stmt->slot, stmt->name.symbol, val);
 }
 
+// Blocks share their function's frame. Only top level blocks can need more
+// slots than it has.
 void Interpreter::visit_block_stmt(Block* stmt) {
-	execute_block(stmt->stmts, std::make_shared<Environment>(env));
+	if (stack.size() < base + stmt->num_slots) stack.resize(base + stmt->num_slots);
+	for (auto s : stmt->stmts) {
+		if (execute(s) != Completion_NORMAL) break;
+	}
 }
 
 void Interpreter::visit_if_stmt(If* stmt) {
@@ -233,84 +433,160 @@ void Interpreter::visit_if_stmt(If* stmt) {
 }
 
 void Interpreter::visit_while_stmt(While* stmt) {
-	while (is_truthy(evaluate(stmt->condition))) execute(stmt->body);
+	while (stmt->condition == nullptr || is_truthy(evaluate(stmt->condition))) {
+		Completion c = execute(stmt->body);
+		if (c == Completion_RETURN) return;
+		completion = Completion_NORMAL;
+		if (c == Completion_BREAK) return;
+		if (stmt->increment != nullptr) evaluate(stmt->increment);
+		if (jit != nullptr && running != nullptr && jit->back_edge(running, stmt, stack.data() + base, return_value)) {
+			completion = Completion_RETURN;
+			return;
+		}
+	}
 }
 
 void Interpreter::visit_fn_stmt(FnStmt* stmt) {
-	auto fn = std::make_shared<Fn>(stmt->name, stmt->params, stmt->body, env);
-	env->define(stmt->name->lexeme, fn);
+	declare(stmt->access, stmt->slot);
+	auto fn = heap.alloc<Fn>(stmt->name, stmt->params, stmt->body, stmt->num_slots, stmt->boxed, stmt->lazy != nullptr ? stmt : nullptr);
+	capture(stmt->captures, fn->upvalues);
+	define(stmt->access, stmt->slot, stmt->name.symbol, fn);
 }
 
 void Interpreter::visit_return_stmt(Return* stmt) {
-	std::shared_ptr<Obj> val = nullptr;
+	Value val;
 	if (stmt->val != nullptr) val = evaluate(stmt->val);
-	throw ReturnException(val);
+	return_value = val;
+	completion = Completion_RETURN;
+}
+
+void Interpreter::visit_break_stmt(Break* stmt) {
+	completion = Completion_BREAK;
+}
+
+void Interpreter::visit_continue_stmt(Continue* stmt) {
+	completion = Completion_CONTINUE;
 }
 
 void Interpreter::visit_class_stmt(ClassStmt* stmt) {
-	env->define(stmt->name->lexeme, nullptr);
-	auto methods = std::make_shared<std::unordered_map<std::string, std::shared_ptr<Callable>>>();
+	declare(stmt->access, stmt->slot);
+	auto methods = std::make_shared<std::unordered_map<Symbol, Callable*>>();
+	// Allocated first so it keeps the methods reachable as they are created.
+	auto klass = heap.alloc<Class>(std::string(stmt->name.lexeme), methods);
 	for (auto m : stmt->methods) {
-		auto fn = std::make_shared<Fn>(m->name, m->params, m->body, env);
-		(*methods)[m->name->lexeme] = fn;
+		auto method = heap.alloc<Fn>(m->name, m->params, m->body, m->num_slots, m->boxed, m->lazy != nullptr ? m : nullptr);
+		capture(m->captures, method->upvalues);
+		(*methods)[m->name.symbol] = method;
+	}
+	define(stmt->access, stmt->slot, stmt->name.symbol, klass);
+}
+
+void Interpreter::visit_import_stmt(Import* stmt) {
+	Module* module = modules.enter(stmt->path);
+	if (module == nullptr) return;
+	ModuleRun run(module);
+	try {
+		for (auto s : module->stmts) execute(s);
+	} catch (RuntimeError& e) {
+		throw Modules::in_module(stmt->path, e);
+	}
+	run.finish();
+}
+
+void Interpreter::mark_roots() {
+	heap.mark(globals);
+	for (auto& v : stack) heap.mark(v);
+	heap.mark(return_value);
+}
+
+// Captures are made as the closure is created, from the boxed locals of the
+// running frame and the captures of the function creating it.
+void Interpreter::capture(Span<Capture> captures, Upvalues& out) {
+	out.reserve(captures.size());
+	for (auto& c : captures) {
+		if (c.is_local) out.push_back(static_cast<Box*>(stack[base + c.index].as_obj()));
+		else out.push_back((*upvalues)[c.index]);
 	}
-	env->assign(stmt->name, std::make_shared<Class>(stmt->name->lexeme, methods));
 }
 
-std::shared_ptr<Obj> Interpreter::evaluate(std::shared_ptr<Expr> expr) {
+// The variable a local access names. Only valid until the stack next grows.
+Value& Interpreter::local(Access access, int slot) {
+	if (access == Access_LOCAL) return stack[base + slot];
+	if (access == Access_BOXED) return static_cast<Box*>(stack[base + slot].as_obj())->val;
+	return (*upvalues)[slot]->val;
+}
+
+// Boxes a captured local before its initializer runs, so closures made in
+// the initializer, such as a recursive fn, can capture it.
+void Interpreter::declare(Access access, int slot) {
+	if (access == Access_BOXED) stack[base + slot] = heap.alloc<Box>(Value());
+}
+
+void Interpreter::define(Access access, int slot, Symbol name, Value val) {
+	if (access == Access_GLOBAL) globals->define(name, val);
+	else local(access, slot) = val;
+}
+
+Value Interpreter::evaluate(Expr* expr) {
 	return expr->accept(this);
 }
 
-void Interpreter::execute(std::shared_ptr<Stmt> stmt) {
+Completion Interpreter::execute(Stmt* stmt) {
 	stmt->accept(this);
+	return completion;
 }
 
-bool Interpreter::is_truthy(std::shared_ptr<Obj> val) {
-	if (val == nullptr) return false;
-	if (auto bool_val = std::dynamic_pointer_cast<BoolObj>(val)) return bool_val->val;
+void Interpreter::report_specialization(std::ostream& out) {
+	const char* names[SpecKind_COUNT] = { "binary", "get", "call" };
+	for (int kind = 0; kind < SpecKind_COUNT; kind++) {
+		const SpecStats& stats = spec_stats[kind];
+		size_t runs = stats.hits + stats.misses + stats.generic;
+		out << "[spec] " << names[kind]
+			<< ": specialized nodes: " << stats.specialized
+			<< ", hits: " << stats.hits
+			<< ", misses: " << stats.misses
+			<< ", generic runs: " << stats.generic
+			<< ", hit rate: " << (runs == 0 ? 0.0 : 100.0 * stats.hits / runs) << "%\n";
+	}
+}
+
+bool Interpreter::is_truthy(const Value& val) {
+	if (val.is_nil()) return false;
+	if (val.is_bool()) return val.as_bool();
 	return true;
 }
 
-bool Interpreter::is_equal(std::shared_ptr<Obj> a, std::shared_ptr<Obj> b) {
-	if (a == nullptr && b == nullptr) return true;
-	if (a == nullptr || b == nullptr) return false;
-	if (auto bool_a = std::dynamic_pointer_cast<BoolObj>(a)) {
-		if (auto bool_b = std::dynamic_pointer_cast<BoolObj>(b)) {
-			return bool_a->val == bool_b->val;
-		}
-	}
-	if (auto double_a = std::dynamic_pointer_cast<DoubleObj>(a)) {
-		if (auto double_b = std::dynamic_pointer_cast<DoubleObj>(b)) {
-			return double_a->val == double_b->val;
-		}
-	}
+bool Interpreter::is_equal(const Value& a, const Value& b) {
+	if (a.is_nil() && b.is_nil()) return true;
+	if (a.is_nil() || b.is_nil()) return false;
+	if (a.is_bool() && b.is_bool()) return a.as_bool() == b.as_bool();
+	if (a.is_number() && b.is_number()) return a.as_number() == b.as_number();
+	// Literals are interned, so equal literals are usually the same object.
+	// Strings built at runtime fall back to comparing contents.
+	if (a.is_string() && b.is_string()) return a.key_equals(b);
 	return false;
 }
 
-void Interpreter::check_num_operand(std::shared_ptr<Token> op, std::shared_ptr<Obj> operand) {
-	if (auto _ = std::dynamic_pointer_cast<DoubleObj>(operand)) return;
+void Interpreter::check_num_operand(Token op, const Value& operand) {
+	if (operand.is_number()) return;
 	throw RuntimeError(op, "Operand must be a number"); 
 }
 
-void Interpreter::check_num_operands(std::shared_ptr<Token> op, std::shared_ptr<Obj> a, std::shared_ptr<Obj> b) {
-	if (auto _ = std::dynamic_pointer_cast<DoubleObj>(a)) {
-		if (auto _ = std::dynamic_pointer_cast<DoubleObj>(b)) {
-			return;
-		}
-	}
+void Interpreter::check_num_operands(Token op, const Value& a, const Value& b) {
+	if (a.is_number() && b.is_number()) return;
 	throw RuntimeError(op, "Operands must be a number"); 
 }
 
-std::string Interpreter::stringify(std::shared_ptr<Obj> obj) {
-	if (obj == nullptr) return "nil";
-	if (auto val = std::dynamic_pointer_cast<BoolObj>(obj)) return val->to_string();
-	if (auto val = std::dynamic_pointer_cast<DoubleObj>(obj)) return val->to_string();
-	if (auto val = std::dynamic_pointer_cast<StringObj>(obj)) return val->to_string();
-	if (auto val = std::dynamic_pointer_cast<Class>(obj)) return val->to_string();
-	if (auto val = std::dynamic_pointer_cast<Instance>(obj)) return val->to_string();
-    return obj->to_string();
-}
-
-void Interpreter::resolve(Expr* expr, int depth) {
-	locals[expr] = depth;
+std::string Interpreter::stringify(const Value& val) {
+	if (!val.is_obj()) return val.to_string();
+	auto obj = val.as_obj();
+	switch (obj->obj_type) {
+		case OBJ_STRING: return static_cast<StringObj*>(obj)->to_string();
+		case OBJ_CLASS: return static_cast<Class*>(obj)->to_string();
+		case OBJ_INSTANCE:
+		case OBJ_LIST:
+		case OBJ_MAP:
+		case OBJ_STRING_BUILDER: return static_cast<Instance*>(obj)->to_string();
+		default: return obj->to_string();
+	}
 }
\ No newline at end of file
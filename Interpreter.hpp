@@ -11,44 +11,83 @@
 #include "Stmt.hpp"
 #include "Error.hpp"
 #include "Token.hpp"
-#include "Obj.hpp"
+#include "Value.hpp"
 #include "Environment.hpp"
 #include "Callable.hpp"
-#include "ReturnException.hpp"
+#include "Heap.hpp"
+#include "Jit.hpp"
+#include "Parser.hpp"
+#include "Resolver.hpp"
+#include "Optimizer.hpp"
+#include "Module.hpp"
+
+// How the last statement finished. Anything but Completion_NORMAL skips the
+// rest of the enclosing blocks until a loop or call consumes it.
+enum Completion { Completion_NORMAL, Completion_RETURN, Completion_BREAK, Completion_CONTINUE };
+
+// Node kinds that specialize themselves as they run.
+enum SpecKind { SpecKind_BINARY, SpecKind_GET, SpecKind_CALL, SpecKind_COUNT };
+
+// For --spec-stats. Hits and misses are runs of a specialized node that
+// passed or failed its guard, generic runs are runs of the generic node.
+struct SpecStats {
+	size_t specialized;
+	size_t hits;
+	size_t misses;
+	size_t generic;
+};
 
 class Interpreter : Expr::Visitor, Stmt::Visitor {
 public:
-	std::shared_ptr<Environment> globals;
+	Environment* globals;
+	// Set when running with --jit.
+	Jit* jit;
 	
 	Interpreter();
 
-	void interpret(std::vector<std::shared_ptr<Stmt>> stmts);
+	void interpret(Span<Stmt*> stmts);
+
+	Value execute_body(
+		Span<Stmt*> body,
+		int num_slots,
+		Span<int> boxed,
+		const Upvalues& upvalues,
+		const std::vector<Value>& arguments,
+		const Value* receiver = nullptr,
+		Fn* fn = nullptr
+	);
+
+	Value call_fn(Fn* fn, const std::vector<Value>& arguments);
 
-	void execute_block(std::vector<std::shared_ptr<Stmt>>& stmts, std::shared_ptr<Environment> env);
+	// Parses, resolves and optimizes the body of a fn, method or lambda
+	// that --lazy skipped, on its first call.
+	void load(Fn* fn);
 
-	std::shared_ptr<Obj> visit_literal_expr(Literal* expr) override;
+	void load(Lambda* lambda);
 
-	std::shared_ptr<Obj> visit_grouping_expr(Grouping* expr) override;
+	Value visit_literal_expr(Literal* expr) override;
 
-	std::shared_ptr<Obj> visit_unary_expr(Unary* expr) override;
+	Value visit_grouping_expr(Grouping* expr) override;
 
-	std::shared_ptr<Obj> visit_binary_expr(Binary* expr) override;
+	Value visit_unary_expr(Unary* expr) override;
 
-	std::shared_ptr<Obj> visit_variable_expr(Variable* expr) override;
+	Value visit_binary_expr(Binary* expr) override;
 
-	std::shared_ptr<Obj> visit_assign_expr(Assign* expr) override;
+	Value visit_variable_expr(Variable* expr) override;
 
-	std::shared_ptr<Obj> visit_logical_expr(Logical* expr) override;
+	Value visit_assign_expr(Assign* expr) override;
 
-	std::shared_ptr<Obj> visit_call_expr(Call* expr) override;
+	Value visit_logical_expr(Logical* expr) override;
 
-	std::shared_ptr<Obj> visit_lambda_expr(LambdaExpr* expr) override;
+	Value visit_call_expr(Call* expr) override;
 
-	std::shared_ptr<Obj> visit_get_expr(Get* expr) override;
+	Value visit_lambda_expr(LambdaExpr* expr) override;
+
+	Value visit_get_expr(Get* expr) override;
 	
-	std::shared_ptr<Obj> visit_set_expr(Set* expr) override;
+	Value visit_set_expr(Set* expr) override;
 	
-	std::shared_ptr<Obj> visit_this_expr(This* expr) override;
+	Value visit_this_expr(This* expr) override;
 
 	void visit_expression_stmt(Expression* stmt) override;
 
@@ -65,28 +104,73 @@ public:
 	void visit_fn_stmt(FnStmt* stmt) override;
 
 	void visit_return_stmt(Return* stmt) override;
+
+	void visit_break_stmt(Break* stmt) override;
+
+	void visit_continue_stmt(Continue* stmt) override;
 	
 	void visit_class_stmt(ClassStmt* stmt) override;
 
-	void resolve(Expr* expr, int depth);
+	void visit_import_stmt(Import* stmt) override;
+
+	bool is_truthy(const Value& val);
+
+	bool is_equal(const Value& a, const Value& b);
+
+	std::string stringify(const Value& val);
+
+	// The generic case of a binary operator, shared with code compiled by
+	// --aot.
+	Value binary(const Token& op, const Value& left, const Value& right);
 
-	bool is_truthy(std::shared_ptr<Obj> val);
+	void report_specialization(std::ostream& out);
 
 private:
-	std::shared_ptr<Environment> env;
-	std::unordered_map<Expr*, int> locals;
+	// Locals of every running call. The running frame starts at base. Slots
+	// are only ever accessed by index, as the stack can move when it grows.
+	std::vector<Value> stack;
+	size_t base;
+	// Captures of the fn or lambda being run, nullptr at the top level.
+	const Upvalues* upvalues;
+	// The Fn whose frame is running, if it is a plain fn call and there is
+	// a Jit. Its loops count towards compiling it.
+	Fn* running;
+	Completion completion;
+	Value return_value;
+	SpecStats spec_stats[SpecKind_COUNT];
+
+	template <typename T>
+	void parse_lazy(T* node);
+
+	void mark_roots();
+
+	Value evaluate(Expr* expr);
+
+	Completion execute(Stmt* stmt);
+
+	Value number_binary(const Token& op, const Value& left, const Value& right);
+
+	Value get(Get* expr, const Value& obj);
+
+	Value instance_get(Get* expr, const Value& obj);
+
+	Value call(Call* expr, const Value& callee);
+
+	Value fn_call(Call* expr, Fn* fn);
+
+	Value invoke(Call* expr);
 
-	std::shared_ptr<Obj> evaluate(std::shared_ptr<Expr> expr);
+	void capture(Span<Capture> captures, Upvalues& out);
 
-	void execute(std::shared_ptr<Stmt> stmt);
+	Value& local(Access access, int slot);
 
-	bool is_equal(std::shared_ptr<Obj> a, std::shared_ptr<Obj> b);
+	void declare(Access access, int slot);
 
-	void check_num_operand(std::shared_ptr<Token> op, std::shared_ptr<Obj> operand);
+	void define(Access access, int slot, Symbol name, Value val);
 
-	void check_num_operands(std::shared_ptr<Token> op, std::shared_ptr<Obj> a, std::shared_ptr<Obj> b);
+	void check_num_operand(Token op, const Value& operand);
 
-	std::string stringify(std::shared_ptr<Obj> val);
+	void check_num_operands(Token op, const Value& a, const Value& b);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,650 @@
+#include "Jit.hpp"
+#include "Callable.hpp"
+#include "Environment.hpp"
+#include <algorithm>
+#include <cstring>
+#include <math.h>
+
+#ifdef JIT_SUPPORTED
+#include <sys/mman.h>
+#endif
+
+JitCode::JitCode() : entry(nullptr), compiling(false), memory(nullptr), size(0) {}
+
+JitCode::~JitCode() {
+#ifdef JIT_SUPPORTED
+	if (memory != nullptr) munmap(memory, size);
+#endif
+}
+
+Jit::Jit(Environment* globals) : globals(globals) {}
+
+bool Jit::call(Fn* fn, const std::vector<Value>& arguments, Value& result) {
+#ifdef JIT_SUPPORTED
+	if (fn->jit == nullptr) {
+		if (++fn->hotness < JIT_THRESHOLD) return false;
+		compile(fn);
+	}
+	if (fn->jit->entry == nullptr) return false;
+	args.clear();
+	for (auto& a : arguments) {
+		if (!a.is_number()) return false;
+		args.push_back(a.as_number());
+	}
+	seen.clear();
+	if (!is_valid(fn)) return false;
+	result = Value(fn->jit->entry(args.data()));
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool Jit::back_edge(Fn* fn, While* loop, const Value* frame, Value& result) {
+#ifdef JIT_SUPPORTED
+	if (fn->jit == nullptr) {
+		if (++fn->hotness < JIT_THRESHOLD) return false;
+		compile(fn);
+	}
+	if (fn->jit->entry == nullptr) return false;
+	for (auto& l : fn->jit->loops) {
+		if (l.loop != loop) continue;
+		args.assign(fn->num_slots, 0);
+		for (int slot : l.live) {
+			if (!frame[slot].is_number()) return false;
+			args[slot] = frame[slot].as_number();
+		}
+		seen.clear();
+		if (!is_valid(fn)) return false;
+		result = Value(l.entry(args.data()));
+		return true;
+	}
+	return false;
+#else
+	return false;
+#endif
+}
+
+// Whether fn and everything it calls are compiled, and every global it
+// calls still holds the Fn it was compiled against.
+bool Jit::is_valid(Fn* fn) {
+	if (fn->jit == nullptr || fn->jit->entry == nullptr) return false;
+	if (std::find(seen.begin(), seen.end(), fn) != seen.end()) return true;
+	seen.push_back(fn);
+	for (auto& [name, callee] : fn->jit->callees) {
+		Value* val = globals->lookup(name);
+		if (val == nullptr || val->as_obj() != callee || !is_valid(callee)) return false;
+	}
+	return true;
+}
+
+#ifdef JIT_SUPPORTED
+
+// Thrown by the compiler at anything it does not handle.
+struct Unsupported {};
+
+enum Reg { RAX = 0, RCX = 1, RDX = 2, RSP = 4, RBP = 5, RDI = 7 };
+
+enum Cond { COND_B = 0x2, COND_AE = 0x3, COND_E = 0x4, COND_NE = 0x5, COND_BE = 0x6, COND_A = 0x7, COND_P = 0xA };
+
+// The few x86-64 instructions the compiler needs. Only xmm0 and xmm1 are
+// used for values, everything else lives in the frame.
+class Assembler {
+public:
+	std::vector<uint8_t> code;
+
+	int pos() { return code.size(); }
+
+	void byte(uint8_t b) { code.push_back(b); }
+
+	void int32(int32_t val) {
+		for (int i = 0; i < 4; i++) byte((uint32_t) val >> (8 * i));
+	}
+
+	void int64(uint64_t val) {
+		for (int i = 0; i < 8; i++) byte(val >> (8 * i));
+	}
+
+	// ModRM for [base + disp32].
+	void mem(int reg, Reg base, int32_t disp) {
+		byte(0x80 | (reg << 3) | base);
+		if (base == RSP) byte(0x24);
+		int32(disp);
+	}
+
+	void sse(uint8_t prefix, uint8_t op, int dst, int src) {
+		byte(prefix);
+		byte(0x0F);
+		byte(op);
+		byte(0xC0 | (dst << 3) | src);
+	}
+
+	void movsd_load(int xmm, Reg base, int32_t disp) {
+		byte(0xF2);
+		byte(0x0F);
+		byte(0x10);
+		mem(xmm, base, disp);
+	}
+
+	void movsd_store(Reg base, int32_t disp, int xmm) {
+		byte(0xF2);
+		byte(0x0F);
+		byte(0x11);
+		mem(xmm, base, disp);
+	}
+
+	void movsd(int dst, int src) { sse(0xF2, 0x10, dst, src); }
+
+	void addsd(int dst, int src) { sse(0xF2, 0x58, dst, src); }
+
+	void mulsd(int dst, int src) { sse(0xF2, 0x59, dst, src); }
+
+	void subsd(int dst, int src) { sse(0xF2, 0x5C, dst, src); }
+
+	void divsd(int dst, int src) { sse(0xF2, 0x5E, dst, src); }
+
+	void ucomisd(int a, int b) { sse(0x66, 0x2E, a, b); }
+
+	void xorpd(int dst, int src) { sse(0x66, 0x57, dst, src); }
+
+	void mov_imm(Reg reg, uint64_t val) {
+		byte(0x48);
+		byte(0xB8 + reg);
+		int64(val);
+	}
+
+	// movq xmm, rax
+	void movq_from_rax(int xmm) {
+		byte(0x66);
+		byte(0x48);
+		byte(0x0F);
+		byte(0x6E);
+		byte(0xC0 | (xmm << 3) | RAX);
+	}
+
+	// The same truncating conversions (long) and (double) compile to.
+	void cvttsd2si(Reg reg, int xmm) {
+		byte(0xF2);
+		byte(0x48);
+		byte(0x0F);
+		byte(0x2C);
+		byte(0xC0 | (reg << 3) | xmm);
+	}
+
+	void cvtsi2sd(int xmm, Reg reg) {
+		byte(0xF2);
+		byte(0x48);
+		byte(0x0F);
+		byte(0x2A);
+		byte(0xC0 | (xmm << 3) | reg);
+	}
+
+	// rdx:rax / rcx
+	void idiv_rcx() {
+		byte(0x48);
+		byte(0x99);
+		byte(0x48);
+		byte(0xF7);
+		byte(0xF9);
+	}
+
+	void lea(Reg reg, Reg base, int32_t disp) {
+		byte(0x48);
+		byte(0x8D);
+		mem(reg, base, disp);
+	}
+
+	void call_rax() {
+		byte(0xFF);
+		byte(0xD0);
+	}
+
+	// call [rax]
+	void call_at_rax() {
+		byte(0xFF);
+		byte(0x10);
+	}
+
+	// Returns where the frame size goes, patched once it is known.
+	int prologue() {
+		byte(0x55);
+		byte(0x48);
+		byte(0x89);
+		byte(0xE5);
+		byte(0x48);
+		byte(0x81);
+		byte(0xEC);
+		int at = pos();
+		int32(0);
+		return at;
+	}
+
+	void epilogue() {
+		byte(0xC9);
+		byte(0xC3);
+	}
+
+	void ud2() {
+		byte(0x0F);
+		byte(0x0B);
+	}
+
+	// Forward jumps return the offset to patch once the target is known.
+	int jmp() {
+		byte(0xE9);
+		int at = pos();
+		int32(0);
+		return at;
+	}
+
+	int jcc(Cond cond) {
+		byte(0x0F);
+		byte(0x80 | cond);
+		int at = pos();
+		int32(0);
+		return at;
+	}
+
+	void jmp_back(int target) {
+		byte(0xE9);
+		int32(target - (pos() + 4));
+	}
+
+	void patch(int at) { patch(at, pos()); }
+
+	void patch(int at, int target) {
+		int32_t rel = target - (at + 4);
+		memcpy(&code[at], &rel, 4);
+	}
+
+	void patch_int32(int at, int32_t val) { memcpy(&code[at], &val, 4); }
+};
+
+static double jit_pow(double a, double b) {
+	return pow(a, b);
+}
+
+// Lowers one Fn body. Expressions leave their result in xmm0. Locals are at
+// rbp - 8 * (slot + 1), and temporaries for the left operand of a binary
+// and for call arguments at rsp + 8 * index.
+class JitCompiler : Expr::Visitor, Stmt::Visitor {
+public:
+	JitCompiler(Jit* jit, Environment* globals, Fn* fn)
+		: jit(jit), globals(globals), fn(fn), temps(0), max_temps(0) {}
+
+	// Loop entries are added to the Fn's JitCode with their offset in the
+	// code as entry.
+	std::vector<uint8_t> compile() {
+		if (!returns(fn->body)) throw Unsupported();
+		std::vector<int> frame_sizes;
+		frame_sizes.push_back(a.prologue());
+		for (size_t i = 0; i < fn->params.size(); i++) {
+			a.movsd_load(0, RDI, 8 * i);
+			a.movsd_store(RBP, slot(i), 0);
+			live.push_back(i);
+		}
+		for (auto s : fn->body) execute(s);
+		a.ud2();
+		for (auto& l : loop_starts) {
+			JitCode::LoopEntry entry { l.loop, (JitCode::Entry) (uintptr_t) a.pos(), l.live };
+			frame_sizes.push_back(a.prologue());
+			for (int i = 0; i < fn->num_slots; i++) {
+				a.movsd_load(0, RDI, 8 * i);
+				a.movsd_store(RBP, slot(i), 0);
+			}
+			a.jmp_back(l.start);
+			fn->jit->loops.push_back(entry);
+		}
+		int frame_size = (8 * (fn->num_slots + max_temps) + 15) & ~15;
+		for (int at : frame_sizes) a.patch_int32(at, frame_size);
+		return a.code;
+	}
+
+	Value visit_literal_expr(Literal* expr) override {
+		if (!expr->val.is_number()) throw Unsupported();
+		double val = expr->val.as_number();
+		uint64_t bits;
+		memcpy(&bits, &val, 8);
+		a.mov_imm(RAX, bits);
+		a.movq_from_rax(0);
+		return Value();
+	}
+
+	Value visit_grouping_expr(Grouping* expr) override {
+		evaluate(expr->expression);
+		return Value();
+	}
+
+	Value visit_unary_expr(Unary* expr) override {
+		if (expr->op.type != MINUS) throw Unsupported();
+		evaluate(expr->right);
+		a.mov_imm(RAX, 0x8000000000000000);
+		a.movq_from_rax(1);
+		a.xorpd(0, 1);
+		return Value();
+	}
+
+	Value visit_binary_expr(Binary* expr) override {
+		TokenType op = expr->op.type;
+		if (op != PLUS && op != MINUS && op != STAR && op != SLASH && op != MOD && op != STAR_STAR && op != SLASH_SLASH) {
+			throw Unsupported();
+		}
+		operands(expr);
+		switch (op) {
+			case PLUS: a.addsd(0, 1); break;
+			case MINUS: a.subsd(0, 1); break;
+			case STAR: a.mulsd(0, 1); break;
+			case SLASH: a.divsd(0, 1); break;
+			case STAR_STAR:
+				a.mov_imm(RAX, (uint64_t) &jit_pow);
+				a.call_rax();
+				break;
+			case MOD:
+			case SLASH_SLASH:
+				a.cvttsd2si(RAX, 0);
+				a.cvttsd2si(RCX, 1);
+				a.idiv_rcx();
+				a.cvtsi2sd(0, op == MOD ? RDX : RAX);
+				break;
+			default: break;
+		}
+		return Value();
+	}
+
+	Value visit_variable_expr(Variable* expr) override {
+		if (expr->access != Access_LOCAL) throw Unsupported();
+		a.movsd_load(0, RBP, slot(expr->slot));
+		return Value();
+	}
+
+	Value visit_assign_expr(Assign* expr) override {
+		if (expr->access != Access_LOCAL) throw Unsupported();
+		evaluate(expr->val);
+		a.movsd_store(RBP, slot(expr->slot), 0);
+		return Value();
+	}
+
+	Value visit_logical_expr(Logical* expr) override { throw Unsupported(); }
+
+	// Only calls to global Fns that compile too. Arguments go in consecutive
+	// temporaries, which the callee reads through rdi.
+	Value visit_call_expr(Call* expr) override {
+		auto var = dynamic_cast<Variable*>(expr->callee);
+		if (var == nullptr || var->access != Access_GLOBAL || expr->method != nullptr) throw Unsupported();
+		Value* val = globals->lookup(var->name.symbol);
+		if (val == nullptr || !val->is_obj_type(OBJ_FN)) throw Unsupported();
+		auto callee = static_cast<Fn*>(val->as_obj());
+		if (callee->params.size() != expr->arguments.size()) throw Unsupported();
+		// A body --lazy has not parsed yet would be judged empty, for good.
+		if (callee->lazy != nullptr) throw Unsupported();
+		if (callee->jit == nullptr) jit->compile(callee);
+		if (callee->jit->entry == nullptr && !callee->jit->compiling) throw Unsupported();
+		auto entry = std::make_pair(var->name.symbol, callee);
+		auto& callees = fn->jit->callees;
+		if (std::find(callees.begin(), callees.end(), entry) == callees.end()) callees.push_back(entry);
+
+		int first = temps;
+		reserve_temps(expr->arguments.size());
+		for (size_t i = 0; i < expr->arguments.size(); i++) {
+			evaluate(expr->arguments[i]);
+			a.movsd_store(RSP, 8 * (first + i), 0);
+		}
+		temps = first;
+		a.lea(RDI, RSP, 8 * first);
+		// Through the entry field, so calls into a Fn still being compiled,
+		// such as a recursive call, work once it is done.
+		a.mov_imm(RAX, (uint64_t) &callee->jit->entry);
+		a.call_at_rax();
+		return Value();
+	}
+
+	Value visit_lambda_expr(LambdaExpr* expr) override { throw Unsupported(); }
+
+	Value visit_get_expr(Get* expr) override { throw Unsupported(); }
+
+	Value visit_set_expr(Set* expr) override { throw Unsupported(); }
+
+	Value visit_this_expr(This* expr) override { throw Unsupported(); }
+
+	void visit_expression_stmt(Expression* stmt) override {
+		evaluate(stmt->expression);
+	}
+
+	void visit_print_stmt(Print* stmt) override { throw Unsupported(); }
+
+	void visit_var_stmt(Var* stmt) override {
+		if (stmt->access != Access_LOCAL || stmt->initializer == nullptr) throw Unsupported();
+		evaluate(stmt->initializer);
+		a.movsd_store(RBP, slot(stmt->slot), 0);
+		live.push_back(stmt->slot);
+	}
+
+	void visit_block_stmt(Block* stmt) override {
+		size_t scope = live.size();
+		for (auto s : stmt->stmts) execute(s);
+		live.resize(scope);
+	}
+
+	void visit_if_stmt(If* stmt) override {
+		std::vector<int> else_jumps;
+		branch(stmt->condition, false, else_jumps);
+		execute(stmt->then_branch);
+		if (stmt->else_branch == nullptr) {
+			for (int j : else_jumps) a.patch(j);
+			return;
+		}
+		int end_jump = a.jmp();
+		for (int j : else_jumps) a.patch(j);
+		execute(stmt->else_branch);
+		a.patch(end_jump);
+	}
+
+	void visit_while_stmt(While* stmt) override {
+		int start = a.pos();
+		loop_starts.push_back(LoopStart { stmt, start, live });
+		loops.push_back(Loop());
+		if (stmt->condition != nullptr) branch(stmt->condition, false, loops.back().breaks);
+		execute(stmt->body);
+		for (int j : loops.back().continues) a.patch(j);
+		if (stmt->increment != nullptr) evaluate(stmt->increment);
+		a.jmp_back(start);
+		for (int j : loops.back().breaks) a.patch(j);
+		loops.pop_back();
+	}
+
+	void visit_fn_stmt(FnStmt* stmt) override { throw Unsupported(); }
+
+	void visit_return_stmt(Return* stmt) override {
+		if (stmt->val == nullptr) throw Unsupported();
+		evaluate(stmt->val);
+		a.epilogue();
+	}
+
+	void visit_break_stmt(Break* stmt) override {
+		loops.back().breaks.push_back(a.jmp());
+	}
+
+	void visit_continue_stmt(Continue* stmt) override {
+		loops.back().continues.push_back(a.jmp());
+	}
+
+	void visit_class_stmt(ClassStmt* stmt) override { throw Unsupported(); }
+
+	void visit_import_stmt(Import* stmt) override { throw Unsupported(); }
+
+private:
+	struct Loop {
+		std::vector<int> breaks;
+		std::vector<int> continues;
+	};
+
+	struct LoopStart {
+		While* loop;
+		int start;
+		std::vector<int> live;
+	};
+
+	Assembler a;
+	Jit* jit;
+	Environment* globals;
+	Fn* fn;
+	int temps;
+	int max_temps;
+	std::vector<Loop> loops;
+	std::vector<LoopStart> loop_starts;
+	// Slots of the locals in scope.
+	std::vector<int> live;
+
+	static int32_t slot(int index) { return -8 * (index + 1); }
+
+	void evaluate(Expr* expr) { expr->accept(this); }
+
+	void execute(Stmt* stmt) { stmt->accept(this); }
+
+	void reserve_temps(int count) {
+		temps += count;
+		max_temps = std::max(max_temps, temps);
+	}
+
+	// Leaves the left operand in xmm0 and the right one in xmm1.
+	void operands(Binary* expr) {
+		int left = temps;
+		evaluate(expr->left);
+		reserve_temps(1);
+		a.movsd_store(RSP, 8 * left, 0);
+		evaluate(expr->right);
+		temps = left;
+		a.movsd(1, 0);
+		a.movsd_load(0, RSP, 8 * left);
+	}
+
+	// Emits jumps, added to jumps, taken when the truthiness of condition is
+	// when. Numbers are always truthy.
+	void branch(Expr* condition, bool when, std::vector<int>& jumps) {
+		if (auto grouping = dynamic_cast<Grouping*>(condition)) {
+			branch(grouping->expression, when, jumps);
+			return;
+		}
+		if (auto literal = dynamic_cast<Literal*>(condition)) {
+			const Value& val = literal->val;
+			bool truthy = !val.is_nil() && (!val.is_bool() || val.as_bool());
+			if (truthy == when) jumps.push_back(a.jmp());
+			return;
+		}
+		if (auto unary = dynamic_cast<Unary*>(condition)) {
+			if (unary->op.type == BANG) {
+				branch(unary->right, !when, jumps);
+				return;
+			}
+		}
+		if (auto logical = dynamic_cast<Logical*>(condition)) {
+			// The left side alone decides it when it is truthy for or and
+			// falsy for and.
+			bool decides = logical->op.type == OR;
+			if (when == decides) {
+				branch(logical->left, when, jumps);
+				branch(logical->right, when, jumps);
+			} else {
+				std::vector<int> skip;
+				branch(logical->left, decides, skip);
+				branch(logical->right, when, jumps);
+				for (int j : skip) a.patch(j);
+			}
+			return;
+		}
+		if (auto binary = dynamic_cast<Binary*>(condition)) {
+			if (compare(binary, when, jumps)) return;
+		}
+		evaluate(condition);
+		if (when) jumps.push_back(a.jmp());
+	}
+
+	// Unordered compares, with a NaN operand, are false for everything but
+	// !=, as in C++.
+	bool compare(Binary* expr, bool when, std::vector<int>& jumps) {
+		TokenType op = expr->op.type;
+		if (op != GREATER && op != GREATER_EQUAL && op != LESS && op != LESS_EQUAL && op != EQUAL_EQUAL && op != BANG_EQUAL) {
+			return false;
+		}
+		operands(expr);
+		switch (op) {
+			case GREATER:
+				a.ucomisd(0, 1);
+				jumps.push_back(a.jcc(when ? COND_A : COND_BE));
+				break;
+			case GREATER_EQUAL:
+				a.ucomisd(0, 1);
+				jumps.push_back(a.jcc(when ? COND_AE : COND_B));
+				break;
+			case LESS:
+				a.ucomisd(1, 0);
+				jumps.push_back(a.jcc(when ? COND_A : COND_BE));
+				break;
+			case LESS_EQUAL:
+				a.ucomisd(1, 0);
+				jumps.push_back(a.jcc(when ? COND_AE : COND_B));
+				break;
+			default: {
+				a.ucomisd(0, 1);
+				bool equal = (op == EQUAL_EQUAL) == when;
+				if (equal) {
+					int skip = a.jcc(COND_P);
+					jumps.push_back(a.jcc(COND_E));
+					a.patch(skip);
+				} else {
+					jumps.push_back(a.jcc(COND_P));
+					jumps.push_back(a.jcc(COND_NE));
+				}
+				break;
+			}
+		}
+		return true;
+	}
+
+	// Whether running stmts always ends in a return, as nil can't be
+	// returned.
+	static bool returns(Span<Stmt*> stmts) {
+		for (auto s : stmts) {
+			if (returns(s)) return true;
+		}
+		return false;
+	}
+
+	static bool returns(Stmt* stmt) {
+		if (dynamic_cast<Return*>(stmt)) return true;
+		if (auto block = dynamic_cast<Block*>(stmt)) return returns(block->stmts);
+		if (auto branch = dynamic_cast<If*>(stmt)) {
+			return branch->else_branch != nullptr && returns(branch->then_branch) && returns(branch->else_branch);
+		}
+		return false;
+	}
+};
+
+void Jit::compile(Fn* fn) {
+	fn->jit = new JitCode();
+	fn->jit->compiling = true;
+	try {
+		JitCompiler compiler(this, globals, fn);
+		std::vector<uint8_t> code = compiler.compile();
+		void* memory = mmap(nullptr, code.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (memory != MAP_FAILED) {
+			memcpy(memory, code.data(), code.size());
+			mprotect(memory, code.size(), PROT_READ | PROT_EXEC);
+			fn->jit->memory = memory;
+			fn->jit->size = code.size();
+			fn->jit->entry = (JitCode::Entry) memory;
+			for (auto& l : fn->jit->loops) {
+				l.entry = (JitCode::Entry) ((char*) memory + (uintptr_t) l.entry);
+			}
+		}
+	} catch (Unsupported&) {
+		fn->jit->loops.clear();
+	}
+	fn->jit->compiling = false;
+}
+
+#else
+
+void Jit::compile(Fn* fn) {}
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef JIT
+#define JIT
+
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+#include "Expr.hpp"
+#include "Stmt.hpp"
+#include "Value.hpp"
+#include "Symbol.hpp"
+
+#if defined(__x86_64__) && defined(__linux__)
+#define JIT_SUPPORTED
+#endif
+
+// Calls plus loop iterations a Fn runs in the tree walker before it is
+// compiled.
+#define JIT_THRESHOLD 1000
+
+struct Fn;
+class Environment;
+
+// Native code for one Fn. Takes the arguments as doubles and returns the
+// result as a double.
+struct JitCode {
+	typedef double (*Entry)(const double* args);
+
+	// Enters the code at the top of a loop with the frame the tree walker
+	// has built so far, taking every slot as a double. The slots of the
+	// locals in scope there have to hold numbers.
+	struct LoopEntry {
+		While* loop;
+		Entry entry;
+		std::vector<int> live;
+	};
+
+	// nullptr while the Fn is being compiled and for good if it can't be.
+	Entry entry;
+	bool compiling;
+	void* memory;
+	size_t size;
+	// Globals the code calls directly, with the Fn each held at compile
+	// time. The code is only run while all of them still do.
+	std::vector<std::pair<Symbol, Fn*>> callees;
+	std::vector<LoopEntry> loops;
+
+	JitCode();
+
+	~JitCode();
+};
+
+// Baseline compiler for Fns that only do double arithmetic on their own
+// locals and call other such Fns. All values stay unboxed in the native
+// frame. Numbers as arguments, and the callees still being in place, are
+// checked once on the way in from the tree walker. Past that nothing in
+// the code can fail or call back into the interpreter. Anything else is
+// left to the tree walker. x86-64 Linux only, a no-op elsewhere.
+class Jit {
+public:
+	Jit(Environment* globals);
+
+	// Runs fn natively if it is compiled, or is hot enough to compile, and
+	// its guards hold. Returns false to have the tree walker run it.
+	bool call(Fn* fn, const std::vector<Value>& arguments, Value& result);
+
+	// Counts a loop iteration in fn, which the tree walker is running with
+	// its locals in frame. Once fn is compiled the rest of the call runs
+	// natively, and result is what it returns.
+	bool back_edge(Fn* fn, While* loop, const Value* frame, Value& result);
+
+private:
+	friend class JitCompiler;
+
+	Environment* globals;
+	std::vector<Fn*> seen;
+	std::vector<double> args;
+
+	void compile(Fn* fn);
+
+	bool is_valid(Fn* fn);
+};
+
+#endif
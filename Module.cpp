@@ -0,0 +1,89 @@
+#include "Module.hpp"
+#include <fstream>
+#include <sstream>
+#include "Error.hpp"
+#include "Obj.hpp"
+#include "Scanner.hpp"
+#include "Parser.hpp"
+#include "Resolver.hpp"
+#include "Optimizer.hpp"
+
+Modules modules;
+
+void Modules::set_main(const std::string& path) {
+	dirs.assign(1, std::filesystem::absolute(path).parent_path());
+}
+
+Module* Modules::enter(const Token& path) {
+	const std::string& name = static_cast<StringObj*>(path.literal.as_obj())->val;
+	std::filesystem::path full = name;
+	if (!dirs.empty()) full = dirs.back() / full;
+	std::error_code ec;
+	std::string canonical = std::filesystem::weakly_canonical(full, ec).string();
+	auto mtime = std::filesystem::last_write_time(canonical, ec);
+	if (ec) throw RuntimeError(path, "Could not open module '" + name + "'");
+
+	auto found = by_path.find(canonical);
+	Module* module;
+	if (found == by_path.end()) {
+		module = load(path, canonical, mtime);
+	} else {
+		module = found->second;
+		if (module->state == ModuleState_RUNNING) return nullptr;
+		if (module->mtime == mtime) {
+			if (module->state == ModuleState_DONE) return nullptr;
+		} else {
+			// The old AST stays, for the functions it made.
+			module = load(path, canonical, mtime);
+		}
+	}
+	module->state = ModuleState_RUNNING;
+	dirs.push_back(std::filesystem::path(canonical).parent_path());
+	return module;
+}
+
+void Modules::leave(Module* module, bool done) {
+	module->state = done ? ModuleState_DONE : ModuleState_NEW;
+	dirs.pop_back();
+}
+
+// Errors in a module report lines in it, so they also name it.
+Module* Modules::load(const Token& path, const std::string& canonical, std::filesystem::file_time_type mtime) {
+	std::ifstream file(canonical);
+	const std::string& name = static_cast<StringObj*>(path.literal.as_obj())->val;
+	if (!file.is_open()) throw RuntimeError(path, "Could not open module '" + name + "'");
+	std::stringstream ss;
+	ss << file.rdbuf();
+
+	loaded.emplace_back();
+	Module& module = loaded.back();
+	module.path = canonical;
+	module.mtime = mtime;
+	module.state = ModuleState_NEW;
+	module.text = ss.str();
+	by_path[canonical] = &module;
+	try {
+		Scanner scanner(module.text);
+		module.tokens = scanner.scan_tokens();
+		Parser parser(module.tokens, module.arena, lazy);
+		module.stmts = parser.parse();
+		if (!lazy) std::vector<Token>().swap(module.tokens);
+		Resolver(module.arena).resolve(module.stmts);
+		module.stmts = Optimizer(module.arena).optimize(module.stmts);
+	} catch (SyntaxError& e) {
+		by_path.erase(canonical);
+		throw SyntaxError(e.line, std::string(e.what()) + " in module '" + name + "'");
+	} catch (RuntimeError& e) {
+		by_path.erase(canonical);
+		throw in_module(path, e);
+	}
+	return &module;
+}
+
+RuntimeError Modules::in_module(const Token& path, const RuntimeError& e) {
+	if (e.in_module) return e;
+	const std::string& name = static_cast<StringObj*>(path.literal.as_obj())->val;
+	RuntimeError named(e.token, std::string(e.what()) + " in module '" + name + "'");
+	named.in_module = true;
+	return named;
+}
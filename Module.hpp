@@ -0,0 +1,88 @@
+#ifndef MODULE
+#define MODULE
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <filesystem>
+#include "Arena.hpp"
+#include "Token.hpp"
+#include "Stmt.hpp"
+#include "Error.hpp"
+
+enum ModuleState { ModuleState_NEW, ModuleState_RUNNING, ModuleState_DONE };
+
+// A file loaded by import, resolved and optimized but not yet run. Like a
+// script's, its text, tokens and arena are kept for the whole process,
+// since functions it defines point into them.
+struct Module {
+	std::string path;
+	std::filesystem::file_time_type mtime;
+	ModuleState state;
+	std::string text;
+	std::vector<Token> tokens;
+	Arena arena;
+	Span<Stmt*> stmts;
+};
+
+// Every module the process has loaded, by canonical path. A module is
+// scanned, parsed, resolved and optimized the first time it is imported,
+// and again only if its file has changed since. Modules share the one
+// global namespace, so importing a module that has already run does
+// nothing, and neither does importing one that is still running, which is
+// how cycles end.
+class Modules {
+public:
+	// Set by main when the tree walker parses bodies lazily.
+	bool lazy = false;
+
+	// Imports in the script at path are relative to its directory. Without
+	// one they are relative to the working directory.
+	void set_main(const std::string& path);
+
+	// The module path names, relative to the module running, loaded and
+	// marked running. Returns null if it should not run again.
+	Module* enter(const Token& path);
+
+	// Pops the directory of the module running. It is marked as run if
+	// done, or left to run again on its next import if an error ended it.
+	void leave(Module* module, bool done);
+
+	// e, raised while loading or running the module path names, with that
+	// module named. An error raised in a module it imports already names
+	// that one, where its line is, so it is returned as it is.
+	static RuntimeError in_module(const Token& path, const RuntimeError& e);
+
+private:
+	std::deque<Module> loaded;
+	std::unordered_map<std::string, Module*> by_path;
+	// The directories of the main script and each module running.
+	std::vector<std::filesystem::path> dirs;
+
+	Module* load(const Token& path, const std::string& canonical, std::filesystem::file_time_type mtime);
+};
+
+extern Modules modules;
+
+// Leaves the module it was made for when it goes out of scope, so an error
+// unwinding out of the module still pops its directory.
+class ModuleRun {
+public:
+	explicit ModuleRun(Module* module) : module(module), done(false) {}
+
+	ModuleRun(const ModuleRun&) = delete;
+
+	ModuleRun& operator=(const ModuleRun&) = delete;
+
+	~ModuleRun() { modules.leave(module, done); }
+
+	// Called once the module's stmts have all run.
+	void finish() { done = true; }
+
+private:
+	Module* module;
+	bool done;
+};
+
+#endif
@@ -5,31 +5,39 @@
 #include <vector>
 #include <unordered_map>
 #include <functional>
+#include <memory>
+#include <cstdint>
+
+// Instance kinds and callables are each kept together so is_instance and
+// is_callable are range checks.
+enum ObjType : uint8_t {
+	OBJ_STRING, OBJ_INSTANCE, OBJ_LIST, OBJ_MAP, OBJ_STRING_BUILDER, OBJ_ENVIRONMENT, OBJ_PROTO, OBJ_UPVALUE, OBJ_BOX,
+	OBJ_FN, OBJ_LAMBDA, OBJ_AOT_FN, OBJ_CLASS, OBJ_CLOSURE, OBJ_BOUND_METHOD, OBJ_NATIVE,
+};
 
+// Base of everything owned by the Heap. obj_type is switched on instead of
+// using RTTI; marked and size are bookkeeping for the collector.
 struct Obj {
-    Obj();
+	ObjType obj_type;
+	bool marked;
+	size_t size;
 
-    std::string to_string();
+    Obj(ObjType obj_type);
 
-    size_t hash();
-    
-    virtual ~Obj() {}
-};
+	bool is_instance() const { return obj_type >= OBJ_INSTANCE && obj_type <= OBJ_STRING_BUILDER; }
 
-struct BoolObj : public Obj {
-    bool val;
-    
-    BoolObj(bool val);
+	bool is_callable() const { return obj_type >= OBJ_FN; }
 
     std::string to_string();
-};
 
-struct DoubleObj : public Obj {
-    double val;
-    
-    DoubleObj(double val);
+	// Marks every object this one references.
+	virtual void trace() {}
 
-    std::string to_string();
+	// Bytes owned outside the object itself, counted towards the next
+	// collection. Must not change after allocation.
+	virtual size_t payload_size() { return 0; }
+    
+    virtual ~Obj() {}
 };
 
 struct StringObj : public Obj {
@@ -37,7 +45,16 @@ struct StringObj : public Obj {
     
     StringObj(std::string val);
 
+    size_t payload_size() override { return val.size(); }
+
+    // Computed on first use, since most strings are never used as keys.
+    size_t hash();
+
     std::string to_string();
+
+private:
+    size_t hash_code;
+    bool hashed;
 };
 
-#endif
\ No newline at end of file
+#endif
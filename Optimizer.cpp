@@ -0,0 +1,300 @@
+#include "Optimizer.hpp"
+
+// Same rules as Interpreter::is_truthy.
+static bool truthy(const Value& val) {
+	if (val.is_nil()) return false;
+	if (val.is_bool()) return val.as_bool();
+	return true;
+}
+
+static Literal* as_literal(Expr* expr) {
+	return dynamic_cast<Literal*>(expr);
+}
+
+Optimizer::Optimizer(Arena& arena) : arena(arena), expr_result(nullptr), stmt_result(nullptr) {}
+
+// Kept statements are compacted in place. Nothing after a return, break or
+// continue in the same list can run.
+Span<Stmt*> Optimizer::optimize(Span<Stmt*> stmts) {
+	uint32_t count = 0;
+	for (auto s : stmts) {
+		Stmt* opt = optimize(s);
+		if (opt == nullptr) continue;
+		stmts[count++] = opt;
+		if (dynamic_cast<Return*>(opt) || dynamic_cast<Break*>(opt) || dynamic_cast<Continue*>(opt)) break;
+	}
+	return Span<Stmt*>(stmts.data, count);
+}
+
+Value Optimizer::visit_literal_expr(Literal* expr) {
+	expr_result = expr;
+	return Value();
+}
+
+// Parentheses only matter to the parser.
+Value Optimizer::visit_grouping_expr(Grouping* expr) {
+	expr_result = optimize(expr->expression);
+	return Value();
+}
+
+Value Optimizer::visit_unary_expr(Unary* expr) {
+	expr->right = optimize(expr->right);
+	expr_result = expr;
+	Literal* right = as_literal(expr->right);
+	if (right == nullptr) return Value();
+	if (expr->op.type == BANG) expr_result = arena.make<Literal>(Value(!truthy(right->val)));
+	else if (expr->op.type == MINUS && right->val.is_number()) {
+		expr_result = arena.make<Literal>(Value(-right->val.as_number()));
+	}
+	return Value();
+}
+
+Value Optimizer::visit_binary_expr(Binary* expr) {
+	expr->left = optimize(expr->left);
+	expr->right = optimize(expr->right);
+	expr_result = expr;
+	Literal* left = as_literal(expr->left);
+	Literal* right = as_literal(expr->right);
+	if (left != nullptr && right != nullptr) {
+		Expr* folded = fold(expr, left->val, right->val);
+		if (folded != nullptr) expr_result = folded;
+		return Value();
+	}
+	// Identities only hold once the other side is known to be a number.
+	// x + 0 is left alone, since -0 + 0 is 0.
+	switch (expr->op.type) {
+		case STAR:
+			if (is_number(expr->right, 1) && is_numeric(expr->left)) expr_result = expr->left;
+			else if (is_number(expr->left, 1) && is_numeric(expr->right)) expr_result = expr->right;
+			break;
+		case SLASH:
+		case STAR_STAR:
+			if (is_number(expr->right, 1) && is_numeric(expr->left)) expr_result = expr->left;
+			break;
+		case MINUS:
+			if (is_number(expr->right, 0) && is_numeric(expr->left)) expr_result = expr->left;
+			break;
+		default:
+			break;
+	}
+	return Value();
+}
+
+Value Optimizer::visit_variable_expr(Variable* expr) {
+	expr_result = expr;
+	return Value();
+}
+
+Value Optimizer::visit_assign_expr(Assign* expr) {
+	expr->val = optimize(expr->val);
+	expr_result = expr;
+	return Value();
+}
+
+Value Optimizer::visit_logical_expr(Logical* expr) {
+	expr->left = optimize(expr->left);
+	Literal* left = as_literal(expr->left);
+	if (left != nullptr) {
+		// The left side decides the result or hands over to the right side.
+		bool short_circuits = expr->op.type == OR ? truthy(left->val) : !truthy(left->val);
+		expr_result = short_circuits ? expr->left : optimize(expr->right);
+		return Value();
+	}
+	expr->right = optimize(expr->right);
+	expr_result = expr;
+	return Value();
+}
+
+Value Optimizer::visit_call_expr(Call* expr) {
+	expr->callee = optimize(expr->callee);
+	for (auto& a : expr->arguments) a = optimize(a);
+	expr_result = expr;
+	return Value();
+}
+
+Value Optimizer::visit_lambda_expr(LambdaExpr* expr) {
+	expr->body = optimize(expr->body);
+	expr_result = expr;
+	return Value();
+}
+
+Value Optimizer::visit_get_expr(Get* expr) {
+	expr->obj = optimize(expr->obj);
+	expr_result = expr;
+	return Value();
+}
+
+Value Optimizer::visit_set_expr(Set* expr) {
+	expr->obj = optimize(expr->obj);
+	expr->val = optimize(expr->val);
+	expr_result = expr;
+	return Value();
+}
+
+Value Optimizer::visit_this_expr(This* expr) {
+	expr_result = expr;
+	return Value();
+}
+
+void Optimizer::visit_expression_stmt(Expression* stmt) {
+	stmt->expression = optimize(stmt->expression);
+	stmt_result = as_literal(stmt->expression) != nullptr ? nullptr : stmt;
+}
+
+void Optimizer::visit_print_stmt(Print* stmt) {
+	stmt->expression = optimize(stmt->expression);
+	stmt_result = stmt;
+}
+
+void Optimizer::visit_var_stmt(Var* stmt) {
+	if (stmt->initializer != nullptr) stmt->initializer = optimize(stmt->initializer);
+	stmt_result = stmt;
+}
+
+void Optimizer::visit_block_stmt(Block* stmt) {
+	stmt->stmts = optimize(stmt->stmts);
+	stmt_result = stmt->stmts.empty() ? nullptr : stmt;
+}
+
+void Optimizer::visit_if_stmt(If* stmt) {
+	stmt->condition = optimize(stmt->condition);
+	Literal* condition = as_literal(stmt->condition);
+	if (condition != nullptr) {
+		Stmt* taken = truthy(condition->val) ? stmt->then_branch : stmt->else_branch;
+		stmt_result = taken != nullptr ? optimize(taken) : nullptr;
+		return;
+	}
+	stmt->then_branch = optimize_branch(stmt->then_branch);
+	if (stmt->else_branch != nullptr) stmt->else_branch = optimize(stmt->else_branch);
+	stmt_result = stmt;
+}
+
+// A constant true condition is dropped, which both engines treat as
+// looping until a break or return.
+void Optimizer::visit_while_stmt(While* stmt) {
+	if (stmt->condition != nullptr) {
+		stmt->condition = optimize(stmt->condition);
+		Literal* condition = as_literal(stmt->condition);
+		if (condition != nullptr) {
+			if (!truthy(condition->val)) {
+				stmt_result = nullptr;
+				return;
+			}
+			stmt->condition = nullptr;
+		}
+	}
+	stmt->body = optimize_branch(stmt->body);
+	if (stmt->increment != nullptr) stmt->increment = optimize(stmt->increment);
+	stmt_result = stmt;
+}
+
+void Optimizer::visit_fn_stmt(FnStmt* stmt) {
+	stmt->body = optimize(stmt->body);
+	stmt_result = stmt;
+}
+
+void Optimizer::visit_return_stmt(Return* stmt) {
+	if (stmt->val != nullptr) stmt->val = optimize(stmt->val);
+	stmt_result = stmt;
+}
+
+void Optimizer::visit_break_stmt(Break* stmt) {
+	stmt_result = stmt;
+}
+
+void Optimizer::visit_continue_stmt(Continue* stmt) {
+	stmt_result = stmt;
+}
+
+void Optimizer::visit_class_stmt(ClassStmt* stmt) {
+	for (auto m : stmt->methods) m->body = optimize(m->body);
+	stmt_result = stmt;
+}
+
+void Optimizer::visit_import_stmt(Import* stmt) {
+	stmt_result = stmt;
+}
+
+Expr* Optimizer::optimize(Expr* expr) {
+	expr->accept(this);
+	return expr_result;
+}
+
+Stmt* Optimizer::optimize(Stmt* stmt) {
+	stmt->accept(this);
+	return stmt_result;
+}
+
+// For the branches of if and while, which can't be left empty.
+Stmt* Optimizer::optimize_branch(Stmt* stmt) {
+	Stmt* opt = optimize(stmt);
+	return opt != nullptr ? opt : arena.make<Block>(Span<Stmt*>());
+}
+
+// Evaluates an operator on two literals the way Interpreter does. Returns
+// nullptr for anything that would throw, so the error is left to runtime.
+Expr* Optimizer::fold(Binary* expr, const Value& left, const Value& right) {
+	if (left.is_nil() || right.is_nil()) return nullptr;
+	TokenType op = expr->op.type;
+	if (op == EQUAL_EQUAL || op == BANG_EQUAL) {
+		bool equal = false;
+		if (left.is_bool() && right.is_bool()) equal = left.as_bool() == right.as_bool();
+		else if (left.is_number() && right.is_number()) equal = left.as_number() == right.as_number();
+		else if (left.is_string() && right.is_string()) equal = left.key_equals(right);
+		return arena.make<Literal>(Value(op == EQUAL_EQUAL ? equal : !equal));
+	}
+	if (op == PLUS && left.is_string() && right.is_string()) {
+		std::string joined = static_cast<StringObj*>(left.as_obj())->val + static_cast<StringObj*>(right.as_obj())->val;
+		return arena.make<Literal>(Value(symbols.string(symbols.intern(joined))));
+	}
+	if (!left.is_number() || !right.is_number()) return nullptr;
+	double a = left.as_number();
+	double b = right.as_number();
+	switch (op) {
+		case GREATER: return arena.make<Literal>(Value(a > b));
+		case GREATER_EQUAL: return arena.make<Literal>(Value(a >= b));
+		case LESS: return arena.make<Literal>(Value(a < b));
+		case LESS_EQUAL: return arena.make<Literal>(Value(a <= b));
+		case PLUS: return arena.make<Literal>(Value(a + b));
+		case MINUS: return arena.make<Literal>(Value(a - b));
+		case SLASH: return arena.make<Literal>(Value(a / b));
+		case STAR: return arena.make<Literal>(Value(a * b));
+		case STAR_STAR: return arena.make<Literal>(Value(pow(a, b)));
+		// Integer division by zero traps, so it is left to happen at runtime.
+		case MOD:
+			if ((long) b == 0) return nullptr;
+			return arena.make<Literal>(Value((double) ((long) a % (long) b)));
+		case SLASH_SLASH:
+			if ((long) b == 0) return nullptr;
+			return arena.make<Literal>(Value((double) ((long) a / (long) b)));
+		default:
+			return nullptr;
+	}
+}
+
+// Whether expr can only evaluate to a number, if it doesn't throw.
+bool Optimizer::is_numeric(Expr* expr) {
+	if (Literal* literal = as_literal(expr)) return literal->val.is_number();
+	if (Unary* unary = dynamic_cast<Unary*>(expr)) return unary->op.type == MINUS;
+	if (Binary* binary = dynamic_cast<Binary*>(expr)) {
+		switch (binary->op.type) {
+			case MINUS:
+			case SLASH:
+			case STAR:
+			case MOD:
+			case STAR_STAR:
+			case SLASH_SLASH:
+				return true;
+			case PLUS:
+				return is_numeric(binary->left) && is_numeric(binary->right);
+			default:
+				return false;
+		}
+	}
+	return false;
+}
+
+bool Optimizer::is_number(Expr* expr, double val) {
+	Literal* literal = as_literal(expr);
+	return literal != nullptr && literal->val.is_number() && literal->val.as_number() == val;
+}
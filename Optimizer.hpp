@@ -0,0 +1,90 @@
+#ifndef OPTIMIZER
+#define OPTIMIZER
+
+#include <vector>
+#include <string>
+#include <math.h>
+#include "Expr.hpp"
+#include "Stmt.hpp"
+#include "Value.hpp"
+#include "Symbol.hpp"
+
+// Rewrites a resolved AST before it runs. Folds constant subexpressions,
+// drops branches and statements that can never run, and simplifies numeric
+// identities such as x * 1. Anything that could throw is left alone, so
+// errors still happen at runtime, on the same line.
+class Optimizer : Expr::Visitor, Stmt::Visitor {
+public:
+	Optimizer(Arena& arena);
+
+	Span<Stmt*> optimize(Span<Stmt*> stmts);
+
+	Value visit_literal_expr(Literal* expr) override;
+
+	Value visit_grouping_expr(Grouping* expr) override;
+
+	Value visit_unary_expr(Unary* expr) override;
+
+	Value visit_binary_expr(Binary* expr) override;
+
+	Value visit_variable_expr(Variable* expr) override;
+
+	Value visit_assign_expr(Assign* expr) override;
+
+	Value visit_logical_expr(Logical* expr) override;
+
+	Value visit_call_expr(Call* expr) override;
+
+	Value visit_lambda_expr(LambdaExpr* expr) override;
+
+	Value visit_get_expr(Get* expr) override;
+
+	Value visit_set_expr(Set* expr) override;
+
+	Value visit_this_expr(This* expr) override;
+
+	void visit_expression_stmt(Expression* stmt) override;
+
+	void visit_print_stmt(Print* stmt) override;
+
+	void visit_var_stmt(Var* stmt) override;
+
+	void visit_block_stmt(Block* stmt) override;
+
+	void visit_if_stmt(If* stmt) override;
+
+	void visit_while_stmt(While* stmt) override;
+
+	void visit_fn_stmt(FnStmt* stmt) override;
+
+	void visit_return_stmt(Return* stmt) override;
+
+	void visit_break_stmt(Break* stmt) override;
+
+	void visit_continue_stmt(Continue* stmt) override;
+
+	void visit_class_stmt(ClassStmt* stmt) override;
+
+	void visit_import_stmt(Import* stmt) override;
+
+private:
+	Arena& arena;
+	// What the node being visited is replaced with. A null statement is
+	// removed.
+	Expr* expr_result;
+	Stmt* stmt_result;
+
+	Expr* optimize(Expr* expr);
+
+	Stmt* optimize(Stmt* stmt);
+
+	Stmt* optimize_branch(Stmt* stmt);
+
+	Expr* fold(Binary* expr, const Value& left, const Value& right);
+
+	bool is_numeric(Expr* expr);
+
+	bool is_number(Expr* expr, double val);
+};
+
+#endif
@@ -0,0 +1,179 @@
+#include "ParallelParser.hpp"
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
+#include <time.h>
+#include "Parser.hpp"
+
+// Below this a part costs more to hand to a thread than to parse.
+static const size_t MIN_PART_BYTES = 1 << 16;
+
+static double wall_seconds() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static double thread_seconds() {
+#if defined(__unix__) || defined(__APPLE__)
+	timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+#else
+	return 0;
+#endif
+}
+
+ParallelParser::Part::Part(std::string_view source, int line)
+	: scanner(source, line, true), failed(false), scan_time(0), parse_time(0) {}
+
+ParallelParser::ParallelParser(std::string_view source, int num_threads)
+	: split_time(0), scan_time(0), intern_time(0), parse_time(0) {
+	int num_parts = std::min<size_t>(num_threads, source.size() / MIN_PART_BYTES);
+	if (num_parts < 2) return;
+	double start = wall_seconds();
+	split(source, num_parts);
+	split_time = wall_seconds() - start;
+}
+
+bool ParallelParser::parse(Arena& arena, std::vector<Arena>& arenas, Span<Stmt*>& stmts) {
+	if (parts.size() < 2) return false;
+	double start = wall_seconds();
+	run([this](Part& part) { scan(part); });
+	scan_time = wall_seconds() - start;
+	for (auto& part : parts) {
+		if (part.failed) return false;
+	}
+
+	start = wall_seconds();
+	for (auto& part : parts) part.scanner.intern();
+	intern_time = wall_seconds() - start;
+
+	start = wall_seconds();
+	run([this](Part& part) { parse(part); });
+	parse_time = wall_seconds() - start;
+	for (auto& part : parts) {
+		if (part.failed) return false;
+	}
+
+	std::vector<Stmt*> all;
+	for (auto& part : parts) {
+		all.insert(all.end(), part.stmts.begin(), part.stmts.end());
+		arenas.push_back(std::move(part.arena));
+	}
+	stmts = arena.copy(all);
+	return true;
+}
+
+void ParallelParser::report(std::ostream& out) {
+	double busiest_scan = 0;
+	double busiest_parse = 0;
+	for (auto& part : parts) {
+		busiest_scan = std::max(busiest_scan, part.scan_time);
+		busiest_parse = std::max(busiest_parse, part.parse_time);
+	}
+	out << "[parse] parts: " << parts.size()
+		<< ", split ms: " << split_time * 1000
+		<< ", scan ms: " << scan_time * 1000
+		<< ", intern ms: " << intern_time * 1000
+		<< ", parse ms: " << parse_time * 1000
+		<< ", busiest part scan cpu ms: " << busiest_scan * 1000
+		<< ", parse cpu ms: " << busiest_parse * 1000 << '\n';
+}
+
+// Whether the text at i starts a new declaration rather than carrying on
+// the one before: a name or keyword, other than those that can follow a
+// block or a lambda's body.
+static bool starts_declaration(std::string_view source, size_t i) {
+	while (i < source.size()) {
+		char c = source[i];
+		if (c == '#') {
+			while (i < source.size() && source[i] != '\n') i++;
+		} else if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+			i++;
+		} else {
+			break;
+		}
+	}
+	size_t end = i;
+	while (end < source.size() && (isalnum((unsigned char) source[end]) || source[end] == '_')) end++;
+	if (end == i || isdigit((unsigned char) source[i])) return false;
+	std::string_view word = source.substr(i, end - i);
+	return word != "else" && word != "and" && word != "or";
+}
+
+// Parts end after a ';' or '}' outside any bracket, once they are long
+// enough. A split in the wrong place can only make a part fail to parse, and
+// then the sequential front end runs, so this only has to agree with the
+// Scanner on strings and comments.
+void ParallelParser::split(std::string_view source, int num_parts) {
+	size_t target = source.size() / num_parts;
+	size_t begin = 0;
+	int begin_line = 1;
+	int line = 1;
+	int depth = 0;
+	parts.reserve(num_parts);
+	for (size_t i = 0; i < source.size(); i++) {
+		char c = source[i];
+		switch (c) {
+			case '\n': line++; break;
+			case '#':
+				while (i + 1 < source.size() && source[i + 1] != '\n') i++;
+				break;
+			case '"':
+			case '\'': {
+				size_t end = source.find(c, i + 1);
+				if (end == std::string_view::npos) end = source.size();
+				line += std::count(source.begin() + i, source.begin() + end, '\n');
+				i = end;
+				break;
+			}
+			case '(':
+			case '[':
+			case '{': depth++; break;
+			case ')':
+			case ']': depth--; break;
+			case '}':
+			case ';':
+				if (c == '}') depth--;
+				if (depth == 0 && i + 1 - begin >= target && (int) parts.size() + 1 < num_parts && starts_declaration(source, i + 1)) {
+					parts.emplace_back(source.substr(begin, i + 1 - begin), begin_line);
+					begin = i + 1;
+					begin_line = line;
+				}
+				break;
+		}
+	}
+	parts.emplace_back(source.substr(begin), begin_line);
+}
+
+void ParallelParser::scan(Part& part) {
+	double start = thread_seconds();
+	try {
+		part.tokens = part.scanner.scan_tokens();
+	} catch (std::runtime_error&) {
+		part.failed = true;
+	}
+	part.scan_time = thread_seconds() - start;
+}
+
+void ParallelParser::parse(Part& part) {
+	double start = thread_seconds();
+	try {
+		part.scanner.bind(part.tokens);
+		Parser parser(part.tokens, part.arena);
+		part.stmts = parser.parse();
+	} catch (std::runtime_error&) {
+		part.failed = true;
+	}
+	std::vector<Token>().swap(part.tokens);
+	part.parse_time = thread_seconds() - start;
+}
+
+template <typename F>
+void ParallelParser::run(F work) {
+	std::vector<std::thread> threads;
+	for (size_t i = 1; i < parts.size(); i++) threads.emplace_back(work, std::ref(parts[i]));
+	work(parts[0]);
+	for (auto& t : threads) t.join();
+}
@@ -0,0 +1,62 @@
+#ifndef PARALLEL_PARSER
+#define PARALLEL_PARSER
+
+#include <string_view>
+#include <vector>
+#include <ostream>
+#include "Arena.hpp"
+#include "Token.hpp"
+#include "Stmt.hpp"
+#include "Scanner.hpp"
+
+// Scans and parses a source on several threads, for --parse-threads. A
+// cheap pass over the text splits it into parts at top level declarations,
+// skipping strings and comments and counting brackets. Each part is scanned
+// and parsed on its own thread into its own arena, and the statements are
+// joined in order. The symbol table and the heap are only touched on the
+// main thread, between the scan and the parse.
+class ParallelParser {
+public:
+	ParallelParser(std::string_view source, int num_threads);
+
+	// Returns false if the source is too small to split, or if any part
+	// fails to scan or parse. The sequential front end then runs instead,
+	// which reports any error exactly as it always has. The parts' arenas
+	// are moved into arenas, which have to be kept as long as the AST.
+	bool parse(Arena& arena, std::vector<Arena>& arenas, Span<Stmt*>& stmts);
+
+	void report(std::ostream& out);
+
+private:
+	struct Part {
+		Scanner scanner;
+		std::vector<Token> tokens;
+		Arena arena;
+		Span<Stmt*> stmts;
+		bool failed;
+		// Thread CPU seconds spent scanning and parsing.
+		double scan_time;
+		double parse_time;
+
+		Part(std::string_view source, int line);
+	};
+
+	std::vector<Part> parts;
+	// Wall clock seconds for each phase.
+	double split_time;
+	double scan_time;
+	double intern_time;
+	double parse_time;
+
+	void split(std::string_view source, int num_parts);
+
+	void scan(Part& part);
+
+	void parse(Part& part);
+
+	// Runs work on every part, one thread each, the first on this one.
+	template <typename F>
+	void run(F work);
+};
+
+#endif
@@ -1,42 +1,69 @@
 
 #include "Parser.hpp"
 
-Parser::Parser(std::vector<std::shared_ptr<Token>> tokens) : tokens(tokens), curr(0) {}
+Parser::Parser(const std::vector<Token>& tokens, Arena& arena, bool lazy)
+	: tokens(tokens), arena(arena), scanner(nullptr), lazy(lazy), depth(0), functions(0), curr(0) {}
 
-std::vector<std::shared_ptr<Stmt>> Parser::parse() {
-	std::vector<std::shared_ptr<Stmt>> stmts;
+Parser::Parser(Scanner& scanner, Arena& arena)
+	: tokens(window), arena(arena), scanner(&scanner), lazy(false), depth(0), functions(0), curr(0) {}
+
+Span<Stmt*> Parser::parse() {
+	std::vector<Stmt*> stmts;
 	while (!is_at_end()) stmts.push_back(declaration());
-	return stmts;
+	return arena.copy(stmts);
+}
+
+Stmt* Parser::next() {
+	window.erase(window.begin(), window.begin() + curr);
+	curr = 0;
+	if (window.empty()) window.push_back(scanner->scan_next());
+	if (is_at_end()) return nullptr;
+	return declaration();
 }
 
-std::shared_ptr<Stmt> Parser::declaration() {
+Span<Stmt*> Parser::parse_body(const LazyBody& body) {
+	curr = body.start;
+	return block();
+}
+
+Stmt* Parser::declaration() {
 	if (match(CLASS)) return class_declaration();
 	if (match(LET)) return var_declaration();
 	if (match(FN)) return fn_declaration("fn");
+	if (match(IMPORT)) return import_declaration();
 	return stmt();
 }
 
-std::shared_ptr<Stmt> Parser::class_declaration() {
-	std::shared_ptr<Token> name = consume(IDENTIFIER, "Expect class name");
+Stmt* Parser::class_declaration() {
+	Token name = consume(IDENTIFIER, "Expect class name");
+	functions++;
 	consume(LEFT_BRACE, "Expect '{' before class body");
-	std::vector<std::shared_ptr<FnStmt>> methods;
+	std::vector<FnStmt*> methods;
 	while (!check(RIGHT_BRACE)) methods.push_back(fn_declaration("method"));
 	consume(RIGHT_BRACE, "Expect '}' after class body");
-	return std::make_shared<ClassStmt>(name, methods);
+	return arena.make<ClassStmt>(name, arena.copy(methods));
 }
 
-std::shared_ptr<Stmt> Parser::var_declaration() {
-	std::shared_ptr<Token> name = consume(IDENTIFIER, "Expect variable name");
-	std::shared_ptr<Expr> initializer = nullptr;
+Stmt* Parser::var_declaration() {
+	Token name = consume(IDENTIFIER, "Expect variable name");
+	Expr* initializer = nullptr;
 	if (match(EQUAL)) initializer = expression();
 	consume(SEMICOLON, "Expect ';' after variable declaration");
-	return std::make_shared<Var>(name, initializer);
+	return arena.make<Var>(name, initializer);
 }
 
-std::shared_ptr<FnStmt> Parser::fn_declaration(std::string kind) {
-	std::shared_ptr<Token> name = consume(IDENTIFIER, "Expect " + kind + " name");
+Stmt* Parser::import_declaration() {
+	Token keyword = prev();
+	Token path = consume(STRING, "Expect module path after 'import'");
+	consume(SEMICOLON, "Expect ';' after import");
+	return arena.make<Import>(keyword, path);
+}
+
+FnStmt* Parser::fn_declaration(std::string kind) {
+	Token name = consume(IDENTIFIER, "Expect " + kind + " name");
+	functions++;
 	consume(LEFT_PAREN, "Expect '(' after " + kind + " name");
-	std::vector<std::shared_ptr<Token>> params;
+	std::vector<Token> params;
 	if (!check(RIGHT_PAREN)) {
 		do {
 			params.push_back(consume(IDENTIFIER, "Expect parameter name"));
@@ -44,109 +71,137 @@ std::shared_ptr<FnStmt> Parser::fn_declaration(std::string kind) {
 	}
 	consume(RIGHT_PAREN, "Expect ')' after parameters");
 	consume(LEFT_BRACE, "Expect '{' before " + kind + " body");
-	std::vector<std::shared_ptr<Stmt>> body = block();
-	return std::make_shared<FnStmt>(name, params, body);
+	if (lazy && depth == 0) {
+		return arena.make<FnStmt>(name, arena.copy(params), Span<Stmt*>(), skip_body(kind == "method"));
+	}
+	Span<Stmt*> body = block();
+	return arena.make<FnStmt>(name, arena.copy(params), body);
 }
 
-std::shared_ptr<Stmt> Parser::stmt() {
+Stmt* Parser::stmt() {
 	if (match(FOR)) return for_stmt();
 	if (match(IF)) return if_stmt();
 	if (match(PRINT)) return print_stmt();
 	if (match(RETURN)) return return_stmt();
 	if (match(WHILE)) return while_stmt();
-	if (match(LEFT_BRACE)) return std::make_shared<Block>(block());
+	if (match(BREAK)) return break_stmt();
+	if (match(CONTINUE)) return continue_stmt();
+	if (match(LEFT_BRACE)) return arena.make<Block>(block());
 	return expr_stmt();
 }
 
-std::shared_ptr<Stmt> Parser::for_stmt() {
+// The initializer is scoped to the loop, which counts as a block.
+Stmt* Parser::for_stmt() {
 	consume(LEFT_PAREN, "Expect '(' after 'for'");
-	
-	std::shared_ptr<Stmt> initializer;
+	depth++;
+
+	Stmt* initializer;
 	if (match(SEMICOLON)) initializer = nullptr;
 	else if (match(LET)) initializer = var_declaration();
 	else initializer = expr_stmt();
 
-	std::shared_ptr<Expr> condition = nullptr;
+	Expr* condition = nullptr;
 	if (!check(SEMICOLON)) condition = expression();
-	else condition = std::make_shared<Literal>(std::make_shared<BoolObj>(true));
+	else condition = arena.make<Literal>(Value(true));
 	consume(SEMICOLON, "Expect ';' after for loop condition");
 
-	std::shared_ptr<Expr> increment = nullptr;
+	Expr* increment = nullptr;
 	if (!check(RIGHT_PAREN)) increment = expression();
 	consume(RIGHT_PAREN, "Expect ')' after for clauses");
 
-	std::shared_ptr<Stmt> body = stmt();
-
-	if (increment != nullptr) {
-		body = std::make_shared<Block>(std::vector<std::shared_ptr<Stmt>> {
-			body, std::make_shared<Expression>(increment)
-		});
-	}
-
-	body = std::make_shared<While>(condition, body);
+	Stmt* body = arena.make<While>(condition, stmt(), increment);
+	depth--;
 	
 	if (initializer != nullptr) {
-		body = std::make_shared<Block>(std::vector<std::shared_ptr<Stmt>> {
+		body = arena.make<Block>(arena.copy(std::vector<Stmt*> {
 			initializer, body
-		});
+		}));
 	}
 	
 	return body;
 }
 
-std::shared_ptr<Stmt> Parser::if_stmt() {
+Stmt* Parser::if_stmt() {
 	consume(LEFT_PAREN, "Expect '(' after 'if'");
-	std::shared_ptr<Expr> condition = expression();
+	Expr* condition = expression();
 	consume(RIGHT_PAREN, "Expect ')' after if contidion");
-	std::shared_ptr<Stmt> then_branch = stmt();
-	std::shared_ptr<Stmt> else_branch = nullptr;
+	Stmt* then_branch = stmt();
+	Stmt* else_branch = nullptr;
 	if (match(ELSE)) else_branch = stmt();
-	return std::make_shared<If>(condition, then_branch, else_branch);
+	return arena.make<If>(condition, then_branch, else_branch);
 }
 
-std::shared_ptr<Stmt> Parser::print_stmt() {
-	std::shared_ptr<Expr> val = expression();
+Stmt* Parser::print_stmt() {
+	Expr* val = expression();
 	consume(SEMICOLON, "Expect ';' after value");
-	return std::make_shared<Print>(val);
+	return arena.make<Print>(val);
 }
 
-std::shared_ptr<Stmt> Parser::return_stmt() {
-	std::shared_ptr<Token> keyword = prev();
-	std::shared_ptr<Expr> val = nullptr;
+Stmt* Parser::return_stmt() {
+	Token keyword = prev();
+	Expr* val = nullptr;
 	if (!check(SEMICOLON)) val = expression();
 	consume(SEMICOLON, "Expect ';' after return expression");
-	return std::make_shared<Return>(keyword, val);
+	return arena.make<Return>(keyword, val);
 }
 
-std::shared_ptr<Stmt> Parser::while_stmt() {
+Stmt* Parser::while_stmt() {
 	consume(LEFT_PAREN, "Expect '(' after 'while'");
-	std::shared_ptr<Expr> condition = expression();
+	Expr* condition = expression();
 	consume(RIGHT_PAREN, "Expect ')' after condition");
-	std::shared_ptr<Stmt> body = stmt();
-	return std::make_shared<While>(condition, body);
+	Stmt* body = stmt();
+	return arena.make<While>(condition, body);
+}
+
+Stmt* Parser::break_stmt() {
+	Token keyword = prev();
+	consume(SEMICOLON, "Expect ';' after 'break'");
+	return arena.make<Break>(keyword);
+}
+
+Stmt* Parser::continue_stmt() {
+	Token keyword = prev();
+	consume(SEMICOLON, "Expect ';' after 'continue'");
+	return arena.make<Continue>(keyword);
 }
 
-std::vector<std::shared_ptr<Stmt>> Parser::block() {
-	std::vector<std::shared_ptr<Stmt>> stmts;
+Span<Stmt*> Parser::block() {
+	std::vector<Stmt*> stmts;
+	depth++;
 	while (!check(RIGHT_BRACE) && !is_at_end()) stmts.push_back(declaration());
+	depth--;
 	consume(RIGHT_BRACE, "Expect '}' after block");
-	return stmts;
+	return arena.copy(stmts);
+}
+
+// Moves past a body by matching braces, just after its '{'. Anything
+// else wrong with the body is reported once it is parsed.
+LazyBody* Parser::skip_body(bool is_method) {
+	int start = curr;
+	for (int open = 1; open > 0;) {
+		if (is_at_end()) throw RuntimeError(peek(), "Expect '}' after block");
+		TokenType type = advance().type;
+		if (type == LEFT_BRACE) open++;
+		else if (type == RIGHT_BRACE) open--;
+	}
+	return arena.make<LazyBody>(LazyBody { &tokens, &arena, start, is_method });
 }
 
-std::shared_ptr<Stmt> Parser::expr_stmt() {
-	std::shared_ptr<Expr> expr = expression();
+Stmt* Parser::expr_stmt() {
+	Expr* expr = expression();
 	consume(SEMICOLON, "Expect ';' after value");
-	return std::make_shared<Expression>(expr);
+	return arena.make<Expression>(expr);
 }
 
-std::shared_ptr<Expr> Parser::expression() {
+Expr* Parser::expression() {
 	return lambda_expr();
 }
 
-std::shared_ptr<Expr> Parser::lambda_expr() {
+Expr* Parser::lambda_expr() {
 	if (match(FN)) {
+		functions++;
 		consume(LEFT_PAREN, "Expect '(' after anonymous fn");
-		std::vector<std::shared_ptr<Token>> params;
+		std::vector<Token> params;
 		if (!check(RIGHT_PAREN)) {
 			do {
 				params.push_back(consume(IDENTIFIER, "Expect parameter name"));
@@ -154,21 +209,24 @@ std::shared_ptr<Expr> Parser::lambda_expr() {
 		}
 		consume(RIGHT_PAREN, "Expect ')' after parameeters");
 		consume(LEFT_BRACE, "Expect '{' before fn body.");
-		std::vector<std::shared_ptr<Stmt>> body = block();
-		return std::make_shared<LambdaExpr>(params, body);
+		if (lazy && depth == 0) {
+			return arena.make<LambdaExpr>(arena.copy(params), Span<Stmt*>(), skip_body(false));
+		}
+		Span<Stmt*> body = block();
+		return arena.make<LambdaExpr>(arena.copy(params), body);
 	}
 	return assignment();
 }
 
-std::shared_ptr<Expr> Parser::assignment() {
+Expr* Parser::assignment() {
 	auto expr = logical_or();
 	if (match(EQUAL)) {
-		auto equals = prev();
+		Token equals = prev();
 		auto val = assignment();
-		if (auto variable = std::dynamic_pointer_cast<Variable>(expr)) {
-			return std::make_shared<Assign>(variable->name, val);
-		} else if (auto get = std::dynamic_pointer_cast<Get>(expr)) {
-			return std::make_shared<Set>(get->obj, get->name, val);
+		if (auto variable = dynamic_cast<Variable*>(expr)) {
+			return arena.make<Assign>(variable->name, val);
+		} else if (auto get = dynamic_cast<Get*>(expr)) {
+			return arena.make<Set>(get->obj, get->name, val);
 		}
 		throw RuntimeError(equals, "Invalid assignment target");
 	} else if (match(PLUS_EQUAL, MINUS_EQUAL, STAR_EQUAL, SLASH_EQUAL, SLASH_SLASH_EQUAL, MOD_EQUAL)) {
@@ -178,112 +236,113 @@ std::shared_ptr<Expr> Parser::assignment() {
 	}
 }
 
-std::shared_ptr<Expr> Parser::op_assignment(std::shared_ptr<Expr> expr, std::shared_ptr<Token> op) {
+Expr* Parser::op_assignment(Expr* expr, Token op) {
 	auto val = assignment();
-	std::shared_ptr<Token> binary_op;
-	switch (op->type) {
-		case PLUS_EQUAL: binary_op = std::make_shared<Token>(PLUS, "+", nullptr, op->line); break;
-		case MINUS_EQUAL: binary_op = std::make_shared<Token>(MINUS, "-", nullptr, op->line); break;
-		case STAR_EQUAL: binary_op = std::make_shared<Token>(STAR, "*", nullptr, op->line); break;
-		case SLASH_EQUAL: binary_op = std::make_shared<Token>(SLASH, "/", nullptr, op->line); break;
-		case SLASH_SLASH_EQUAL: binary_op = std::make_shared<Token>(SLASH_SLASH, "//", nullptr, op->line); break;
-		case MOD_EQUAL: binary_op = std::make_shared<Token>(MOD, "%", nullptr, op->line); break;
+	Token binary_op { _EOF, "", Value(), op.line };
+	switch (op.type) {
+		case PLUS_EQUAL: binary_op.type = PLUS; binary_op.lexeme = "+"; break;
+		case MINUS_EQUAL: binary_op.type = MINUS; binary_op.lexeme = "-"; break;
+		case STAR_EQUAL: binary_op.type = STAR; binary_op.lexeme = "*"; break;
+		case SLASH_EQUAL: binary_op.type = SLASH; binary_op.lexeme = "/"; break;
+		case SLASH_SLASH_EQUAL: binary_op.type = SLASH_SLASH; binary_op.lexeme = "//"; break;
+		case MOD_EQUAL: binary_op.type = MOD; binary_op.lexeme = "%"; break;
+		default: break;
 	}
-	if (auto variable = std::dynamic_pointer_cast<Variable>(expr)) {
-		return std::make_shared<Assign>(variable->name, std::make_shared<Binary>(expr, binary_op, val));
-	} else if (auto get = std::dynamic_pointer_cast<Get>(expr)) {
-		return std::make_shared<Set>(get->obj, get->name, std::make_shared<Binary>(expr, binary_op, val));
+	if (auto variable = dynamic_cast<Variable*>(expr)) {
+		return arena.make<Assign>(variable->name, arena.make<Binary>(expr, binary_op, val));
+	} else if (auto get = dynamic_cast<Get*>(expr)) {
+		return arena.make<Set>(get->obj, get->name, arena.make<Binary>(expr, binary_op, val));
 	}
 	throw RuntimeError(op, "Invalid assignment target");
 }
 
-std::shared_ptr<Expr> Parser::logical_or() {
-	std::shared_ptr<Expr> expr = logical_and();
+Expr* Parser::logical_or() {
+	Expr* expr = logical_and();
 	while (match(OR)) {
-		std::shared_ptr<Token> op = prev();
-		std::shared_ptr<Expr> right = logical_and();
-		expr = std::make_shared<Logical>(expr, op, right);
+		Token op = prev();
+		Expr* right = logical_and();
+		expr = arena.make<Logical>(expr, op, right);
 	}
 	return expr;
 }
 
-std::shared_ptr<Expr> Parser::logical_and() {
-	std::shared_ptr<Expr> expr = equality();
+Expr* Parser::logical_and() {
+	Expr* expr = equality();
 	while (match(AND)) {
-		std::shared_ptr<Token> op = prev();
-		std::shared_ptr<Expr> right = equality();
-		expr = std::make_shared<Logical>(expr, op, right);
+		Token op = prev();
+		Expr* right = equality();
+		expr = arena.make<Logical>(expr, op, right);
 	}
 	return expr;
 }
 
-std::shared_ptr<Expr> Parser::equality() {
-	std::shared_ptr<Expr> expr = comparison();
+Expr* Parser::equality() {
+	Expr* expr = comparison();
 	while (match(BANG_EQUAL, EQUAL_EQUAL)) {
-		std::shared_ptr<Token> op = prev();
-		std::shared_ptr<Expr> right = comparison();
-		expr = std::make_shared<Binary>(expr, op, right);
+		Token op = prev();
+		Expr* right = comparison();
+		expr = arena.make<Binary>(expr, op, right);
 	}
 	return expr;
 }
 
-std::shared_ptr<Expr> Parser::comparison() {
-	std::shared_ptr<Expr> expr = term();
+Expr* Parser::comparison() {
+	Expr* expr = term();
 	while (match(GREATER, GREATER_EQUAL, LESS, LESS_EQUAL)) {
-		std::shared_ptr<Token> op = prev();
-		std::shared_ptr<Expr> right = term();
-		expr = std::make_shared<Binary>(expr, op, right);
+		Token op = prev();
+		Expr* right = term();
+		expr = arena.make<Binary>(expr, op, right);
 	}
 	return expr;
 }
 
-std::shared_ptr<Expr> Parser::term() {
-	std::shared_ptr<Expr> expr = factor();
+Expr* Parser::term() {
+	Expr* expr = factor();
 	while (match(MINUS, PLUS)) {
-		std::shared_ptr<Token> op = prev();
-		std::shared_ptr<Expr> right = factor();
-		expr = std::make_shared<Binary>(expr, op, right);
+		Token op = prev();
+		Expr* right = factor();
+		expr = arena.make<Binary>(expr, op, right);
 	}
 	return expr;
 }
 
-std::shared_ptr<Expr> Parser::factor() {
-	std::shared_ptr<Expr> expr = exponent();
+Expr* Parser::factor() {
+	Expr* expr = exponent();
 	while (match(SLASH, STAR, MOD, SLASH_SLASH)) {
-		std::shared_ptr<Token> op = prev();
-		std::shared_ptr<Expr> right = exponent();
-		expr = std::make_shared<Binary>(expr, op, right);
+		Token op = prev();
+		Expr* right = exponent();
+		expr = arena.make<Binary>(expr, op, right);
 	}
 	return expr;
 }
 
-std::shared_ptr<Expr> Parser::exponent() {
-	std::shared_ptr<Expr> expr = unary();
+Expr* Parser::exponent() {
+	Expr* expr = unary();
 	while (match(STAR_STAR)) {
-		std::shared_ptr<Token> op = prev();
-		std::shared_ptr<Expr> right = unary();
-		expr = std::make_shared<Binary>(expr, op, right);
+		Token op = prev();
+		Expr* right = unary();
+		expr = arena.make<Binary>(expr, op, right);
 	}
 	return expr;
 }
 
-std::shared_ptr<Expr> Parser::unary() {
+Expr* Parser::unary() {
 	if (match(BANG, MINUS)) {
-		std::shared_ptr<Token> op = prev();
-		std::shared_ptr<Expr> right = unary();
-		return std::make_shared<Unary>(op, right);
+		Token op = prev();
+		Expr* right = unary();
+		return arena.make<Unary>(op, right);
 	}
 	return call();
 }
 
-std::shared_ptr<Expr> Parser::call() {
+Expr* Parser::call() {
 	auto expr = primary();
 	for (;;) {
 		if (match(LEFT_PAREN)) {
 			expr = finish_call_expr(expr);
 		} else if (match(DOT)) {
-			std::shared_ptr<Token>  name = consume(IDENTIFIER, "Expect property after '.'");
-			expr = std::make_shared<Get>(expr, name);
+			Token  name = consume(IDENTIFIER, "Expect property after '.'");
+			expr = arena.make<Get>(expr, name);
 		} else if (match(LEFT_BRACKET)) {
 			expr = finish_idx_expr(expr);
 		} else {
@@ -293,49 +352,49 @@ std::shared_ptr<Expr> Parser::call() {
 	return expr;
 }
 
-std::shared_ptr<Expr> Parser::finish_call_expr(std::shared_ptr<Expr> callee) {
-	std::vector<std::shared_ptr<Expr>> arguments;
+Expr* Parser::finish_call_expr(Expr* callee) {
+	std::vector<Expr*> arguments;
 	if (!check(RIGHT_PAREN)) {
 		do {
 			arguments.push_back(expression());
 		} while (match(COMMA));
 	}
-	auto paren = consume(RIGHT_PAREN, "Expect ')' after arguments");
-	return std::make_shared<Call>(callee, paren, arguments);
+	Token paren = consume(RIGHT_PAREN, "Expect ')' after arguments");
+	return arena.make<Call>(callee, paren, arena.copy(arguments));
 }
 
-std::shared_ptr<Expr> Parser::finish_idx_expr(std::shared_ptr<Expr> callee) {
-	std::vector<std::shared_ptr<Expr>> arguments;
+Expr* Parser::finish_idx_expr(Expr* callee) {
+	std::vector<Expr*> arguments;
 	arguments.push_back(expression());
-	auto bracket = consume(RIGHT_BRACKET, "Expect ']' after expression");
+	Token bracket = consume(RIGHT_BRACKET, "Expect ']' after expression");
 	if (match(EQUAL)) {
 		arguments.push_back(expression());
-		auto token = std::make_shared<Token>(IDENTIFIER, "__set__", std::make_shared<StringObj>("__set__"), bracket->line);
-		auto get = std::make_shared<Get>(callee, token);
-		return std::make_shared<Call>(get, bracket, arguments);
+		Token token { IDENTIFIER, "__set__", Value(), bracket.line, SYM_SET };
+		auto get = arena.make<Get>(callee, token);
+		return arena.make<Call>(get, bracket, arena.copy(arguments));
 	} else {
-		auto token = std::make_shared<Token>(IDENTIFIER, "__get__", std::make_shared<StringObj>("__get__"), bracket->line);
-		auto get = std::make_shared<Get>(callee, token);
-		return std::make_shared<Call>(get, bracket, arguments);
+		Token token { IDENTIFIER, "__get__", Value(), bracket.line, SYM_GET };
+		auto get = arena.make<Get>(callee, token);
+		return arena.make<Call>(get, bracket, arena.copy(arguments));
 	}
 }
 
-std::shared_ptr<Expr> Parser::primary() {
-	if (match(FALSE)) return std::make_shared<Literal>(std::make_shared<BoolObj>(false));
-	if (match(TRUE)) return std::make_shared<Literal>(std::make_shared<BoolObj>(true));
-	if (match(NIL)) return std::make_shared<Literal>(nullptr);
-	if (match(NUMBER, STRING)) return std::make_shared<Literal>(prev()->literal);
-	if (match(IDENTIFIER)) return std::make_shared<Variable>(prev());
-	if (match(THIS)) return std::make_shared<This>(prev());
+Expr* Parser::primary() {
+	if (match(FALSE)) return arena.make<Literal>(Value(false));
+	if (match(TRUE)) return arena.make<Literal>(Value(true));
+	if (match(NIL)) return arena.make<Literal>(Value());
+	if (match(NUMBER, STRING)) return arena.make<Literal>(prev().literal);
+	if (match(IDENTIFIER)) return arena.make<Variable>(prev());
+	if (match(THIS)) return arena.make<This>(prev());
 	if (match(LEFT_PAREN)) {
 		auto expr = expression();
 		consume(RIGHT_PAREN, "Expect ')' after expression");
-		return std::make_shared<Grouping>(expr);
+		return arena.make<Grouping>(expr);
 	}
 	throw RuntimeError(peek(), "Expect expression");
 }
 
-std::shared_ptr<Token> Parser::consume(TokenType token, std::string msg) {
+const Token& Parser::consume(TokenType token, std::string msg) {
 	if (check(token)) return advance();
 	throw RuntimeError(peek(), msg);
 }
@@ -343,7 +402,7 @@ std::shared_ptr<Token> Parser::consume(TokenType token, std::string msg) {
 void Parser::synchronize() {
 	advance();
 	while (!is_at_end()) {
-		if (prev()->type == SEMICOLON) return;
+		if (prev().type == SEMICOLON) return;
 		advance();
 	}
 }
@@ -361,22 +420,30 @@ bool Parser::match(Args... types) {
 
 bool Parser::check(TokenType type) {
 	if (is_at_end()) return false;
-	return peek()->type == type;
+	return peek().type == type;
 }
 
-std::shared_ptr<Token> Parser::advance() {
-	if (!is_at_end()) curr++;
+const Token& Parser::advance() {
+	if (!is_at_end()) {
+		// A streamed token is copied out before the next one is scanned over
+		// it, and the window is kept a token ahead for peek.
+		if (scanner != nullptr) {
+			window[curr].lexeme = arena.copy(window[curr].lexeme);
+			if (curr + 1 == (int) window.size()) window.push_back(scanner->scan_next());
+		}
+		curr++;
+	}
 	return prev();
 }
 
 bool Parser::is_at_end() {
-	return peek()->type == _EOF;
+	return peek().type == _EOF;
 }
 
-std::shared_ptr<Token> Parser::peek() {
+const Token& Parser::peek() {
 	return tokens[curr];
 }
 
-std::shared_ptr<Token> Parser::prev() {
+const Token& Parser::prev() {
 	return tokens[curr - 1];
 }
\ No newline at end of file
@@ -9,75 +9,112 @@
 #include "Token.hpp"
 #include "Expr.hpp"
 #include "Stmt.hpp"
+#include "Scanner.hpp"
 
 
 class Parser {
 public:
-	Parser(std::vector<std::shared_ptr<Token>> tokens);
+	// tokens are read in place and have to outlive the parser. Nodes are
+	// allocated in arena, which has to outlive the AST. With lazy, the bodies
+	// of top level fns, methods and lambdas are skipped, and tokens then
+	// have to outlive the AST as well.
+	Parser(const std::vector<Token>& tokens, Arena& arena, bool lazy = false);
 
-	std::vector<std::shared_ptr<Stmt>> parse();
+	Span<Stmt*> parse();
+
+	// The body a lazy parse skipped.
+	Span<Stmt*> parse_body(const LazyBody& body);
+
+	// Streaming: tokens are pulled from scanner as the parser reaches them,
+	// and their lexemes are copied into arena as they are consumed, so the
+	// AST only points into the arena.
+	Parser(Scanner& scanner, Arena& arena);
+
+	// The next top level declaration, or nullptr at the end of the input.
+	Stmt* next();
+
+	// Fns, lambdas and classes parsed so far. The functions made from them
+	// point into the arena, so it has to outlive them.
+	int num_functions() const { return functions; }
 
 private:
-	std::vector<std::shared_ptr<Token>> tokens;
+	// Tokens a streaming parser has pulled and not yet left behind.
+	std::vector<Token> window;
+	const std::vector<Token>& tokens;
+	Arena& arena;
+	Scanner* scanner;
+	bool lazy;
+	// Blocks the parser is in. Only bodies at depth 0 are left lazy, since
+	// nothing encloses them that they could capture.
+	int depth;
+	int functions;
 	int curr;
 
-	std::shared_ptr<Stmt> declaration();
+	Stmt* declaration();
+
+	Stmt* class_declaration();
+
+	Stmt* var_declaration();
+
+	Stmt* import_declaration();
+
+	FnStmt* fn_declaration(std::string kind);
 
-	std::shared_ptr<Stmt> class_declaration();
+	Stmt* stmt();
 
-	std::shared_ptr<Stmt> var_declaration();
+	Stmt* for_stmt();
 
-	std::shared_ptr<FnStmt> fn_declaration(std::string kind);
+	Stmt* if_stmt();
 
-	std::shared_ptr<Stmt> stmt();
+	Stmt* print_stmt();
 
-	std::shared_ptr<Stmt> for_stmt();
+	Stmt* return_stmt();
 
-	std::shared_ptr<Stmt> if_stmt();
+	Stmt* while_stmt();
 
-	std::shared_ptr<Stmt> print_stmt();
+	Stmt* break_stmt();
 
-	std::shared_ptr<Stmt> return_stmt();
+	Stmt* continue_stmt();
 
-	std::shared_ptr<Stmt> while_stmt();
+	Span<Stmt*> block();
 
-	std::vector<std::shared_ptr<Stmt>> block();
+	LazyBody* skip_body(bool is_method);
 
-	std::shared_ptr<Stmt> expr_stmt();
+	Stmt* expr_stmt();
 
-	std::shared_ptr<Expr> expression();
+	Expr* expression();
 
-	std::shared_ptr<Expr> lambda_expr();
+	Expr* lambda_expr();
 
-	std::shared_ptr<Expr> assignment();
+	Expr* assignment();
 
-	std::shared_ptr<Expr> op_assignment(std::shared_ptr<Expr> expr, std::shared_ptr<Token> op);
+	Expr* op_assignment(Expr* expr, Token op);
 
-	std::shared_ptr<Expr> logical_or();
+	Expr* logical_or();
 
-	std::shared_ptr<Expr> logical_and();
+	Expr* logical_and();
 
-	std::shared_ptr<Expr> equality();
+	Expr* equality();
 
-	std::shared_ptr<Expr> comparison();
+	Expr* comparison();
 
-	std::shared_ptr<Expr> term();
+	Expr* term();
 
-	std::shared_ptr<Expr> factor();
+	Expr* factor();
 	
-	std::shared_ptr<Expr> exponent();
+	Expr* exponent();
 
-	std::shared_ptr<Expr> unary();
+	Expr* unary();
 
-	std::shared_ptr<Expr> call();
+	Expr* call();
 
-	std::shared_ptr<Expr> finish_call_expr(std::shared_ptr<Expr> callee);
+	Expr* finish_call_expr(Expr* callee);
 
-	std::shared_ptr<Expr> finish_idx_expr(std::shared_ptr<Expr> callee);
+	Expr* finish_idx_expr(Expr* callee);
 
-	std::shared_ptr<Expr> primary();
+	Expr* primary();
 
-	std::shared_ptr<Token> consume(TokenType token, std::string msg);
+	const Token& consume(TokenType token, std::string msg);
 
 	void synchronize();
 
@@ -86,13 +123,15 @@ private:
 
 	bool check(TokenType type);
 
-	std::shared_ptr<Token> advance();
+	// A streaming parser pulls the next token here, so token references
+	// are only good until the next advance.
+	const Token& advance();
 
 	bool is_at_end();
 
-	std::shared_ptr<Token> peek();
+	const Token& peek();
 
-	std::shared_ptr<Token> prev();
+	const Token& prev();
 };
 
 #endif
\ No newline at end of file
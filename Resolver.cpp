@@ -1,79 +1,80 @@
 #include "Resolver.hpp"
 
-Resolver::Resolver(Interpreter* interpreter) 
-	: interpreter(interpreter), curr_fn(FnType_NONE), curr_class(ClassType_NONE) {}
+Resolver::Resolver(Arena& arena)
+	: arena(arena), script { nullptr, 0, 0, 0, {}, {}, {} }, curr_scope(&script), curr_fn(FnType_NONE), curr_class(ClassType_NONE), loop_depth(0) {}
 
-std::shared_ptr<Obj> Resolver::visit_literal_expr(Literal* expr) {
-	return nullptr;
+Value Resolver::visit_literal_expr(Literal* expr) {
+	return Value();
 }
 
-std::shared_ptr<Obj> Resolver::visit_grouping_expr(Grouping* expr) {
+Value Resolver::visit_grouping_expr(Grouping* expr) {
 	resolve(expr->expression);
-	return nullptr;
+	return Value();
 }
 
-std::shared_ptr<Obj> Resolver::visit_unary_expr(Unary* expr) {
+Value Resolver::visit_unary_expr(Unary* expr) {
 	resolve(expr->right);
-	return nullptr;
+	return Value();
 }
 
-std::shared_ptr<Obj> Resolver::visit_binary_expr(Binary* expr) {
+Value Resolver::visit_binary_expr(Binary* expr) {
 	resolve(expr->left);
 	resolve(expr->right);
-	return nullptr;
+	return Value();
 }
 
-std::shared_ptr<Obj> Resolver::visit_variable_expr(Variable* expr) {
+Value Resolver::visit_variable_expr(Variable* expr) {
 	if (!scopes.empty()) {
-		if (scopes.back().count(expr->name->lexeme) && scopes.back()[expr->name->lexeme] == false) {
-			std::cout << expr->name->lexeme << " was declared, but not defined\n";
+		if (scopes.back().count(expr->name.symbol) && !scopes.back()[expr->name.symbol].defined) {
+			std::cout << expr->name.lexeme << " was declared, but not defined\n";
 			throw RuntimeError(expr->name, "Can't read local variable in its own initializer");
 		}
 	}
-	resolve_local(expr, expr->name);
-	return nullptr;
+	resolve_local(expr->name, expr->access, expr->slot);
+	return Value();
 }
 
-std::shared_ptr<Obj> Resolver::visit_assign_expr(Assign* expr) {
+Value Resolver::visit_assign_expr(Assign* expr) {
 	resolve(expr->val);
-	resolve_local(expr, expr->name);
-	return nullptr;
+	resolve_local(expr->name, expr->access, expr->slot);
+	return Value();
 }
 
-std::shared_ptr<Obj> Resolver::visit_logical_expr(Logical* expr) {
+Value Resolver::visit_logical_expr(Logical* expr) {
 	resolve(expr->left);
 	resolve(expr->right);
-	return nullptr;
+	return Value();
 }
 
-std::shared_ptr<Obj> Resolver::visit_call_expr(Call* expr) {
+Value Resolver::visit_call_expr(Call* expr) {
+	expr->method = dynamic_cast<Get*>(expr->callee);
 	resolve(expr->callee);
 	for (auto a : expr->arguments) resolve(a);
-	return nullptr;
+	return Value();
 }
 
-std::shared_ptr<Obj> Resolver::visit_lambda_expr(LambdaExpr* expr) {
-	resolve_lambda_expr(expr, FnType_FN);
-	return nullptr;
+Value Resolver::visit_lambda_expr(LambdaExpr* expr) {
+	resolve_fn(expr, FnType_FN);
+	return Value();
 }
 
-std::shared_ptr<Obj> Resolver::visit_get_expr(Get* expr) {
+Value Resolver::visit_get_expr(Get* expr) {
 	resolve(expr->obj);
-	return nullptr;
+	return Value();
 }
 
-std::shared_ptr<Obj> Resolver::visit_set_expr(Set* expr) {
+Value Resolver::visit_set_expr(Set* expr) {
 	resolve(expr->val);
 	resolve(expr->obj);
-	return nullptr;
+	return Value();
 }
 
-std::shared_ptr<Obj> Resolver::visit_this_expr(This* expr) {
+Value Resolver::visit_this_expr(This* expr) {
 	if (curr_class == ClassType_NONE) {
 		throw RuntimeError(expr->keyword, "Can't use 'this' outside of a class");
 	}
-	resolve_local(expr, expr->keyword);
-	return nullptr;
+	resolve_local(expr->keyword, expr->access, expr->slot);
+	return Value();
 }
 
 void Resolver::visit_expression_stmt(Expression* stmt) {
@@ -85,7 +86,7 @@ void Resolver::visit_print_stmt(Print* stmt) {
 }
 
 void Resolver::visit_var_stmt(Var* stmt) {
-	declare(stmt->name);
+	stmt->slot = declare(stmt->name, &stmt->access);
 	if (stmt->initializer != nullptr) resolve(stmt->initializer);
 	define(stmt->name);
 }
@@ -93,7 +94,7 @@ void Resolver::visit_var_stmt(Var* stmt) {
 void Resolver::visit_block_stmt(Block* stmt) {
 	begin_scope();
 	resolve(stmt->stmts);
-	end_scope();
+	stmt->num_slots = end_scope();
 }
 
 void Resolver::visit_if_stmt(If* stmt) {
@@ -104,13 +105,16 @@ void Resolver::visit_if_stmt(If* stmt) {
 
 void Resolver::visit_while_stmt(While* stmt) {
 	resolve(stmt->condition);
+	loop_depth++;
 	resolve(stmt->body);
+	loop_depth--;
+	if (stmt->increment != nullptr) resolve(stmt->increment);
 }
 
 void Resolver::visit_fn_stmt(FnStmt* stmt) {
-	declare(stmt->name);
+	stmt->slot = declare(stmt->name, &stmt->access);
 	define(stmt->name);
-	resolve_fn_stmt(stmt, FnType_FN);
+	resolve_fn(stmt, FnType_FN);
 }
 
 void Resolver::visit_return_stmt(Return* stmt) {
@@ -121,82 +125,164 @@ void Resolver::visit_return_stmt(Return* stmt) {
 	}
 }
 
+void Resolver::visit_break_stmt(Break* stmt) {
+	if (loop_depth == 0) throw RuntimeError(stmt->keyword, "Can't break outside of a loop");
+}
+
+void Resolver::visit_continue_stmt(Continue* stmt) {
+	if (loop_depth == 0) throw RuntimeError(stmt->keyword, "Can't continue outside of a loop");
+}
+
 void Resolver::visit_class_stmt(ClassStmt* stmt) {
-	declare(stmt->name);
+	stmt->slot = declare(stmt->name, &stmt->access);
 	define(stmt->name);
 	ClassType enclosing_class = curr_class;
 	curr_class = ClassType_CLASS;
-	begin_scope();
-	scopes.back()["this"] = true;
 	for (auto m : stmt->methods) {
-		resolve_fn_stmt(m.get(), m->name->lexeme == "__init__" ? FnType_INIT : FnType_METHOD);
+		FnType type = m->name.symbol == SYM_INIT ? FnType_INIT : FnType_METHOD;
+		resolve_fn(m, type);
 	}
-	end_scope();
 	curr_class = enclosing_class;
 }
 
-void Resolver::resolve(std::vector<std::shared_ptr<Stmt>>& stmts) {
+void Resolver::visit_import_stmt(Import* stmt) {
+	if (!scopes.empty() || curr_fn != FnType_NONE) throw RuntimeError(stmt->keyword, "Can only import at the top level");
+}
+
+void Resolver::resolve(Span<Stmt*> stmts) {
 	for (auto s : stmts) resolve(s);
 } 
 
-void Resolver::resolve(std::shared_ptr<Stmt> stmt) {
+void Resolver::resolve_lazy(FnStmt* fn) {
+	if (fn->lazy->is_method) {
+		curr_class = ClassType_CLASS;
+		resolve_fn(fn, fn->name.symbol == SYM_INIT ? FnType_INIT : FnType_METHOD);
+		curr_class = ClassType_NONE;
+	} else {
+		resolve_fn(fn, FnType_FN);
+	}
+}
+
+void Resolver::resolve_lazy(LambdaExpr* fn) {
+	resolve_fn(fn, FnType_FN);
+}
+
+void Resolver::resolve(Stmt* stmt) {
 	stmt->accept(this);
 }
 
-void Resolver::resolve(std::shared_ptr<Expr> expr) {
+void Resolver::resolve(Expr* expr) {
 	expr->accept(this);
 }
 
 void Resolver::begin_scope() {
-	scopes.push_back(std::unordered_map<std::string, bool>());
+	scopes.push_back(std::unordered_map<Symbol, Binding>());
 }
 
-void Resolver::end_scope() {
+// Pops the innermost scope and frees its slots. Returns how many slots were
+// in use by its end.
+int Resolver::end_scope() {
+	int num_slots = curr_scope->next_slot;
+	for (auto& [name, binding] : scopes.back()) {
+		if (!binding.captured) continue;
+		for (auto use : binding.uses) *use = Access_BOXED;
+		if (binding.param) curr_scope->boxed.push_back(binding.slot);
+	}
+	curr_scope->next_slot -= scopes.back().size();
 	scopes.pop_back();
+	return num_slots;
 }
 
-void Resolver::declare(std::shared_ptr<Token> name) {
-	if (!scopes.empty() && scopes.back().count(name->lexeme)) {
+// Declares a local in the innermost scope and returns its slot, or -1 at the
+// top level. Params are declared with a null access.
+int Resolver::declare(Token name, Access* access) {
+	if (scopes.empty()) return -1;
+	if (scopes.back().count(name.symbol)) {
 		throw RuntimeError(name, "A variable with this name already exists in this scope");
 	}
-	if (!scopes.empty()) scopes.back()[name->lexeme] = false;
+	int slot = curr_scope->next_slot++;
+	curr_scope->max_slots = std::max(curr_scope->max_slots, curr_scope->next_slot);
+	Binding& binding = scopes.back()[name.symbol];
+	binding = Binding { false, access == nullptr, false, slot, {} };
+	if (access != nullptr) {
+		*access = Access_LOCAL;
+		binding.uses.push_back(access);
+	}
+	return slot;
 }
 
-void Resolver::define(std::shared_ptr<Token> name) {
-	if (!scopes.empty()) scopes.back()[name->lexeme] = true;
+void Resolver::define(Token name) {
+	if (!scopes.empty()) scopes.back()[name.symbol].defined = true;
 }
 
-void Resolver::resolve_local(Expr* expr, std::shared_ptr<Token> name) {
-	for (int i = scopes.size() - 1; i >= 0; i--) {
-		if (scopes[i].count(name->lexeme)) {
-			interpreter->resolve(expr, scopes.size() - 1 - i);
+void Resolver::resolve_local(Token name, Access& access, int& slot) {
+	for (int i = scopes.size() - 1; i >= (int) curr_scope->scope_base; i--) {
+		auto binding = scopes[i].find(name.symbol);
+		if (binding != scopes[i].end()) {
+			access = Access_LOCAL;
+			slot = binding->second.slot;
+			binding->second.uses.push_back(&access);
 			return;
 		}
 	}
+	int index = resolve_capture(curr_scope, name.symbol);
+	if (index != -1) {
+		access = Access_UPVALUE;
+		slot = index;
+	}
 }
 
-void Resolver::resolve_fn_stmt(FnStmt* fn, FnType type) {
-	FnType enclosing_fn = curr_fn;
-	curr_fn = type;
-	begin_scope();
-	for (auto p : fn->params) {
-		declare(p);
-		define(p);
+// Finds name in the functions enclosing fn, capturing it in each function
+// on the way. Returns -1 for globals.
+int Resolver::resolve_capture(FnScope* fn, Symbol name) {
+	FnScope* enclosing = fn->enclosing;
+	if (enclosing == nullptr) return -1;
+	for (int i = fn->scope_base - 1; i >= (int) enclosing->scope_base; i--) {
+		auto binding = scopes[i].find(name);
+		if (binding != scopes[i].end()) {
+			binding->second.captured = true;
+			return add_capture(fn, name, Capture { true, binding->second.slot });
+		}
 	}
-	resolve(fn->body);
-	end_scope();
-	curr_fn = enclosing_fn;
+	int index = resolve_capture(enclosing, name);
+	if (index == -1) return -1;
+	return add_capture(fn, name, Capture { false, index });
+}
+
+int Resolver::add_capture(FnScope* fn, Symbol name, Capture capture) {
+	for (size_t i = 0; i < fn->names.size(); i++) {
+		if (fn->names[i] == name) return i;
+	}
+	fn->names.push_back(name);
+	fn->captures.push_back(capture);
+	return fn->captures.size() - 1;
 }
 
-void Resolver::resolve_lambda_expr(LambdaExpr* lambda, FnType type) {
+// Resolves a FnStmt or LambdaExpr body in a frame of its own.
+template <typename T>
+void Resolver::resolve_fn(T* fn, FnType type) {
 	FnType enclosing_fn = curr_fn;
+	int enclosing_loop_depth = loop_depth;
 	curr_fn = type;
+	loop_depth = 0;
+	FnScope scope { curr_scope, scopes.size(), 0, 0, {}, {}, {} };
+	curr_scope = &scope;
 	begin_scope();
-	for (auto p : lambda->params) {
-		declare(p);
+	// The receiver is passed in slot 0 of a method's own frame.
+	if (type == FnType_METHOD || type == FnType_INIT) {
+		scopes.back()[SYM_THIS] = Binding { true, true, false, scope.next_slot++, {} };
+		scope.max_slots = scope.next_slot;
+	}
+	for (auto p : fn->params) {
+		declare(p, nullptr);
 		define(p);
 	}
-	resolve(lambda->body);
+	resolve(fn->body);
 	end_scope();
+	curr_scope = scope.enclosing;
 	curr_fn = enclosing_fn;
+	loop_depth = enclosing_loop_depth;
+	fn->num_slots = scope.max_slots;
+	fn->captures = arena.copy(scope.captures);
+	fn->boxed = arena.copy(scope.boxed);
 }
@@ -2,43 +2,54 @@
 #define RESOLVER
 
 #include <vector>
+#include <algorithm>
 #include <unordered_map>
 #include <iostream>
 #include "Expr.hpp"
 #include "Stmt.hpp"
-#include "Interpreter.hpp"
+#include "Error.hpp"
 
 enum FnType { FnType_NONE, FnType_FN, FnType_METHOD, FnType_INIT };
 
 enum ClassType { ClassType_NONE, ClassType_CLASS };
 
+struct Binding {
+	bool defined;
+	bool param;
+	// Set once a closure captures the local, which then lives in a Box.
+	bool captured;
+	int slot;
+	// Every access naming the local, patched to Access_BOXED if captured.
+	std::vector<Access*> uses;
+};
+
 class Resolver : Expr::Visitor, Stmt::Visitor {
 public:
-	Resolver(Interpreter* interpreter);
+	Resolver(Arena& arena);
 
-	std::shared_ptr<Obj> visit_literal_expr(Literal* expr) override;
+	Value visit_literal_expr(Literal* expr) override;
 
-	std::shared_ptr<Obj> visit_grouping_expr(Grouping* expr) override;
+	Value visit_grouping_expr(Grouping* expr) override;
 
-	std::shared_ptr<Obj> visit_unary_expr(Unary* expr) override;
+	Value visit_unary_expr(Unary* expr) override;
 
-	std::shared_ptr<Obj> visit_binary_expr(Binary* expr) override;
+	Value visit_binary_expr(Binary* expr) override;
 
-	std::shared_ptr<Obj> visit_variable_expr(Variable* expr) override;
+	Value visit_variable_expr(Variable* expr) override;
 
-	std::shared_ptr<Obj> visit_assign_expr(Assign* expr) override;
+	Value visit_assign_expr(Assign* expr) override;
 
-	std::shared_ptr<Obj> visit_logical_expr(Logical* expr) override;
+	Value visit_logical_expr(Logical* expr) override;
 
-	std::shared_ptr<Obj> visit_call_expr(Call* expr) override;
+	Value visit_call_expr(Call* expr) override;
 
-	std::shared_ptr<Obj> visit_lambda_expr(LambdaExpr* expr) override;
+	Value visit_lambda_expr(LambdaExpr* expr) override;
 
-	std::shared_ptr<Obj> visit_get_expr(Get* expr) override;
+	Value visit_get_expr(Get* expr) override;
 	
-	std::shared_ptr<Obj> visit_set_expr(Set* expr) override;
+	Value visit_set_expr(Set* expr) override;
 	
-	std::shared_ptr<Obj> visit_this_expr(This* expr) override;
+	Value visit_this_expr(This* expr) override;
 
 	void visit_expression_stmt(Expression* stmt) override;
 
@@ -56,33 +67,65 @@ public:
 
 	void visit_return_stmt(Return* stmt) override;
 
+	void visit_break_stmt(Break* stmt) override;
+
+	void visit_continue_stmt(Continue* stmt) override;
+
 	void visit_class_stmt(ClassStmt* stmt) override;
 
-	void resolve(std::vector<std::shared_ptr<Stmt>>& stmts);
+	void visit_import_stmt(Import* stmt) override;
+
+	void resolve(Span<Stmt*> stmts);
+
+	// Resolves a body the Parser left lazy, once it is parsed. Those are
+	// only ever at the top level, so the body is resolved as if there.
+	void resolve_lazy(FnStmt* fn);
+
+	void resolve_lazy(LambdaExpr* fn);
 
 private:
-	Interpreter* interpreter;
-	std::vector<std::unordered_map<std::string, bool>> scopes;
+	// The function being resolved. Its own scopes start at scope_base, any
+	// below that belong to enclosing functions and have to be captured.
+	// Slots are handed out in order and reused once their scope ends.
+	struct FnScope {
+		FnScope* enclosing;
+		size_t scope_base;
+		int next_slot;
+		int max_slots;
+		std::vector<Symbol> names;
+		std::vector<Capture> captures;
+		std::vector<int> boxed;
+	};
+
+	Arena& arena;
+	std::vector<std::unordered_map<Symbol, Binding>> scopes;
+	// Top level blocks, which use slots in the interpreter's base frame.
+	FnScope script;
+	FnScope* curr_scope;
 	FnType curr_fn;
 	ClassType curr_class;
+	int loop_depth;
 
-	void resolve(std::shared_ptr<Stmt> stmt);
+	void resolve(Stmt* stmt);
 
-	void resolve(std::shared_ptr<Expr> expr);
+	void resolve(Expr* expr);
 
 	void begin_scope();
 
-	void end_scope();
+	int end_scope();
 
-	void declare(std::shared_ptr<Token> name);
+	int declare(Token name, Access* access);
 
-	void define(std::shared_ptr<Token> name);
+	void define(Token name);
 
-	void resolve_local(Expr* expr, std::shared_ptr<Token> name);
+	void resolve_local(Token name, Access& access, int& slot);
 
-	void resolve_fn_stmt(FnStmt* fn, FnType type);
-	
-	void resolve_lambda_expr(LambdaExpr* fn, FnType type);
+	int resolve_capture(FnScope* fn, Symbol name);
+
+	int add_capture(FnScope* fn, Symbol name, Capture capture);
+
+	template <typename T>
+	void resolve_fn(T* fn, FnType type);
 };
 
 #endif
\ No newline at end of file
@@ -1,39 +1,111 @@
 #include "Scanner.hpp"
+#include <charconv>
+
+Scanner::Scanner(std::string_view source) : source(source), start(0), curr(0), line(1), in(nullptr), deferred(false) {}
+
+Scanner::Scanner(std::istream& in) : start(0), curr(0), line(1), in(&in), deferred(false) {}
+
+Scanner::Scanner(std::string_view source, int line, bool deferred)
+	: source(source), start(0), curr(0), line(line), in(nullptr), deferred(deferred), first_identifier(SYM_NONE) {}
+
+static const std::pair<const char*, TokenType> keywords[] = {
+	{"and", AND}, {"class", CLASS}, {"else", ELSE}, {"false", FALSE}, {"for", FOR},
+	{"fn", FN}, {"if", IF}, {"nil", NIL}, {"or", OR}, {"print", PRINT},
+	{"return", RETURN}, {"super", SUPER}, {"this", THIS}, {"true", TRUE}, {"let", LET},
+	{"while", WHILE}, {"break", BREAK}, {"continue", CONTINUE}, {"import", IMPORT},
+};
+
+// Keyword type for sym, or IDENTIFIER. Keywords are interned the first time
+// this runs, before most names, so the table stays short.
+static TokenType keyword(Symbol sym) {
+	static std::vector<TokenType> types = [] {
+		std::vector<TokenType> types;
+		for (auto& k : keywords) {
+			Symbol sym = symbols.intern(k.first);
+			if (sym >= types.size()) types.resize(sym + 1, IDENTIFIER);
+			types[sym] = k.second;
+		}
+		return types;
+	}();
+	return sym < types.size() ? types[sym] : IDENTIFIER;
+}
+
+// The same, by name, for deferred scanners. Only used the first time a
+// scanner sees a name.
+static TokenType keyword(std::string_view name) {
+	for (auto& k : keywords) {
+		if (name == k.first) return k.second;
+	}
+	return IDENTIFIER;
+}
 
-Scanner::Scanner(std::string source) : source(source), start(0), curr(0), line(1) {
-	keywords["and"] = AND;
-	keywords["class"] = CLASS;
-	keywords["else"] = ELSE;
-	keywords["false"] = FALSE;
-	keywords["for"] = FOR;
-	keywords["fn"] = FN;
-	keywords["if"] = IF;
-	keywords["nil"] = NIL;
-	keywords["or"] = OR;
-	keywords["print"] = PRINT;
-	keywords["return"] = RETURN;
-	keywords["super"] = SUPER;
-	keywords["this"] = THIS;
-	keywords["true"] = TRUE;
-	keywords["let"] = LET;
-	keywords["while"] = WHILE;
-}
-
-std::vector<std::shared_ptr<Token>> Scanner::scan_tokens() {
-	std::vector<std::shared_ptr<Token>> tokens;
+std::vector<Token> Scanner::scan_tokens() {
+	std::vector<Token> tokens;
+	// Most tokens are a handful of characters, so this is rarely outgrown.
+	tokens.reserve(source.size() / 4 + 1);
 	while (!is_at_end()) {
 		start = curr;
 		scan_token(tokens);
 	}
-	tokens.push_back(std::make_shared<Token>(_EOF, "", nullptr, line));
+	tokens.push_back(Token { _EOF, "", Value(), line });
 	return tokens;
 }
 
+Token Scanner::scan_next() {
+	scanned.clear();
+	while (scanned.empty()) {
+		if (is_at_end() && !read_line()) return Token { _EOF, "", Value(), line };
+		start = curr;
+		scan_token(scanned);
+	}
+	return scanned.back();
+}
+
+// Names are interned in the order a scanner of the whole source would have
+// first seen them, so symbols come out the same either way.
+void Scanner::intern() {
+	symbols_found.resize(local_names.size());
+	strings_found.resize(local_names.size());
+	for (size_t i = 0; i < local_names.size(); i++) {
+		Symbol sym = symbols.intern(local_names[i].name);
+		if (i == first_identifier) keyword(sym);
+		symbols_found[i] = sym;
+		if (local_names[i].is_string) strings_found[i] = symbols.string(sym);
+	}
+}
+
+void Scanner::bind(std::vector<Token>& tokens) {
+	for (auto& t : tokens) {
+		if (t.symbol == SYM_NONE) continue;
+		if (t.type == STRING) {
+			t.literal = strings_found[t.symbol];
+			t.symbol = SYM_NONE;
+		} else {
+			t.symbol = symbols_found[t.symbol];
+		}
+	}
+}
+
 bool Scanner::is_at_end() {
 	return curr >= source.size();
 }
 
-void Scanner::scan_token(std::vector<std::shared_ptr<Token>>& tokens) {
+// Moves on to the next line of a stream, keeping the token being scanned.
+// False once there is nothing left, and always for a whole source.
+bool Scanner::read_line() {
+	if (in == nullptr) return false;
+	std::string next;
+	if (!std::getline(*in, next)) return false;
+	if (!in->eof()) next += '\n';
+	buffer.erase(0, start);
+	buffer += next;
+	curr -= start;
+	start = 0;
+	source = buffer;
+	return true;
+}
+
+void Scanner::scan_token(std::vector<Token>& tokens) {
 	char c = advance();
 	switch (c) {
 		case '(': add_token(tokens, LEFT_PAREN); break;
@@ -73,13 +145,12 @@ char Scanner::advance() {
 	return source[curr++];
 }
 
-void Scanner::add_token(std::vector<std::shared_ptr<Token>>& tokens, TokenType type) {
-	add_token(tokens, type, nullptr);
+void Scanner::add_token(std::vector<Token>& tokens, TokenType type) {
+	add_token(tokens, type, Value());
 }
 
-void Scanner::add_token(std::vector<std::shared_ptr<Token>>& tokens, TokenType type, std::shared_ptr<Obj> literal) {
-	std::string text = source.substr(start, curr - start);
-	tokens.push_back(std::make_shared<Token>(type, text, literal, line));
+void Scanner::add_token(std::vector<Token>& tokens, TokenType type, Value literal) {
+	tokens.push_back(Token { type, source.substr(start, curr - start), literal, line });
 }
 
 bool Scanner::match(char expected) {
@@ -99,8 +170,8 @@ char Scanner::peek_next() {
 	return source[curr + 1];
 }
 
-void Scanner::string(std::vector<std::shared_ptr<Token>>& tokens, char quote) {
-	while (peek() != quote && !is_at_end()) {
+void Scanner::string(std::vector<Token>& tokens, char quote) {
+	while (peek() != quote && (!is_at_end() || read_line())) {
 		if (peek() == '\n') line++;
 		advance();
 	}
@@ -111,7 +182,15 @@ void Scanner::string(std::vector<std::shared_ptr<Token>>& tokens, char quote) {
 	}
 
 	advance();
-	add_token(tokens, STRING, std::make_shared<StringObj>(source.substr(start + 1, (curr - 1) - (start + 1))));
+	std::string_view text = source.substr(start + 1, (curr - 1) - (start + 1));
+	if (deferred) {
+		Symbol id = local_id(text);
+		local_names[id].is_string = true;
+		tokens.push_back(Token { STRING, source.substr(start, curr - start), Value(), line, id });
+		return;
+	}
+	Symbol sym = symbols.intern(text);
+	add_token(tokens, STRING, symbols.string(sym));
 }
 
 bool Scanner::is_digit(char c) {
@@ -126,16 +205,33 @@ bool Scanner::is_alpha_numeric(char c) {
 	return is_alpha(c) || is_digit(c);
 }
 
-void Scanner::number(std::vector<std::shared_ptr<Token>>& tokens) {
+void Scanner::number(std::vector<Token>& tokens) {
 	while (is_digit(peek())) advance();
 	if (peek() == '.' && is_digit(peek_next())) advance();
 	while (is_digit(peek())) advance();
-	add_token(tokens, NUMBER, std::make_shared<DoubleObj>(std::stod(source.substr(start, curr - start))));
+	double val = 0;
+	std::from_chars(source.data() + start, source.data() + curr, val);
+	add_token(tokens, NUMBER, Value(val));
 }
 
-void Scanner::identifier(std::vector<std::shared_ptr<Token>>& tokens) {
+void Scanner::identifier(std::vector<Token>& tokens) {
 	while (is_alpha_numeric(peek())) advance();
-	std::string text = source.substr(start, curr - start);
-	if (keywords.count(text)) add_token(tokens, keywords[text]);
-	else add_token(tokens, IDENTIFIER);
+	std::string_view text = source.substr(start, curr - start);
+	if (deferred) {
+		Symbol id = local_id(text);
+		if (first_identifier == SYM_NONE) first_identifier = id;
+		tokens.push_back(Token { local_names[id].type, text, Value(), line, id });
+		return;
+	}
+	Symbol sym = symbols.intern(text);
+	tokens.push_back(Token { keyword(sym), text, Value(), line, sym });
+}
+
+Symbol Scanner::local_id(std::string_view name) {
+	auto it = local_ids.find(name);
+	if (it != local_ids.end()) return it->second;
+	Symbol id = local_names.size();
+	local_names.push_back(LocalName { name, keyword(name), false });
+	local_ids.emplace(name, id);
+	return id;
 }
\ No newline at end of file
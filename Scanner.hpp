@@ -2,34 +2,77 @@
 #define SCANNER
 
 #include <string>
+#include <string_view>
 #include <vector>
+#include <istream>
 #include <unordered_map>
 #include "Token.hpp"
 #include "Error.hpp"
-#include "Obj.hpp"
+#include "Value.hpp"
+#include "Heap.hpp"
 
 class Scanner {
 public:
-	Scanner(std::string source);
+	// source has to outlive the tokens, which only point into it.
+	Scanner(std::string_view source);
 
-	std::vector<std::shared_ptr<Token>> scan_tokens();
+	std::vector<Token> scan_tokens();
+
+	// Streaming: in is read a line at a time, as tokens are asked for. A
+	// token's lexeme points into the current line, so it is only good until
+	// the next token is scanned.
+	Scanner(std::istream& in);
+
+	// The next token, or _EOF once the input runs out.
+	Token scan_next();
+
+	// For scanning part of a source, starting at line, off the main thread.
+	// A deferred scanner doesn't touch the symbol table or the heap. Names
+	// get ids local to the scanner and string literals are left nil until
+	// intern and bind put them right.
+	Scanner(std::string_view source, int line, bool deferred);
+
+	// On the main thread, once the tokens are scanned.
+	void intern();
+
+	// Gives tokens from scan_tokens their symbols and string literals, once
+	// intern has run. Can run on any thread.
+	void bind(std::vector<Token>& tokens);
 
 private:
-	std::string source;
-	std::unordered_map<std::string, TokenType> keywords;
+	std::string_view source;
 	int start;
 	int curr;
 	int line;
+	// Only used when streaming. buffer holds the current line, after what is
+	// left of a string that started on an earlier one.
+	std::istream* in;
+	std::string buffer;
+	std::vector<Token> scanned;
+	// Only used when deferred, indexed by local id.
+	struct LocalName {
+		std::string_view name;
+		TokenType type;
+		bool is_string;
+	};
+	bool deferred;
+	std::unordered_map<std::string_view, Symbol> local_ids;
+	std::vector<LocalName> local_names;
+	Symbol first_identifier;
+	std::vector<Symbol> symbols_found;
+	std::vector<Value> strings_found;
 
 	bool is_at_end();
+
+	bool read_line();
 	
-	void scan_token(std::vector<std::shared_ptr<Token>>& tokens);
+	void scan_token(std::vector<Token>& tokens);
 
 	char advance();
 
-	void add_token(std::vector<std::shared_ptr<Token>>& tokens, TokenType type);
+	void add_token(std::vector<Token>& tokens, TokenType type);
 
-	void add_token(std::vector<std::shared_ptr<Token>>& tokens, TokenType type, std::shared_ptr<Obj> literal);
+	void add_token(std::vector<Token>& tokens, TokenType type, Value literal);
 
 	bool match(char expected);
 
@@ -37,7 +80,7 @@ private:
 
 	char peek_next();
 
-	void string(std::vector<std::shared_ptr<Token>>& tokens, char quote);
+	void string(std::vector<Token>& tokens, char quote);
 
 	bool is_digit(char c); 
 
@@ -45,9 +88,11 @@ private:
 
 	bool is_alpha_numeric(char c);
 
-	void number(std::vector<std::shared_ptr<Token>>& tokens);
+	void number(std::vector<Token>& tokens);
+
+	void identifier(std::vector<Token>& tokens);
 
-	void identifier(std::vector<std::shared_ptr<Token>>& tokens);
+	Symbol local_id(std::string_view name);
 };
 
 #endif
\ No newline at end of file
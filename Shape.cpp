@@ -0,0 +1,27 @@
+#include "Shape.hpp"
+
+static size_t next_shape_id = 0;
+
+Shape::Shape() : id(next_shape_id++) {}
+
+int Shape::find(Symbol name) {
+	auto it = slots.find(name);
+	if (it == slots.end()) return -1;
+	return it->second;
+}
+
+Shape* Shape::add(Symbol name) {
+	auto& next = transitions[name];
+	if (next == nullptr) {
+		next.reset(new Shape());
+		next->slots = slots;
+		next->slots[name] = slots.size();
+	}
+	return next.get();
+}
+
+const CacheEntry* InlineCache::add(CacheEntry entry) {
+	if (size < INLINE_CACHE_SIZE) size++;
+	entries[size - 1] = entry;
+	return &entries[size - 1];
+}
@@ -0,0 +1,60 @@
+#ifndef SHAPE
+#define SHAPE
+
+#include <string>
+#include <unordered_map>
+#include <memory>
+#include "Symbol.hpp"
+
+// Field layout shared by every instance that had the same fields added in
+// the same order. Instances start at their class's root shape and follow
+// transitions as fields are added. A shape owns the shapes it leads to, and
+// ids are never reused so caches can't mistake a new shape for a dead one.
+struct Shape {
+	size_t id;
+	std::unordered_map<Symbol, int> slots;
+	std::unordered_map<Symbol, std::unique_ptr<Shape>> transitions;
+
+	Shape();
+
+	// Field slot for name, or -1 if this shape doesn't have it.
+	int find(Symbol name);
+
+	// The shape reached by adding name as the next field.
+	Shape* add(Symbol name);
+};
+
+struct Callable;
+
+// What a property access site found for one shape: a field slot, or a
+// method when index is -1. transition is only used by Set and is the shape
+// an instance moves to when the access adds a new field.
+struct CacheEntry {
+	size_t shape_id;
+	int index;
+	Callable* method;
+	Shape* transition;
+};
+
+#define INLINE_CACHE_SIZE 4
+
+// Polymorphic inline cache kept on Get/Set nodes and VM property
+// instructions. A hit costs a shape id compare per entry.
+struct InlineCache {
+	CacheEntry entries[INLINE_CACHE_SIZE];
+	int size;
+
+	InlineCache() : size(0) {}
+
+	const CacheEntry* find(size_t shape_id) const {
+		for (int i = 0; i < size; i++) {
+			if (entries[i].shape_id == shape_id) return &entries[i];
+		}
+		return nullptr;
+	}
+
+	// Once the site is megamorphic the newest shape replaces the last entry.
+	const CacheEntry* add(CacheEntry entry);
+};
+
+#endif
@@ -12,7 +12,10 @@ class If;
 class While;
 class FnStmt;
 class Return;
+class Break;
+class Continue;
 class ClassStmt;
+class Import;
 
 class Stmt {
 public:
@@ -26,19 +29,20 @@ public:
 		virtual void visit_while_stmt(While* stmt) = 0;
 		virtual void visit_fn_stmt(FnStmt* stmt) = 0;
 		virtual void visit_return_stmt(Return* stmt) = 0;
+		virtual void visit_break_stmt(Break* stmt) = 0;
+		virtual void visit_continue_stmt(Continue* stmt) = 0;
 		virtual void visit_class_stmt(ClassStmt* stmt) = 0;
+		virtual void visit_import_stmt(Import* stmt) = 0;
 	};
 
 	virtual void accept(Visitor* visitor) = 0;
-
-	virtual ~Stmt() {}
 };
 
 class Expression : public Stmt {
 public:
-	std::shared_ptr<Expr> expression;
+	Expr* expression;
 
-	Expression(std::shared_ptr<Expr> expression) : expression(expression) {}
+	Expression(Expr* expression) : expression(expression) {}
 
 	void accept(Visitor* visitor) override {
 		visitor->visit_expression_stmt(this);
@@ -47,9 +51,9 @@ public:
 
 class Print : public Stmt {
 public:
-	std::shared_ptr<Expr> expression;
+	Expr* expression;
 
-	Print(std::shared_ptr<Expr> expression) : expression(expression) {}
+	Print(Expr* expression) : expression(expression) {}
 
 	void accept(Visitor* visitor) override {
 		visitor->visit_print_stmt(this);
@@ -58,10 +62,13 @@ public:
 
 class Var : public Stmt {
 public:
-	std::shared_ptr<Token> name;
-	std::shared_ptr<Expr> initializer;
+	Token name;
+	Expr* initializer;
+	// Frame slot, unused for globals.
+	Access access;
+	int slot;
 	
-	Var(std::shared_ptr<Token> name, std::shared_ptr<Expr> initializer) : name(name),  initializer(initializer) {}
+	Var(Token name, Expr* initializer) : name(name),  initializer(initializer), access(Access_GLOBAL), slot(-1) {}
 
 	void accept(Visitor* visitor) override {
 		visitor->visit_var_stmt(this);
@@ -70,9 +77,11 @@ public:
 
 class Block : public Stmt {
 public:
-	std::vector<std::shared_ptr<Stmt>> stmts;
+	Span<Stmt*> stmts;
+	// Frame slots in use by the end of the block, counting enclosing ones.
+	int num_slots;
 
-	Block(std::vector<std::shared_ptr<Stmt>> stmts) : stmts(stmts) {}
+	Block(Span<Stmt*> stmts) : stmts(stmts), num_slots(0) {}
 
 	void accept(Visitor* visitor) override {
 		visitor->visit_block_stmt(this);
@@ -81,11 +90,11 @@ public:
 
 class If : public Stmt {
 public:
-	std::shared_ptr<Expr> condition;
-	std::shared_ptr<Stmt> then_branch;
-	std::shared_ptr<Stmt> else_branch;
+	Expr* condition;
+	Stmt* then_branch;
+	Stmt* else_branch;
 
-	If(std::shared_ptr<Expr> condition, std::shared_ptr<Stmt> then_branch, std::shared_ptr<Stmt> else_branch) 
+	If(Expr* condition, Stmt* then_branch, Stmt* else_branch) 
 		: condition(condition), then_branch(then_branch), else_branch(else_branch) {}
 
 	void accept(Visitor* visitor) override {
@@ -95,10 +104,14 @@ public:
 
 class While : public Stmt {
 public:
-	std::shared_ptr<Expr> condition;
-	std::shared_ptr<Stmt> body;
+	// nullptr once the Optimizer finds it is always true.
+	Expr* condition;
+	Stmt* body;
+	// Set for desugared for loops so that continue still runs it.
+	Expr* increment;
 
-	While(std::shared_ptr<Expr> condition, std::shared_ptr<Stmt> body) : condition(condition), body(body) {}
+	While(Expr* condition, Stmt* body, Expr* increment = nullptr) 
+		: condition(condition), body(body), increment(increment) {}
 
 	void accept(Visitor* visitor) override {
 		visitor->visit_while_stmt(this);
@@ -107,12 +120,19 @@ public:
 
 class FnStmt : public Stmt {
 public:
-	std::shared_ptr<Token> name;
-	std::vector<std::shared_ptr<Token>> params;
-	std::vector<std::shared_ptr<Stmt>> body;
-
-	FnStmt(std::shared_ptr<Token> name, std::vector<std::shared_ptr<Token>> params, std::vector<std::shared_ptr<Stmt>> body)
-		: name(name), params(params), body(body) {}
+	Token name;
+	Span<Token> params;
+	Span<Stmt*> body;
+	Access access;
+	int slot;
+	int num_slots;
+	Span<Capture> captures;
+	Span<int> boxed;
+	// Set while the body is still unparsed.
+	LazyBody* lazy;
+
+	FnStmt(Token name, Span<Token> params, Span<Stmt*> body, LazyBody* lazy = nullptr)
+		: name(name), params(params), body(body), access(Access_GLOBAL), slot(-1), num_slots(0), lazy(lazy) {}
 
 	void accept(Visitor* visitor) override {
 		visitor->visit_fn_stmt(this);
@@ -121,27 +141,65 @@ public:
 
 class Return : public Stmt {
 public:
-	std::shared_ptr<Token> keyword;
-	std::shared_ptr<Expr> val;
+	Token keyword;
+	Expr* val;
 
-	Return(std::shared_ptr<Token> keyword, std::shared_ptr<Expr> val) : keyword(keyword), val(val) {}
+	Return(Token keyword, Expr* val) : keyword(keyword), val(val) {}
 
 	void accept(Visitor* visitor) override {
 		visitor->visit_return_stmt(this);
 	}
 };
 
+class Break : public Stmt {
+public:
+	Token keyword;
+
+	Break(Token keyword) : keyword(keyword) {}
+
+	void accept(Visitor* visitor) override {
+		visitor->visit_break_stmt(this);
+	}
+};
+
+class Continue : public Stmt {
+public:
+	Token keyword;
+
+	Continue(Token keyword) : keyword(keyword) {}
+
+	void accept(Visitor* visitor) override {
+		visitor->visit_continue_stmt(this);
+	}
+};
+
 class ClassStmt : public Stmt {
 public:
-	std::shared_ptr<Token> name;
-	std::vector<std::shared_ptr<FnStmt>> methods;
+	Token name;
+	Span<FnStmt*> methods;
+	Access access;
+	int slot;
 	
-	ClassStmt(std::shared_ptr<Token> name, std::vector<std::shared_ptr<FnStmt>> methods)
-		: name(name), methods(methods) {}
+	ClassStmt(Token name, Span<FnStmt*> methods)
+		: name(name), methods(methods), access(Access_GLOBAL), slot(-1) {}
 
 	void accept(Visitor* visitor) override {
 		visitor->visit_class_stmt(this);
 	}
 };
 
+// Only allowed at the top level. path is the string literal naming the
+// file, relative to the directory of the file importing it.
+class Import : public Stmt {
+public:
+	Token keyword;
+	Token path;
+
+	Import(Token keyword, Token path) : keyword(keyword), path(path) {}
+
+	void accept(Visitor* visitor) override {
+		visitor->visit_import_stmt(this);
+	}
+};
+
 #endif
\ No newline at end of file
@@ -0,0 +1,30 @@
+#include "Symbol.hpp"
+#include "Heap.hpp"
+
+SymbolTable symbols;
+
+SymbolTable::SymbolTable() {
+	intern("this");
+	intern("__init__");
+	intern("__get__");
+	intern("__set__");
+}
+
+Symbol SymbolTable::intern(std::string_view name) {
+	auto it = ids.find(name);
+	if (it != ids.end()) return it->second;
+	names.emplace_back(name);
+	Symbol sym = names.size() - 1;
+	ids.emplace(names.back(), sym);
+	strings.push_back(nullptr);
+	return sym;
+}
+
+const std::string& SymbolTable::name(Symbol sym) const {
+	return names[sym];
+}
+
+StringObj* SymbolTable::string(Symbol sym) {
+	if (strings[sym] == nullptr) strings[sym] = heap.pin(heap.alloc<StringObj>(names[sym]));
+	return strings[sym];
+}
@@ -0,0 +1,45 @@
+#ifndef SYMBOL
+#define SYMBOL
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <cstdint>
+#include "Obj.hpp"
+
+// Dense id for an identifier or string literal. Scopes, globals, shapes and
+// method tables are keyed on these instead of on strings.
+typedef uint32_t Symbol;
+
+// Interned ahead of anything else, so they have fixed ids.
+enum : Symbol {
+	SYM_THIS, SYM_INIT, SYM_GET, SYM_SET,
+	// Never returned by intern, for slots that have no name.
+	SYM_NONE = UINT32_MAX,
+};
+
+// Process wide interner. Names are never removed, so a symbol and the
+// string_view of its name stay valid for the whole run.
+class SymbolTable {
+public:
+	SymbolTable();
+
+	Symbol intern(std::string_view name);
+
+	const std::string& name(Symbol sym) const;
+
+	// The one StringObj for sym. Every literal with the same text shares
+	// it, so literals can be compared by pointer.
+	StringObj* string(Symbol sym);
+
+private:
+	std::deque<std::string> names;
+	std::unordered_map<std::string_view, Symbol> ids;
+	std::vector<StringObj*> strings;
+};
+
+extern SymbolTable symbols;
+
+#endif
@@ -0,0 +1,141 @@
+#include "Table.hpp"
+#include <cstring>
+
+#define CTRL_EMPTY 0x80
+#define CTRL_DELETED 0xFE
+#define GROUP_WIDTH 8
+#define MIN_CAPACITY 8
+#define NO_SLOT ((size_t) -1)
+
+static const uint64_t LSBS = 0x0101010101010101ULL;
+static const uint64_t MSBS = 0x8080808080808080ULL;
+
+// Value::hash is std::hash, which is the identity for pointers. The low 7
+// bits end up in the control bytes, so everything has to be mixed in.
+static size_t mix(size_t h) {
+	uint64_t x = h;
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdULL;
+	x ^= x >> 33;
+	x *= 0xc4ceb9fe1a85ec53ULL;
+	x ^= x >> 33;
+	return x;
+}
+
+static uint64_t load_group(const uint8_t* ctrl) {
+	uint64_t group;
+	memcpy(&group, ctrl, sizeof(group));
+	return group;
+}
+
+// Sets the high bit of each byte equal to h2. Can report a false match in
+// the byte after a real one, which is fine since keys are compared anyway.
+static uint64_t match_byte(uint64_t group, uint8_t h2) {
+	uint64_t x = group ^ (LSBS * h2);
+	return (x - LSBS) & ~x & MSBS;
+}
+
+static uint64_t match_empty(uint64_t group) {
+	return group & (~group << 6) & MSBS;
+}
+
+static uint64_t match_empty_or_deleted(uint64_t group) {
+	return group & ~(group << 7) & MSBS;
+}
+
+static size_t lowest_byte(uint64_t mask) {
+	return __builtin_ctzll(mask) / 8;
+}
+
+Table::Table() : count(0), tombstones(0) {}
+
+Value* Table::find(const Value& key) {
+	if (count == 0) return nullptr;
+	size_t slot = find_slot(key, mix(key.hash()));
+	return slot == NO_SLOT ? nullptr : &slots[slot].val;
+}
+
+void Table::set(const Value& key, Value val) {
+	size_t hash = mix(key.hash());
+	if (count > 0) {
+		size_t slot = find_slot(key, hash);
+		if (slot != NO_SLOT) {
+			slots[slot].val = val;
+			return;
+		}
+	}
+	// Keep at least one empty slot per 8 so probes always terminate.
+	if ((count + tombstones + 1) * 8 > slots.size() * 7) {
+		rehash(count * 2 + 1 > slots.size() ? slots.size() * 2 : slots.size());
+	}
+	size_t slot = free_slot(hash);
+	if (ctrl[slot] == CTRL_DELETED) tombstones--;
+	ctrl[slot] = hash & 0x7F;
+	slots[slot] = Entry { key, val };
+	count++;
+}
+
+bool Table::remove(const Value& key) {
+	if (count == 0) return false;
+	size_t slot = find_slot(key, mix(key.hash()));
+	if (slot == NO_SLOT) return false;
+	ctrl[slot] = CTRL_DELETED;
+	slots[slot] = Entry();
+	count--;
+	tombstones++;
+	return true;
+}
+
+size_t Table::size() const {
+	return count;
+}
+
+void Table::reserve(size_t n) {
+	size_t capacity = MIN_CAPACITY;
+	while (capacity * 7 < n * 8) capacity *= 2;
+	if (capacity > slots.size()) rehash(capacity);
+}
+
+// Groups are probed in triangular steps, which visits every group once
+// since the number of groups is a power of two.
+size_t Table::find_slot(const Value& key, size_t hash) const {
+	size_t group_mask = slots.size() / GROUP_WIDTH - 1;
+	size_t group = (hash >> 7) & group_mask;
+	uint8_t h2 = hash & 0x7F;
+	for (size_t step = 1;; step++) {
+		const uint8_t* base = &ctrl[group * GROUP_WIDTH];
+		uint64_t bits = load_group(base);
+		for (uint64_t m = match_byte(bits, h2); m != 0; m &= m - 1) {
+			size_t slot = group * GROUP_WIDTH + lowest_byte(m);
+			if (ctrl[slot] == h2 && slots[slot].key.key_equals(key)) return slot;
+		}
+		if (match_empty(bits) != 0) return NO_SLOT;
+		group = (group + step) & group_mask;
+	}
+}
+
+size_t Table::free_slot(size_t hash) const {
+	size_t group_mask = slots.size() / GROUP_WIDTH - 1;
+	size_t group = (hash >> 7) & group_mask;
+	for (size_t step = 1;; step++) {
+		uint64_t m = match_empty_or_deleted(load_group(&ctrl[group * GROUP_WIDTH]));
+		if (m != 0) return group * GROUP_WIDTH + lowest_byte(m);
+		group = (group + step) & group_mask;
+	}
+}
+
+void Table::rehash(size_t capacity) {
+	if (capacity < MIN_CAPACITY) capacity = MIN_CAPACITY;
+	std::vector<uint8_t> old_ctrl = std::move(ctrl);
+	std::vector<Entry> old_slots = std::move(slots);
+	ctrl.assign(capacity, CTRL_EMPTY);
+	slots.assign(capacity, Entry());
+	tombstones = 0;
+	for (size_t i = 0; i < old_slots.size(); i++) {
+		if (!is_full(old_ctrl[i])) continue;
+		size_t hash = mix(old_slots[i].key.hash());
+		size_t slot = free_slot(hash);
+		ctrl[slot] = hash & 0x7F;
+		slots[slot] = old_slots[i];
+	}
+}
@@ -0,0 +1,56 @@
+#ifndef TABLE
+#define TABLE
+
+#include <vector>
+#include <cstdint>
+#include "Value.hpp"
+
+// Open addressing hash table keyed by Value, laid out like a Swiss table.
+// Every slot has a control byte holding 7 bits of its key's hash, and a
+// probe checks a group of 8 control bytes at once before comparing keys.
+class Table {
+public:
+	struct Entry {
+		Value key;
+		Value val;
+	};
+
+	Table();
+
+	// The value stored under key, or nullptr.
+	Value* find(const Value& key);
+
+	void set(const Value& key, Value val);
+
+	// Returns false if key was not in the table.
+	bool remove(const Value& key);
+
+	size_t size() const;
+
+	// Grows the table so n entries fit without rehashing.
+	void reserve(size_t n);
+
+	// Calls f on every entry, in slot order.
+	template <typename F>
+	void for_each(F f) const {
+		for (size_t i = 0; i < slots.size(); i++) {
+			if (is_full(ctrl[i])) f(slots[i]);
+		}
+	}
+
+private:
+	std::vector<uint8_t> ctrl;
+	std::vector<Entry> slots;
+	size_t count;
+	size_t tombstones;
+
+	static bool is_full(uint8_t c) { return (c & 0x80) == 0; }
+
+	size_t find_slot(const Value& key, size_t hash) const;
+
+	size_t free_slot(size_t hash) const;
+
+	void rehash(size_t capacity);
+};
+
+#endif
@@ -1,8 +1,9 @@
 #ifndef TOKEN
 #define TOKEN
 
-#include <string>
-#include "Obj.hpp"
+#include <string_view>
+#include "Value.hpp"
+#include "Symbol.hpp"
 
 enum TokenType {
 	// Single-character tokens
@@ -12,7 +13,7 @@ enum TokenType {
 	// Literals
 	IDENTIFIER, STRING, NUMBER,
 	// Keywords
-	AND, CLASS, ELSE, FALSE, FN, FOR, IF, NIL, OR, PRINT, RETURN, SUPER, THIS, TRUE, LET, WHILE,
+	AND, CLASS, ELSE, FALSE, FN, FOR, IF, NIL, OR, PRINT, RETURN, SUPER, THIS, TRUE, LET, WHILE, BREAK, CONTINUE, IMPORT,
 	// Brackers
 	LEFT_BRACKET, RIGHT_BRACKET,
 	// += -= *= /= %= //=
@@ -21,15 +22,16 @@ enum TokenType {
 	_EOF,
 };
 
-class Token {
-public:
+// Tokens are plain values. lexeme points into the source buffer, which is
+// kept alive for as long as the AST built from it, or at a string literal
+// for tokens the parser makes up. Identifiers and keywords carry their
+// interned symbol.
+struct Token {
 	TokenType type;
-	std::string lexeme;
-	std::shared_ptr<Obj> literal;
+	std::string_view lexeme;
+	Value literal;
 	int line;
-
-	Token(TokenType type, std::string lexeme, std::shared_ptr<Obj> literal, int line) 
-		: type(type), lexeme(lexeme), literal(literal), line(line) {}
+	Symbol symbol = SYM_NONE;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,445 @@
+#include "VM.hpp"
+
+Upvalue::Upvalue(int slot) : Obj(OBJ_UPVALUE), slot(slot), next(nullptr) {}
+
+void Upvalue::trace() {
+	heap.mark(closed);
+}
+
+Closure::Closure(VM* vm, Proto* proto) : Callable(OBJ_CLOSURE), vm(vm), proto(proto) {}
+
+Value Closure::call(Interpreter* interpreter, const std::vector<Value>& arguments) {
+	return vm->call_closure(this, Value(), arguments);
+}
+
+Value Closure::call_method(Interpreter* interpreter, Value receiver, const std::vector<Value>& arguments) {
+	return vm->call_closure(this, receiver, arguments);
+}
+
+int Closure::num_params() {
+	return proto->arity;
+}
+
+void Closure::trace() {
+	heap.mark(proto);
+	for (auto u : upvalues) heap.mark(u);
+}
+
+VM::VM(Interpreter* host) : host(host), open_upvalues(nullptr) {
+	heap.add_roots([this]() { mark_roots(); });
+	globals[symbols.intern("clock")] = heap.alloc<Clock>();
+	globals[symbols.intern("List")] = heap.alloc<List>();
+	globals[symbols.intern("Map")] = heap.alloc<Map>();
+	globals[symbols.intern("StringBuilder")] = heap.alloc<StringBuilder>();
+}
+
+// The script runs once, so its proto is unpinned after. Closures made
+// from it keep the protos of their own bodies alive.
+void VM::interpret(Span<Stmt*> stmts) {
+	Compiler compiler;
+	auto script = heap.alloc<Closure>(this, compiler.compile(stmts));
+	Root script_root(script);
+	heap.unpin(script->proto);
+	std::vector<Value> arguments;
+	try {
+		call_closure(script, Value(), arguments);
+	} catch (RuntimeError& e) {
+		reset();
+		throw;
+	}
+}
+
+Value VM::call_closure(Closure* closure, Value receiver, const std::vector<Value>& arguments) {
+	push(receiver);
+	for (auto& a : arguments) push(a);
+	call(closure, arguments.size());
+	return run(frames.size() - 1);
+}
+
+Value VM::run(size_t exit_depth) {
+	for (;;) {
+		uint8_t op = read_byte();
+		switch (op) {
+			case OP_CONSTANT: push(read_constant()); break;
+			case OP_NIL: push(Value()); break;
+			case OP_TRUE: push(Value(true)); break;
+			case OP_FALSE: push(Value(false)); break;
+			case OP_POP: stack.pop_back(); break;
+			case OP_GET_LOCAL: {
+				uint8_t slot = read_byte();
+				push(stack[frames.back().base + slot]);
+				break;
+			}
+			case OP_SET_LOCAL: {
+				uint8_t slot = read_byte();
+				stack[frames.back().base + slot] = peek(0);
+				break;
+			}
+			case OP_GET_UPVALUE: {
+				uint8_t slot = read_byte();
+				push(upvalue_ref(frames.back().closure->upvalues[slot]));
+				break;
+			}
+			case OP_SET_UPVALUE: {
+				uint8_t slot = read_byte();
+				upvalue_ref(frames.back().closure->upvalues[slot]) = peek(0);
+				break;
+			}
+			case OP_GET_GLOBAL: {
+				Symbol name = read_name();
+				auto it = globals.find(name);
+				if (it == globals.end()) throw error("Undefined variable '" + symbols.name(name) + "'");
+				push(it->second);
+				break;
+			}
+			case OP_DEFINE_GLOBAL: {
+				Symbol name = read_name();
+				globals[name] = pop();
+				break;
+			}
+			case OP_SET_GLOBAL: {
+				Symbol name = read_name();
+				auto it = globals.find(name);
+				if (it == globals.end()) throw error("Undefined variable '" + symbols.name(name) + "'");
+				it->second = peek(0);
+				break;
+			}
+			case OP_GET_PROPERTY: {
+				Symbol name = read_name();
+				InlineCache& cache = read_cache();
+				if (!peek(0).is_instance()) throw error("Only instances have properties");
+				auto instance = static_cast<Instance*>(peek(0).as_obj());
+				const CacheEntry* entry = instance->lookup(name, cache);
+				if (entry == nullptr) throw error("Undefined property '" + symbols.name(name) + "'");
+				if (entry->index >= 0) peek(0) = instance->fields[entry->index];
+				else peek(0) = heap.alloc<BoundMethod>(instance, entry->method);
+				break;
+			}
+			case OP_SET_PROPERTY: {
+				Symbol name = read_name();
+				InlineCache& cache = read_cache();
+				if (!peek(1).is_instance()) throw error("Only instances have feilds");
+				static_cast<Instance*>(peek(1).as_obj())->set(name, peek(0), cache);
+				auto val = pop();
+				peek(0) = val;
+				break;
+			}
+			case OP_EQUAL:
+			case OP_NOT_EQUAL:
+			case OP_GREATER:
+			case OP_GREATER_EQUAL:
+			case OP_LESS:
+			case OP_LESS_EQUAL:
+			case OP_ADD:
+			case OP_SUBTRACT:
+			case OP_MULTIPLY:
+			case OP_DIVIDE:
+			case OP_MOD:
+			case OP_POW:
+			case OP_INT_DIVIDE:
+				binary_op(op);
+				break;
+			case OP_NOT:
+				peek(0) = Value(!host->is_truthy(peek(0)));
+				break;
+			case OP_NEGATE:
+				if (!peek(0).is_number()) throw error("Operand must be a number");
+				peek(0) = Value(-peek(0).as_number());
+				break;
+			case OP_PRINT:
+				std::cout << host->stringify(pop()) << '\n';
+				break;
+			case OP_JUMP: {
+				uint16_t offset = read_short();
+				frames.back().ip += offset;
+				break;
+			}
+			case OP_JUMP_IF_FALSE: {
+				uint16_t offset = read_short();
+				if (!host->is_truthy(peek(0))) frames.back().ip += offset;
+				break;
+			}
+			case OP_LOOP: {
+				uint16_t offset = read_short();
+				frames.back().ip -= offset;
+				break;
+			}
+			case OP_CALL: {
+				int argc = read_byte();
+				call_value(peek(argc), argc);
+				break;
+			}
+			case OP_INVOKE: {
+				Symbol name = read_name();
+				int argc = read_byte();
+				invoke(name, argc, read_cache());
+				break;
+			}
+			case OP_CLOSURE: {
+				auto proto = static_cast<Proto*>(read_constant().as_obj());
+				auto closure = heap.alloc<Closure>(this, proto);
+				// Pushed before capturing so the upvalues are reachable as they are made.
+				push(closure);
+				for (int i = 0; i < proto->upvalue_count; i++) {
+					uint8_t is_local = read_byte();
+					uint8_t index = read_byte();
+					if (is_local) closure->upvalues.push_back(capture_upvalue(frames.back().base + index));
+					else closure->upvalues.push_back(frames.back().closure->upvalues[index]);
+				}
+				break;
+			}
+			case OP_CLOSE_UPVALUE:
+				close_upvalues(stack.size() - 1);
+				stack.pop_back();
+				break;
+			case OP_RETURN: {
+				auto result = pop();
+				int base = frames.back().base;
+				close_upvalues(base);
+				stack.resize(base);
+				frames.pop_back();
+				if (frames.size() == exit_depth) return result;
+				push(result);
+				break;
+			}
+			case OP_CLASS: {
+				auto methods = std::make_shared<std::unordered_map<Symbol, Callable*>>();
+				push(heap.alloc<Class>(symbols.name(read_name()), methods));
+				break;
+			}
+			case OP_METHOD: {
+				Symbol name = read_name();
+				auto method = static_cast<Callable*>(peek(0).as_obj());
+				auto klass = static_cast<Class*>(peek(1).as_obj());
+				(*klass->methods)[name] = method;
+				stack.pop_back();
+				break;
+			}
+			case OP_IMPORT: {
+				Token path { STRING, "", read_constant(), curr_line() };
+				Module* module = modules.enter(path);
+				if (module != nullptr) {
+					ModuleRun run(module);
+					try {
+						interpret(module->stmts);
+					} catch (RuntimeError& e) {
+						throw Modules::in_module(path, e);
+					}
+					run.finish();
+				}
+				break;
+			}
+		}
+	}
+}
+
+void VM::push(Value val) {
+	stack.push_back(std::move(val));
+}
+
+Value VM::pop() {
+	auto val = std::move(stack.back());
+	stack.pop_back();
+	return val;
+}
+
+Value& VM::peek(int dist) {
+	return stack[stack.size() - 1 - dist];
+}
+
+uint8_t VM::read_byte() {
+	return *frames.back().ip++;
+}
+
+uint16_t VM::read_short() {
+	uint16_t hi = read_byte();
+	return (hi << 8) | read_byte();
+}
+
+Value& VM::read_constant() {
+	return frames.back().closure->proto->chunk.constants[read_short()];
+}
+
+Symbol VM::read_name() {
+	return frames.back().closure->proto->chunk.names[read_short()];
+}
+
+InlineCache& VM::read_cache() {
+	return frames.back().closure->proto->caches[read_short()];
+}
+
+void VM::call_value(Value callee, int argc) {
+	if (!callee.is_callable()) throw error("Object is not callable");
+	auto fn = static_cast<Callable*>(callee.as_obj());
+	check_arity(fn, argc);
+	switch (fn->obj_type) {
+		case OBJ_CLOSURE:
+			call(static_cast<Closure*>(fn), argc);
+			break;
+		case OBJ_BOUND_METHOD: {
+			auto bound = static_cast<BoundMethod*>(fn);
+			peek(argc) = bound->receiver;
+			if (bound->method->obj_type == OBJ_CLOSURE) call(static_cast<Closure*>(bound->method), argc);
+			else call_native(bound->method, argc);
+			break;
+		}
+		case OBJ_CLASS: {
+			auto klass = static_cast<Class*>(fn);
+			peek(argc) = heap.alloc<Instance>(klass->name, klass->methods, klass->shape);
+			auto init = klass->methods->find(SYM_INIT);
+			if (init != klass->methods->end() && init->second->obj_type == OBJ_CLOSURE) {
+				call(static_cast<Closure*>(init->second), argc);
+			}
+			break;
+		}
+		default: {
+			std::vector<Value> arguments(stack.end() - argc, stack.end());
+			Value result;
+			try {
+				result = fn->call(host, arguments);
+			} catch (NativeError& e) {
+				throw error(e.what());
+			}
+			stack.resize(stack.size() - argc - 1);
+			push(result);
+		}
+	}
+}
+
+// Runs a native method on the receiver sitting below its arguments.
+void VM::call_native(Callable* method, int argc) {
+	std::vector<Value> arguments(stack.end() - argc, stack.end());
+	Value result;
+	try {
+		result = method->call_method(host, peek(argc), arguments);
+	} catch (NativeError& e) {
+		throw error(e.what());
+	}
+	stack.resize(stack.size() - argc - 1);
+	push(result);
+}
+
+void VM::invoke(Symbol name, int argc, InlineCache& cache) {
+	if (!peek(argc).is_instance()) throw error("Only instances have properties");
+	auto instance = static_cast<Instance*>(peek(argc).as_obj());
+	const CacheEntry* entry = instance->lookup(name, cache);
+	if (entry == nullptr) throw error("Undefined property '" + symbols.name(name) + "'");
+	if (entry->index >= 0) {
+		Value field = instance->fields[entry->index];
+		peek(argc) = field;
+		call_value(field, argc);
+		return;
+	}
+	check_arity(entry->method, argc);
+	if (entry->method->obj_type == OBJ_CLOSURE) call(static_cast<Closure*>(entry->method), argc);
+	else call_native(entry->method, argc);
+}
+
+void VM::call(Closure* closure, int argc) {
+	const uint8_t* ip = closure->proto->chunk.code.data();
+	frames.push_back(CallFrame { closure, ip, (int) stack.size() - argc - 1 });
+}
+
+void VM::check_arity(Callable* callee, int argc) {
+	if (argc != callee->num_params()) throw error("Incorect number of arguments");
+}
+
+Upvalue* VM::capture_upvalue(int slot) {
+	Upvalue* prev = nullptr;
+	Upvalue* upvalue = open_upvalues;
+	while (upvalue != nullptr && upvalue->slot > slot) {
+		prev = upvalue;
+		upvalue = upvalue->next;
+	}
+	if (upvalue != nullptr && upvalue->slot == slot) return upvalue;
+	auto created = heap.alloc<Upvalue>(slot);
+	created->next = upvalue;
+	if (prev == nullptr) open_upvalues = created;
+	else prev->next = created;
+	return created;
+}
+
+void VM::close_upvalues(int last) {
+	while (open_upvalues != nullptr && open_upvalues->slot >= last) {
+		auto upvalue = open_upvalues;
+		upvalue->closed = stack[upvalue->slot];
+		upvalue->slot = -1;
+		open_upvalues = upvalue->next;
+		upvalue->next = nullptr;
+	}
+}
+
+Value& VM::upvalue_ref(Upvalue* upvalue) {
+	if (upvalue->slot >= 0) return stack[upvalue->slot];
+	return upvalue->closed;
+}
+
+void VM::binary_op(uint8_t op) {
+	Value right = pop();
+	Value left = pop();
+
+	if (left.is_nil() || right.is_nil()) throw error("nil can not be added");
+
+	if (left.is_number() && right.is_number()) {
+		double a = left.as_number();
+		double b = right.as_number();
+		switch (op) {
+			case OP_EQUAL: push(Value(a == b)); return;
+			case OP_NOT_EQUAL: push(Value(a != b)); return;
+			case OP_GREATER: push(Value(a > b)); return;
+			case OP_GREATER_EQUAL: push(Value(a >= b)); return;
+			case OP_LESS: push(Value(a < b)); return;
+			case OP_LESS_EQUAL: push(Value(a <= b)); return;
+			case OP_ADD: push(Value(a + b)); return;
+			case OP_SUBTRACT: push(Value(a - b)); return;
+			case OP_MULTIPLY: push(Value(a * b)); return;
+			case OP_DIVIDE: push(Value(a / b)); return;
+			case OP_MOD: push(Value((double) ((long) a % (long) b))); return;
+			case OP_POW: push(Value(pow(a, b))); return;
+			case OP_INT_DIVIDE: push(Value((double) ((long) a / (long) b))); return;
+		}
+	}
+
+	switch (op) {
+		case OP_EQUAL: push(Value(host->is_equal(left, right))); return;
+		case OP_NOT_EQUAL: push(Value(!host->is_equal(left, right))); return;
+		case OP_ADD:
+			if (left.is_string()) {
+				auto& string_left = static_cast<StringObj*>(left.as_obj())->val;
+				if (right.is_string()) {
+					push(heap.alloc<StringObj>(string_left + static_cast<StringObj*>(right.as_obj())->val));
+					return;
+				}
+				if (right.is_number() || right.is_bool()) {
+					push(heap.alloc<StringObj>(string_left + host->stringify(right)));
+					return;
+				}
+			}
+			throw error("Operands can not be added with '+'");
+		default:
+			throw error("Operands must be a number");
+	}
+}
+
+int VM::curr_line() {
+	auto& frame = frames.back();
+	auto& chunk = frame.closure->proto->chunk;
+	return chunk.lines[frame.ip - chunk.code.data() - 1];
+}
+
+RuntimeError VM::error(const std::string& msg) {
+	return RuntimeError(Token { _EOF, "", Value(), curr_line() }, msg);
+}
+
+void VM::mark_roots() {
+	for (auto& v : stack) heap.mark(v);
+	for (auto& f : frames) heap.mark(f.closure);
+	for (auto& g : globals) heap.mark(g.second);
+	for (Upvalue* u = open_upvalues; u != nullptr; u = u->next) heap.mark(u);
+}
+
+void VM::reset() {
+	stack.clear();
+	frames.clear();
+	open_upvalues = nullptr;
+}
@@ -0,0 +1,114 @@
+#ifndef VIRTUAL_MACHINE
+#define VIRTUAL_MACHINE
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include "Value.hpp"
+#include "Chunk.hpp"
+#include "Compiler.hpp"
+#include "Interpreter.hpp"
+#include "Callable.hpp"
+#include "Error.hpp"
+#include "Heap.hpp"
+
+class VM;
+
+struct Upvalue : public Obj {
+	// Index of the captured stack slot while the variable is still live,
+	// -1 once it has been closed over and moved into closed.
+	int slot;
+	Value closed;
+	Upvalue* next;
+
+	Upvalue(int slot);
+
+	void trace() override;
+};
+
+struct Closure : public Callable {
+	VM* vm;
+	Proto* proto;
+	std::vector<Upvalue*> upvalues;
+
+	Closure(VM* vm, Proto* proto);
+
+	Value call(Interpreter* interpreter, const std::vector<Value>& arguments) override;
+
+	Value call_method(Interpreter* interpreter, Value receiver, const std::vector<Value>& arguments) override;
+
+	int num_params() override;
+
+	void trace() override;
+};
+
+// Stack based bytecode interpreter. Produces the same results as Interpreter,
+// which it also uses as the host for native callables and value helpers.
+class VM {
+public:
+	VM(Interpreter* host);
+
+	void interpret(Span<Stmt*> stmts);
+
+	Value call_closure(Closure* closure, Value receiver, const std::vector<Value>& arguments);
+
+private:
+	struct CallFrame {
+		Closure* closure;
+		const uint8_t* ip;
+		int base;
+	};
+
+	Interpreter* host;
+	std::vector<Value> stack;
+	std::vector<CallFrame> frames;
+	std::unordered_map<Symbol, Value> globals;
+	Upvalue* open_upvalues;
+
+	void mark_roots();
+
+	Value run(size_t exit_depth);
+
+	void push(Value val);
+
+	Value pop();
+
+	Value& peek(int dist);
+
+	uint8_t read_byte();
+
+	uint16_t read_short();
+
+	Value& read_constant();
+
+	Symbol read_name();
+
+	InlineCache& read_cache();
+
+	void call_value(Value callee, int argc);
+
+	void invoke(Symbol name, int argc, InlineCache& cache);
+
+	void call(Closure* closure, int argc);
+
+	void call_native(Callable* method, int argc);
+
+	void check_arity(Callable* callee, int argc);
+
+	Upvalue* capture_upvalue(int slot);
+
+	void close_upvalues(int last);
+
+	Value& upvalue_ref(Upvalue* upvalue);
+
+	void binary_op(uint8_t op);
+
+	// The line of the instruction running.
+	int curr_line();
+
+	RuntimeError error(const std::string& msg);
+
+	void reset();
+};
+
+#endif
@@ -0,0 +1,45 @@
+#include "Value.hpp"
+
+std::string Value::to_string() const {
+	switch (type) {
+		case VAL_NIL: return "nil";
+		case VAL_BOOL: return as.boolean ? "true" : "false";
+		case VAL_NUMBER: {
+			auto num_str = std::to_string(as.number);
+			while (num_str.back() == '0') num_str.pop_back();
+			if (num_str.back() == '.') num_str.pop_back();
+			return num_str;
+		}
+		case VAL_OBJ: return as.obj->to_string();
+	}
+	return "";
+}
+
+size_t Value::hash() const {
+	switch (type) {
+		case VAL_NIL: return 0;
+		case VAL_BOOL: return std::hash<bool>()(as.boolean);
+		// 0 and -0 are equal keys, so they have to hash the same.
+		case VAL_NUMBER: return as.number == 0 ? 0 : std::hash<double>()(as.number);
+		case VAL_OBJ:
+			if (as.obj->obj_type == OBJ_STRING) return static_cast<StringObj*>(as.obj)->hash();
+			return std::hash<Obj*>()(as.obj);
+	}
+	return 0;
+}
+
+bool Value::key_equals(const Value& other) const {
+	if (type != other.type) return false;
+	switch (type) {
+		case VAL_NIL: return true;
+		case VAL_BOOL: return as.boolean == other.as.boolean;
+		case VAL_NUMBER: return as.number == other.as.number;
+		case VAL_OBJ:
+			if (as.obj == other.as.obj) return true;
+			if (as.obj->obj_type != OBJ_STRING || other.as.obj->obj_type != OBJ_STRING) return false;
+			auto a = static_cast<StringObj*>(as.obj);
+			auto b = static_cast<StringObj*>(other.as.obj);
+			return a->hash() == b->hash() && a->val == b->val;
+	}
+	return false;
+}
@@ -0,0 +1,74 @@
+#ifndef VALUE
+#define VALUE
+
+#include <string>
+#include <cstddef>
+#include <type_traits>
+#include "Obj.hpp"
+
+enum ValueType { VAL_NIL, VAL_BOOL, VAL_NUMBER, VAL_OBJ };
+
+// nil, bools and numbers are stored inline so arithmetic never allocates.
+// Only strings, functions, classes and instances are boxed in an Obj, which
+// is owned by the Heap rather than by the values pointing at it.
+struct Value {
+	ValueType type;
+	union {
+		bool boolean;
+		double number;
+		Obj* obj;
+	} as;
+
+	Value() : type(VAL_NIL) {
+		as.number = 0;
+	}
+
+	Value(std::nullptr_t) : Value() {}
+
+	explicit Value(bool boolean) : type(VAL_BOOL) {
+		as.number = 0;
+		as.boolean = boolean;
+	}
+
+	explicit Value(double number) : type(VAL_NUMBER) {
+		as.number = number;
+	}
+
+	template <typename T, typename = typename std::enable_if<std::is_base_of<Obj, T>::value>::type>
+	Value(T* obj) : type(obj ? VAL_OBJ : VAL_NIL) {
+		as.number = 0;
+		as.obj = obj;
+	}
+
+	bool is_nil() const { return type == VAL_NIL; }
+
+	bool is_bool() const { return type == VAL_BOOL; }
+
+	bool is_number() const { return type == VAL_NUMBER; }
+
+	bool is_obj() const { return type == VAL_OBJ; }
+
+	bool as_bool() const { return as.boolean; }
+
+	double as_number() const { return as.number; }
+
+	Obj* as_obj() const { return type == VAL_OBJ ? as.obj : nullptr; }
+
+	bool is_obj_type(ObjType obj_type) const { return type == VAL_OBJ && as.obj->obj_type == obj_type; }
+
+	bool is_string() const { return is_obj_type(OBJ_STRING); }
+
+	bool is_instance() const { return type == VAL_OBJ && as.obj->is_instance(); }
+
+	bool is_callable() const { return type == VAL_OBJ && as.obj->is_callable(); }
+
+	std::string to_string() const;
+
+	size_t hash() const;
+
+	// Equality used for map keys. Numbers, bools and strings compare by
+	// value, other objects by identity.
+	bool key_equals(const Value& other) const;
+};
+
+#endif
@@ -0,0 +1,25 @@
+#!/bin/bash
+# Runs every script in bench/ through ./main and prints the best user plus
+# system CPU time of several runs of each, the way the timings in the commit
+# log were taken. Flags after the options go to main, so
+#   bench/run.sh -n 7 --vm
+# times the VM with the best of 7.
+cd "$(dirname "$0")/.." || exit 1
+runs=5
+if [ "$1" = "-n" ]; then
+	runs=$2
+	shift 2
+fi
+if [ ! -x ./main ]; then
+	echo "bench/run.sh: build ./main first" >&2
+	exit 1
+fi
+TIMEFORMAT='%U %S'
+for f in bench/*.txt; do
+	best=""
+	for ((i = 0; i < runs; i++)); do
+		t=$( { time ./main "$@" "$f" >/dev/null 2>&1; } 2>&1 | awk '{ print $1 + $2 }')
+		best=$(awk -v a="$t" -v b="$best" 'BEGIN { print (b == "" || a < b) ? a : b }')
+	done
+	printf '%-12s %.3fs\n' "$(basename "$f" .txt)" "$best"
+done
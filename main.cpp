@@ -2,36 +2,147 @@
 #include <fstream>
 #include <sstream>
 #include <string>
-#include <string>
 #include <vector>
+#include <deque>
 #include <stdexcept>
+#include <algorithm>
+#include <cstdlib>
 #include "Error.hpp"
 #include "Interpreter.hpp"
 #include "Token.hpp"
 #include "Scanner.hpp"
 #include "Parser.hpp"
 #include "Resolver.hpp"
+#include "Optimizer.hpp"
+#include "AstPrinter.hpp"
+#include "VM.hpp"
+#include "Heap.hpp"
+#include "Jit.hpp"
+#include "Cache.hpp"
+#include "AotCompiler.hpp"
+#include "Module.hpp"
+#include "ParallelParser.hpp"
 
-Interpreter interpreter;
+// Created in main so the heap can scan everything below main's frame.
+Interpreter* interpreter;
+VM* vm;
+bool use_vm;
+bool use_jit;
+bool use_cache;
+bool use_lazy;
+bool use_stream;
+bool gc_stats;
+bool dump_ast;
+bool spec_stats;
+bool parse_stats;
+// Threads for the front end. More than one splits it with ParallelParser.
+int parse_threads = 1;
+// Where --aot writes the C++ for the script, which is then not run.
+std::string aot_path;
 bool had_error;
 bool had_runtime_error;
+// Tokens point into the text, or into the cache file the AST was read
+// from, and the AST lives in the arena. Functions can keep parts of an AST
+// alive past the run that built it, so sources are kept for the whole
+// session. The tokens are kept for the bodies a lazy parse skipped, and
+// parts are the arenas of the statements parsed on other threads.
+struct Source {
+	std::string text;
+	std::vector<Token> tokens;
+	Arena arena;
+	std::vector<Arena> parts;
+	CacheFile cache;
+};
+
+std::deque<Source> sources;
+
+// With a cache_path, the front end is skipped if that file holds the AST
+// for this exact source, and the file is written otherwise.
+void run(std::string source, const std::string& cache_path = "") {
+	Span<Stmt*> stmts;
+	try {
+		sources.emplace_back();
+		Source& src = sources.back();
+		src.text = std::move(source);
+		uint64_t hash = cache_path.empty() ? 0 : hash_source(src.text);
+		if (cache_path.empty() || dump_ast || !src.cache.load(cache_path, hash, src.arena, stmts)) {
+			// Everything but the tree walker needs the whole AST up front.
+			bool lazy = use_lazy && !use_vm && aot_path.empty() && cache_path.empty() && !dump_ast;
+			bool parallel = false;
+			if (parse_threads > 1 && !lazy) {
+				ParallelParser parallel_parser(src.text, parse_threads);
+				parallel = parallel_parser.parse(src.arena, src.parts, stmts);
+				if (parse_stats) parallel_parser.report(std::cerr);
+			}
+			if (!parallel) {
+				Scanner scanner(src.text);
+				src.tokens = scanner.scan_tokens();
+				Parser parser(src.tokens, src.arena, lazy);
+				stmts = parser.parse();
+				if (!lazy) std::vector<Token>().swap(src.tokens);
+			}
+			Resolver resolver(src.arena);
+			resolver.resolve(stmts);
+			if (dump_ast) {
+				std::cerr << "== ast ==\n";
+				AstPrinter(std::cerr).print(stmts);
+			}
+			Optimizer optimizer(src.arena);
+			stmts = optimizer.optimize(stmts);
+			if (dump_ast) {
+				std::cerr << "== optimized ==\n";
+				AstPrinter(std::cerr).print(stmts);
+			}
+			if (!cache_path.empty()) write_cache(cache_path, hash, stmts);
+		}
+		if (!aot_path.empty()) {
+			std::ofstream out(aot_path);
+			out << AotCompiler().compile(stmts);
+			if (!out) {
+				std::cout << "Error: Could not write file " << aot_path << std::endl;
+				std::exit(1);
+			}
+		} else if (use_vm) vm->interpret(stmts);
+		else interpreter->interpret(stmts);
+	} catch (SyntaxError& e) {
+		std::cout << "Syntax error: [line: " << e.line << "] " << e.what() << '\n';
+		had_error = true;
+	} catch (RuntimeError& e) {
+		std::cout << "Runtime error: [line: " << e.token.line << "] " << e.what() << '\n';
+		had_error = true;
+		had_runtime_error = true;
+	}
+}
 
-void run(std::string source) {
-	std::vector<std::shared_ptr<Stmt>> stmts;
+// For --stream. Each top level declaration is scanned, parsed, resolved,
+// optimized and run before the next one is read. Its nodes are freed once
+// it has run, unless it made functions that still point into them. The VM
+// compiles everything it needs out of the AST, so there it frees them all.
+void run_stream(std::istream& in) {
+	Arena arena;
+	Scanner scanner(in);
+	Parser parser(scanner, arena);
+	Resolver resolver(arena);
 	try {
-		Scanner scanner(source);
-		std::vector<std::shared_ptr<Token>> tokens = scanner.scan_tokens();
-		
-		Parser parser(tokens);
-		stmts = parser.parse();
-		Resolver resolver(&interpreter);
-		resolver.resolve(stmts);
-		interpreter.interpret(stmts);
+		int functions = 0;
+		while (Stmt* stmt = parser.next()) {
+			Span<Stmt*> stmts(&stmt, 1);
+			resolver.resolve(stmts);
+			stmts = Optimizer(arena).optimize(stmts);
+			if (use_vm) vm->interpret(stmts);
+			else interpreter->interpret(stmts);
+			if (!use_vm && parser.num_functions() != functions) {
+				sources.emplace_back();
+				sources.back().arena = std::move(arena);
+				functions = parser.num_functions();
+			}
+			arena.clear();
+		}
 	} catch (SyntaxError& e) {
 		std::cout << "Syntax error: [line: " << e.line << "] " << e.what() << '\n';
 		had_error = true;
 	} catch (RuntimeError& e) {
-		std::cout << "Runtime error: [line: " << e.token->line << "] " << e.what() << '\n';
+		std::cout << "Runtime error: [line: " << e.token.line << "] " << e.what() << '\n';
 		had_error = true;
 		had_runtime_error = true;
 	}
@@ -50,13 +161,21 @@ void run_prompt() {
 void run_file(const std::string& path) {
     std::ifstream file(path);
     if (file.is_open()) {
-        std::stringstream ss;
-        ss << file.rdbuf();
-        std::string file_content = ss.str();
-        file.close();
+        modules.set_main(path);
+        // The cache, --aot and --dump-ast work on the whole program.
+        if (use_stream && !use_cache && aot_path.empty() && !dump_ast) {
+            run_stream(file);
+        } else {
+            std::stringstream ss;
+            ss << file.rdbuf();
+            std::string file_content = ss.str();
+            file.close();
 
-        run(file_content);
+            run(file_content, use_cache ? path + ".cache" : "");
+        }
 
+        if (gc_stats) heap.report(std::cerr);
+        if (spec_stats) interpreter->report_specialization(std::cerr);
         if (had_error) std::exit(65);
         if (had_runtime_error) std::exit(70);
     } else {
@@ -66,7 +185,32 @@ void run_file(const std::string& path) {
 }
 
 int main(int argc, char* argv[]) {
-	if (argc > 2) std::cout << "Usage: jlox [script]" << std::endl;
-    else if (argc == 2) run_file(argv[1]);
+	heap.set_stack_base(__builtin_frame_address(0));
+	Interpreter main_interpreter;
+	VM main_vm(&main_interpreter);
+	interpreter = &main_interpreter;
+	vm = &main_vm;
+	Jit main_jit(main_interpreter.globals);
+
+	std::vector<std::string> args;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--vm") use_vm = true;
+		else if (arg == "--jit") use_jit = true;
+		else if (arg == "--cache") use_cache = true;
+		else if (arg == "--lazy") use_lazy = true;
+		else if (arg == "--stream") use_stream = true;
+		else if (arg == "--aot" && i + 1 < argc) aot_path = argv[++i];
+		else if (arg == "--gc-stats") gc_stats = true;
+		else if (arg == "--dump-ast") dump_ast = true;
+		else if (arg == "--spec-stats") spec_stats = true;
+		else if (arg == "--parse-threads" && i + 1 < argc) parse_threads = std::max(1, atoi(argv[++i]));
+		else if (arg == "--parse-stats") parse_stats = true;
+		else args.push_back(arg);
+	}
+	if (use_jit) main_interpreter.jit = &main_jit;
+	modules.lazy = use_lazy && !use_vm && aot_path.empty();
+	if (args.size() > 1) std::cout << "Usage: jlox [--vm] [--jit] [--cache] [--lazy] [--stream] [--aot out.cpp] [--parse-threads n] [--gc-stats] [--dump-ast] [--spec-stats] [--parse-stats] [script]" << std::endl;
+    else if (args.size() == 1) run_file(args[0]);
     else run_prompt();
 }
\ No newline at end of file